@@ -1,5 +1,6 @@
 #include "Session.h"
 #include <google/protobuf/message.h>
+#include <cstdlib>
 #include "proto/Message.pb.h"
 #include "util/Logger.h"
 #include "util/NetDefine.h"
@@ -71,11 +72,13 @@ void Session::list_project_files(const std::string &proj_name) {
 
 void Session::get_symbol_definition(const std::string &proj_name,
                                     const std::string &symbol,
-                                    const std::string &abs_path) {
+                                    const std::string &abs_path,
+                                    const std::string &with_metadata) {
   GetSymbolDefinitionReq req;
   req.set_proj_name(proj_name);
   req.set_symbol(symbol);
   req.set_abs_path(abs_path);
+  req.set_with_metadata(with_metadata == "meta");
 
   GetSymbolDefinitionRsp rsp;
   send_and_recv(MessageID::GET_SYMBOL_DEFINITION_REQ, req, rsp);
@@ -94,10 +97,12 @@ void Session::get_symbol_references(const std::string &proj_name,
 }
 
 void Session::list_file_symbols(const std::string &proj_name,
-                                const std::string &rel_path) {
+                                const std::string &rel_path,
+                                const std::string &with_metadata) {
   ListFileSymbolsReq req;
   req.set_proj_name(proj_name);
   req.set_relative_path(rel_path);
+  req.set_with_metadata(with_metadata == "meta");
 
   ListFileSymbolsRsp rsp;
   send_and_recv(MessageID::LIST_FILE_SYMBOLS_REQ, req, rsp);
@@ -123,6 +128,119 @@ void Session::rebuild_file(const std::string &proj_name,
   send_and_recv(MessageID::REBUILD_FILE_REQ, req, rsp);
 }
 
+void Session::get_symbol_at_position(const std::string &proj_name,
+                                     const std::string &abs_path,
+                                     const std::string &line,
+                                     const std::string &column) {
+  GetSymbolAtPositionReq req;
+  req.set_proj_name(proj_name);
+  req.set_abs_path(abs_path);
+  req.set_line(std::strtoul(line.c_str(), nullptr, 10));
+  req.set_column(std::strtoul(column.c_str(), nullptr, 10));
+
+  GetSymbolAtPositionRsp rsp;
+  send_and_recv(MessageID::GET_SYMBOL_AT_POSITION_REQ, req, rsp);
+}
+
+void Session::get_callers(const std::string &proj_name,
+                          const std::string &symbol,
+                          const std::string &depth) {
+  GetCallersReq req;
+  req.set_proj_name(proj_name);
+  req.set_symbol(symbol);
+  req.set_depth(std::strtoul(depth.c_str(), nullptr, 10));
+
+  GetCallersRsp rsp;
+  send_and_recv(MessageID::GET_CALLERS_REQ, req, rsp);
+}
+
+void Session::get_callees(const std::string &proj_name,
+                          const std::string &symbol,
+                          const std::string &depth) {
+  GetCalleesReq req;
+  req.set_proj_name(proj_name);
+  req.set_symbol(symbol);
+  req.set_depth(std::strtoul(depth.c_str(), nullptr, 10));
+
+  GetCalleesRsp rsp;
+  send_and_recv(MessageID::GET_CALLEES_REQ, req, rsp);
+}
+
+void Session::get_type_hierarchy(const std::string &proj_name,
+                                 const std::string &symbol,
+                                 const std::string &direction,
+                                 const std::string &depth) {
+  GetTypeHierarchyReq req;
+  req.set_proj_name(proj_name);
+  req.set_symbol(symbol);
+  req.set_direction(direction == "base" ? GetTypeHierarchyReq::BASE
+                                        : GetTypeHierarchyReq::DERIVED);
+  req.set_depth(std::strtoul(depth.c_str(), nullptr, 10));
+
+  GetTypeHierarchyRsp rsp;
+  send_and_recv(MessageID::GET_TYPE_HIERARCHY_REQ, req, rsp);
+}
+
+void Session::get_overrides(const std::string &proj_name,
+                            const std::string &symbol,
+                            const std::string &direction,
+                            const std::string &depth) {
+  GetOverridesReq req;
+  req.set_proj_name(proj_name);
+  req.set_symbol(symbol);
+  req.set_direction(direction == "overridden" ? GetOverridesReq::OVERRIDDEN
+                                              : GetOverridesReq::OVERRIDERS);
+  req.set_depth(std::strtoul(depth.c_str(), nullptr, 10));
+
+  GetOverridesRsp rsp;
+  send_and_recv(MessageID::GET_OVERRIDES_REQ, req, rsp);
+}
+
+void Session::get_includes(const std::string &proj_name,
+                           const std::string &path,
+                           const std::string &direction,
+                           const std::string &depth) {
+  GetIncludesReq req;
+  req.set_proj_name(proj_name);
+  req.set_path(path);
+  req.set_direction(direction == "includees" ? GetIncludesReq::INCLUDEES
+                                             : GetIncludesReq::INCLUDERS);
+  req.set_depth(std::strtoul(depth.c_str(), nullptr, 10));
+
+  GetIncludesRsp rsp;
+  send_and_recv(MessageID::GET_INCLUDES_REQ, req, rsp);
+}
+
+void Session::search_symbols(const std::string &proj_name,
+                             const std::string &query,
+                             const std::string &mode) {
+  SearchSymbolsReq req;
+  req.set_proj_name(proj_name);
+  req.set_query(query);
+  if (mode == "substring") {
+    req.set_mode(SearchSymbolsReq::SUBSTRING);
+  } else if (mode == "fuzzy") {
+    req.set_mode(SearchSymbolsReq::FUZZY);
+  } else {
+    req.set_mode(SearchSymbolsReq::PREFIX);
+  }
+
+  SearchSymbolsRsp rsp;
+  send_and_recv(MessageID::SEARCH_SYMBOLS_REQ, req, rsp);
+}
+
+void Session::text_search(const std::string &proj_name,
+                          const std::string &text,
+                          const std::string &ignore_case) {
+  TextSearchReq req;
+  req.set_proj_name(proj_name);
+  req.set_text(text);
+  req.set_ignore_case(ignore_case == "icase");
+
+  TextSearchRsp rsp;
+  send_and_recv(MessageID::TEXT_SEARCH_REQ, req, rsp);
+}
+
 bool Session::send(int msg_id, const google::protobuf::Message &body) {
   MessageHead head;
   head.set_msg_id(msg_id);
@@ -28,22 +28,60 @@ public:
   void list_projects();
   void list_project_files(const std::string &proj_name);
 
+  // with_metadata is "meta" to get the kind, type, etc. of the symbol too.
   void get_symbol_definition(const std::string &proj_name,
                              const std::string &symbol,
-                             const std::string &hint_path);
+                             const std::string &hint_path,
+                             const std::string &with_metadata);
 
   void get_symbol_references(const std::string &proj_name,
                              const std::string &symbol,
                              const std::string &hint_path);
 
   void list_file_symbols(const std::string &proj_name,
-                         const std::string &path);
+                         const std::string &path,
+                         const std::string &with_metadata);
 
   void list_file_references(const std::string &proj_name,
                             const std::string &path);
 
   void rebuild_file(const std::string &proj_name, const std::string &path);
 
+  void get_symbol_at_position(const std::string &proj_name,
+                              const std::string &abs_path,
+                              const std::string &line,
+                              const std::string &column);
+
+  // depth defaults to 1, i.e. the direct ones only.
+  void get_callers(const std::string &proj_name, const std::string &symbol,
+                   const std::string &depth);
+  void get_callees(const std::string &proj_name, const std::string &symbol,
+                   const std::string &depth);
+
+  // direction is "derived" or "base", and defaults to derived. depth
+  // defaults to the whole hierarchy.
+  void get_type_hierarchy(const std::string &proj_name,
+                          const std::string &symbol,
+                          const std::string &direction,
+                          const std::string &depth);
+
+  // direction is "overriders" or "overridden", and defaults to overriders.
+  void get_overrides(const std::string &proj_name, const std::string &symbol,
+                     const std::string &direction, const std::string &depth);
+
+  // direction is "includers" or "includees", and defaults to includers.
+  // depth defaults to all of them.
+  void get_includes(const std::string &proj_name, const std::string &path,
+                    const std::string &direction, const std::string &depth);
+
+  // mode is "prefix", "substring" or "fuzzy", and defaults to prefix.
+  void search_symbols(const std::string &proj_name, const std::string &query,
+                      const std::string &mode);
+
+  // ignore_case is "icase" to ignore the case.
+  void text_search(const std::string &proj_name, const std::string &text,
+                   const std::string &ignore_case);
+
 private:
   bool send(int msg_id, const google::protobuf::Message &body);
 
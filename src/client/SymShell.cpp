@@ -146,20 +146,51 @@ void SymShell::Init(boost::asio::io_service &io_context,
       "project files <proj_name>", &Session::list_project_files});
 
   auto &sym_cmd = root_cmd_["symbol"];
-  sym_cmd["definition"].SetHandler(
-      CommandDelegator<2, 3>{"symbol definition <proj_name> <symbol> [path]",
-                             &Session::get_symbol_definition});
+  sym_cmd["definition"].SetHandler(CommandDelegator<2, 4>{
+      "symbol definition <proj_name> <symbol> [path] [meta]",
+      &Session::get_symbol_definition});
 
   sym_cmd["reference"].SetHandler(
       CommandDelegator<2, 3>{"symbol reference <proj_name> <symbol> [path]",
                              &Session::get_symbol_references});
 
-  root_cmd_["file"]["symbols"].SetHandler(CommandDelegator<2>{
-      "file symbols <proj_name> <path>", &Session::list_file_symbols});
+  sym_cmd["at"].SetHandler(CommandDelegator<4>{
+      "symbol at <proj_name> <abs_path> <line> <column>",
+      &Session::get_symbol_at_position});
+
+  sym_cmd["callers"].SetHandler(
+      CommandDelegator<2, 3>{"symbol callers <proj_name> <symbol> [depth]",
+                             &Session::get_callers});
+
+  sym_cmd["callees"].SetHandler(
+      CommandDelegator<2, 3>{"symbol callees <proj_name> <symbol> [depth]",
+                             &Session::get_callees});
+
+  sym_cmd["hierarchy"].SetHandler(CommandDelegator<2, 4>{
+      "symbol hierarchy <proj_name> <symbol> [derived|base] [depth]",
+      &Session::get_type_hierarchy});
+
+  sym_cmd["overrides"].SetHandler(CommandDelegator<2, 4>{
+      "symbol overrides <proj_name> <symbol> [overriders|overridden] [depth]",
+      &Session::get_overrides});
+
+  sym_cmd["search"].SetHandler(CommandDelegator<2, 3>{
+      "symbol search <proj_name> <query> [prefix|substring|fuzzy]",
+      &Session::search_symbols});
+
+  root_cmd_["text"]["search"].SetHandler(CommandDelegator<2, 3>{
+      "text search <proj_name> <text> [icase]", &Session::text_search});
+
+  root_cmd_["file"]["symbols"].SetHandler(CommandDelegator<2, 3>{
+      "file symbols <proj_name> <path> [meta]", &Session::list_file_symbols});
 
   root_cmd_["file"]["refer"].SetHandler(CommandDelegator<2>{
       "file refer <proj_name> <path>", &Session::list_file_references});
 
+  root_cmd_["file"]["includes"].SetHandler(CommandDelegator<2, 4>{
+      "file includes <proj_name> <path> [includers|includees] [depth]",
+      &Session::get_includes});
+
   root_cmd_["file"]["rebuild"].SetHandler(CommandDelegator<2>{
       "file rebuild <proj_name> <path>", &Session::rebuild_file});
 
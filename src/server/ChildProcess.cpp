@@ -0,0 +1,91 @@
+#include "ChildProcess.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <cstring>
+#include "util/Exceptions.h"
+#include "util/Logger.h"
+
+extern char **environ;
+
+namespace symdb {
+
+ChildProcess::~ChildProcess() {
+  if (IsRunning()) {
+    LOG_WARN << "kill the child, pid=" << pid_;
+    ::kill(pid_, SIGTERM);
+    ::waitpid(pid_, nullptr, 0);
+  }
+}
+
+void ChildProcess::Start(const StringVec &argv, const fspath &output_path,
+                         ExitHandler on_exit) {
+  if (IsRunning()) {
+    THROW_AT_FILE_LINE("child pid<%d> is running", pid_);
+  }
+  if (argv.empty()) {
+    THROW_AT_FILE_LINE("empty command");
+  }
+
+  std::vector<char *> c_argv;
+  c_argv.reserve(argv.size() + 1);
+  for (const auto &arg : argv) {
+    c_argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  c_argv.push_back(nullptr);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO,
+                                   output_path.c_str(),
+                                   O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+
+  pid_t pid = -1;
+  int ret = posix_spawnp(&pid, c_argv[0], &actions, nullptr, c_argv.data(),
+                         environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (ret != 0) {
+    THROW_AT_FILE_LINE("spawn<%s> error: %s", c_argv[0], strerror(ret));
+  }
+
+  LOG_INFO << "spawned, command=" << argv[0] << " pid=" << pid;
+
+  pid_ = pid;
+  on_exit_ = std::move(on_exit);
+  WaitExit();
+}
+
+void ChildProcess::WaitExit() {
+  signals_.async_wait([this](const boost::system::error_code &ec, int) {
+    if (ec) {
+      return;
+    }
+
+    int status = 0;
+    pid_t ret = ::waitpid(pid_, &status, WNOHANG);
+    if (ret == 0) {
+      // Another child exits.
+      WaitExit();
+      return;
+    }
+
+    int exit_code = -1;
+    if (ret < 0) {
+      LOG_ERROR << "waitpid error: " << strerror(errno) << ", pid=" << pid_;
+    } else if (WIFEXITED(status)) {
+      exit_code = WEXITSTATUS(status);
+    }
+
+    LOG_INFO << "exited, pid=" << pid_ << " exit_code=" << exit_code;
+
+    pid_ = -1;
+    // The handler may start another one.
+    ExitHandler on_exit;
+    on_exit.swap(on_exit_);
+    on_exit(exit_code);
+  });
+}
+
+}  // namespace symdb
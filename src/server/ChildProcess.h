@@ -0,0 +1,43 @@
+#pragma once
+
+#include <sys/types.h>
+#include <functional>
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+// A command run in a child process. Its exit is waited by the io_service
+// instead of blocking the thread, which is the only one to use it.
+class ChildProcess {
+public:
+  // exit_code is -1 if the child is killed by a signal.
+  using ExitHandler = std::function<void(int exit_code)>;
+
+  explicit ChildProcess(boost::asio::io_service &io_service)
+      : signals_{io_service, SIGCHLD} {}
+
+  // Kill the child if it's running, without calling the handler.
+  ~ChildProcess();
+
+  ChildProcess(const ChildProcess &) = delete;
+  ChildProcess &operator=(const ChildProcess &) = delete;
+
+  // argv[0] is searched in PATH, and both the stdout and stderr of the child
+  // go to output_path. Throw if the child can't be started or it's running.
+  void Start(const StringVec &argv, const fspath &output_path,
+             ExitHandler on_exit);
+
+  bool IsRunning() const { return pid_ > 0; }
+
+private:
+  void WaitExit();
+
+private:
+  // SIGCHLD is delivered to all the signal sets, so a signal may be of
+  // another child.
+  boost::asio::signal_set signals_;
+  pid_t pid_ = -1;
+  ExitHandler on_exit_;
+};
+
+}  // namespace symdb
@@ -70,6 +70,25 @@ inline std::string GetCursorNamespace(CXCursor cursor) {
   return ns;
 }
 
+// e.g. "symdb::Project::Build"
+inline std::string GetCursorQualifiedName(CXCursor cursor) {
+  std::string name;
+  while (!clang_Cursor_isNull(cursor)) {
+    CXCursorKind kind = clang_getCursorKind(cursor);
+    if (kind == CXCursor_TranslationUnit || clang_isInvalid(kind)) {
+      break;
+    }
+
+    auto spelling = CXStringToString(clang_getCursorSpelling(cursor));
+    if (spelling.empty()) {
+      spelling = "(anonymous)";
+    }
+    name = name.empty() ? spelling : spelling + "::" + name;
+    cursor = clang_getCursorSemanticParent(cursor);
+  }
+  return name;
+}
+
 }  // namespace symdb
 
 #endif /* end of include guard: CLANGUTILS_H_9MVHQLJS */
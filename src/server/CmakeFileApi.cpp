@@ -0,0 +1,446 @@
+#include "CmakeFileApi.h"
+#include <fstream>
+#include <iterator>
+#include "CompileCommands.h"
+#include "JsonReader.h"
+#include "util/Exceptions.h"
+#include "util/Logger.h"
+
+namespace symdb {
+
+namespace {
+
+const char kClientName[] = "client-symdb";
+const char kCodemodelKind[] = "codemodel-v2";
+const char kCmakeFilesKind[] = "cmakeFiles-v1";
+const char kToolchainsKind[] = "toolchains-v1";
+
+fspath GetApiPath(const fspath &build_path) {
+  return build_path / ".cmake" / "api" / "v1";
+}
+
+template <typename Fn>
+void ReadJsonFile(const fspath &path, Fn &&fn) {
+  std::ifstream ifs{path, std::ios::binary};
+  if (!ifs) {
+    THROW_AT_FILE_LINE("failed to read %s", path.c_str());
+  }
+  std::string content{std::istreambuf_iterator<char>{ifs},
+                      std::istreambuf_iterator<char>{}};
+
+  JsonReader reader{content.data(), content.data() + content.size()};
+  fn(reader);
+}
+
+// Return the path of the reply of kind, or empty if there's none.
+fspath FindReplyFile(const fspath &build_path, const std::string &kind) {
+  fspath reply_dir = GetApiPath(build_path) / "reply";
+
+  // The latest index is the last one in the name order.
+  fspath index_path;
+  try {
+    if (!filesystem::is_directory(reply_dir)) {
+      return fspath{};
+    }
+    for (const auto &entry : filesystem::directory_iterator{reply_dir}) {
+      const auto &path = entry.path();
+      auto name = path.filename().string();
+      if (name.compare(0, 6, "index-") == 0 && path.extension() == ".json" &&
+          (index_path.empty() || index_path.filename().string() < name)) {
+        index_path = path;
+      }
+    }
+  } catch (const std::exception &e) {
+    LOG_ERROR << "exception=" << e.what() << ", dir=" << reply_dir;
+    return fspath{};
+  }
+
+  if (index_path.empty()) {
+    return fspath{};
+  }
+
+  // {"reply": {"client-symdb": {"codemodel-v2": {"jsonFile": "..."}}}}
+  std::string json_file;
+  ReadJsonFile(index_path, [&](JsonReader &reader) {
+    reader.ReadObject([&](const std::string &key) {
+      if (key != "reply") {
+        reader.SkipValue();
+        return;
+      }
+      reader.ReadObject([&](const std::string &client) {
+        if (client != kClientName) {
+          reader.SkipValue();
+          return;
+        }
+        reader.ReadObject([&](const std::string &reply_kind) {
+          if (reply_kind != kind) {
+            reader.SkipValue();
+            return;
+          }
+          // Either jsonFile or error
+          reader.ReadObject([&](const std::string &field) {
+            if (field == "jsonFile") {
+              reader.ReadString(json_file);
+            } else {
+              reader.SkipValue();
+            }
+          });
+        });
+      });
+    });
+  });
+
+  if (json_file.empty()) {
+    LOG_WARN << "no reply, kind=" << kind << " index=" << index_path;
+    return fspath{};
+  }
+  return reply_dir / json_file;
+}
+
+// Read {"path": ...} of the source and build paths.
+void ReadPaths(JsonReader &reader, fspath &source, fspath &build) {
+  std::string value;
+  reader.ReadObject([&](const std::string &key) {
+    if (key == "source") {
+      reader.ReadString(value);
+      source = value;
+    } else if (key == "build") {
+      reader.ReadString(value);
+      build = value;
+    } else {
+      reader.SkipValue();
+    }
+  });
+}
+
+// The flags of a compile group, in the order of a compile command.
+StringVecPtr ReadCompileGroup(JsonReader &reader, std::string &language) {
+  auto flags = std::make_shared<StringVec>();
+  StringVec defines;
+  StringVec includes;
+  std::string value;
+
+  reader.ReadObject([&](const std::string &key) {
+    if (key == "language") {
+      reader.ReadString(language);
+      if (language == "CXX") {
+        flags->insert(flags->begin(), {"-x", "c++"});
+      } else if (language == "C") {
+        flags->insert(flags->begin(), {"-x", "c"});
+      }
+    } else if (key == "compileCommandFragments") {
+      reader.ReadArray([&]() {
+        reader.ReadObject([&](const std::string &field) {
+          if (field == "fragment") {
+            reader.ReadString(value);
+            SplitCommandLine(value, *flags);
+          } else {
+            reader.SkipValue();
+          }
+        });
+      });
+    } else if (key == "defines") {
+      reader.ReadArray([&]() {
+        reader.ReadObject([&](const std::string &field) {
+          if (field == "define") {
+            reader.ReadString(value);
+            defines.push_back("-D" + value);
+          } else {
+            reader.SkipValue();
+          }
+        });
+      });
+    } else if (key == "includes") {
+      reader.ReadArray([&]() {
+        std::string path;
+        bool is_system = false;
+        reader.ReadObject([&](const std::string &field) {
+          if (field == "path") {
+            reader.ReadString(path);
+          } else if (field == "isSystem") {
+            is_system = reader.Peek() == 't';
+            reader.SkipValue();
+          } else {
+            reader.SkipValue();
+          }
+        });
+        if (is_system) {
+          includes.push_back("-isystem");
+          includes.push_back(path);
+        } else {
+          includes.push_back("-I" + path);
+        }
+      });
+    } else if (key == "sysroot") {
+      reader.ReadObject([&](const std::string &field) {
+        if (field == "path") {
+          reader.ReadString(value);
+          defines.push_back("--sysroot=" + value);
+        } else {
+          reader.SkipValue();
+        }
+      });
+    } else {
+      reader.SkipValue();
+    }
+  });
+
+  flags->insert(flags->end(), defines.begin(), defines.end());
+  flags->insert(flags->end(), includes.begin(), includes.end());
+  return flags;
+}
+
+void ReadTarget(const fspath &target_path, const fspath &top_source_dir,
+                CmakeSourceVec &sources) {
+  fspath target_dir;
+  fspath unused_build_dir;
+  std::vector<StringVecPtr> groups;
+  std::vector<std::string> languages;
+  // (source path, compile group index)
+  std::vector<std::pair<fspath, int64_t>> target_sources;
+
+  ReadJsonFile(target_path, [&](JsonReader &reader) {
+    reader.ReadObject([&](const std::string &key) {
+      if (key == "paths") {
+        ReadPaths(reader, target_dir, unused_build_dir);
+      } else if (key == "compileGroups") {
+        reader.ReadArray([&]() {
+          languages.emplace_back();
+          groups.push_back(ReadCompileGroup(reader, languages.back()));
+        });
+      } else if (key == "sources") {
+        reader.ReadArray([&]() {
+          std::string path;
+          int64_t group = -1;
+          reader.ReadObject([&](const std::string &field) {
+            if (field == "path") {
+              reader.ReadString(path);
+            } else if (field == "compileGroupIndex") {
+              group = reader.ReadInt();
+            } else {
+              reader.SkipValue();
+            }
+          });
+          // The headers and the others aren't compiled.
+          if (group >= 0) {
+            target_sources.emplace_back(path, group);
+          }
+        });
+      } else {
+        reader.SkipValue();
+      }
+    });
+  });
+
+  // The relative paths are of the top-level source directory.
+  target_dir = (top_source_dir / target_dir).lexically_normal();
+  if (!target_dir.empty() && target_dir.filename().empty()) {
+    target_dir = target_dir.parent_path();
+  }
+
+  for (auto &source : target_sources) {
+    if (source.second >= static_cast<int64_t>(groups.size())) {
+      THROW_AT_FILE_LINE("bad compileGroupIndex in %s", target_path.c_str());
+    }
+    fspath abs_path = source.first.is_absolute()
+                          ? source.first
+                          : (top_source_dir / source.first).lexically_normal();
+    sources.push_back(CmakeSource{std::move(abs_path), target_dir,
+                                  languages[source.second],
+                                  groups[source.second]});
+  }
+}
+
+}  // namespace
+
+void WriteCmakeFileApiQuery(const fspath &build_path) {
+  fspath query_dir = GetApiPath(build_path) / "query" / kClientName;
+  filesystem::create_directories(query_dir);
+  for (const char *kind : {kCodemodelKind, kCmakeFilesKind, kToolchainsKind}) {
+    std::ofstream ofs{query_dir / kind};
+    if (!ofs) {
+      THROW_AT_FILE_LINE("failed to write the query %s in %s", kind,
+                         query_dir.c_str());
+    }
+  }
+}
+
+bool HasCmakeFileApiQuery(const fspath &build_path) {
+  try {
+    return filesystem::exists(GetApiPath(build_path) / "query" / kClientName /
+                              kCodemodelKind);
+  } catch (const std::exception &e) {
+    return false;
+  }
+}
+
+bool ReadCmakeCodemodel(const fspath &build_path, CmakeSourceVec &sources) {
+  fspath codemodel_path = FindReplyFile(build_path, kCodemodelKind);
+  if (codemodel_path.empty()) {
+    return false;
+  }
+
+  fspath source_dir;
+  fspath unused_build_dir;
+  std::vector<std::string> target_files;
+  bool is_first_config = true;
+  ReadJsonFile(codemodel_path, [&](JsonReader &reader) {
+    reader.ReadObject([&](const std::string &key) {
+      if (key == "paths") {
+        ReadPaths(reader, source_dir, unused_build_dir);
+      } else if (key == "configurations") {
+        reader.ReadArray([&]() {
+          // The multi-config generators have one per build type, which
+          // have the same sources.
+          if (!is_first_config) {
+            reader.SkipValue();
+            return;
+          }
+          is_first_config = false;
+          reader.ReadObject([&](const std::string &field) {
+            if (field != "targets") {
+              reader.SkipValue();
+              return;
+            }
+            reader.ReadArray([&]() {
+              reader.ReadObject([&](const std::string &target_field) {
+                if (target_field == "jsonFile") {
+                  target_files.emplace_back();
+                  reader.ReadString(target_files.back());
+                } else {
+                  reader.SkipValue();
+                }
+              });
+            });
+          });
+        });
+      } else {
+        reader.SkipValue();
+      }
+    });
+  });
+
+  if (source_dir.empty()) {
+    THROW_AT_FILE_LINE("no source path in %s", codemodel_path.c_str());
+  }
+
+  fspath reply_dir = codemodel_path.parent_path();
+  for (const auto &target_file : target_files) {
+    ReadTarget(reply_dir / target_file, source_dir, sources);
+  }
+
+  LOG_INFO << "codemodel=" << codemodel_path
+           << " targets=" << target_files.size()
+           << " sources=" << sources.size();
+  return true;
+}
+
+bool ReadCmakeToolchains(const fspath &build_path,
+                         std::vector<CmakeToolchain> &toolchains) {
+  fspath toolchains_path = FindReplyFile(build_path, kToolchainsKind);
+  if (toolchains_path.empty()) {
+    return false;
+  }
+
+  // {"toolchains": [{"language": "CXX", "compiler": {"path": "...",
+  //   "implicit": {"includeDirectories": [...]}}}]}
+  ReadJsonFile(toolchains_path, [&](JsonReader &reader) {
+    reader.ReadObject([&](const std::string &key) {
+      if (key != "toolchains") {
+        reader.SkipValue();
+        return;
+      }
+      reader.ReadArray([&]() {
+        CmakeToolchain toolchain;
+        std::string value;
+        reader.ReadObject([&](const std::string &field) {
+          if (field == "language") {
+            reader.ReadString(toolchain.language);
+          } else if (field == "compiler") {
+            reader.ReadObject([&](const std::string &compiler_field) {
+              if (compiler_field == "path") {
+                reader.ReadString(value);
+                toolchain.compiler = value;
+              } else if (compiler_field == "implicit") {
+                reader.ReadObject([&](const std::string &implicit_field) {
+                  if (implicit_field != "includeDirectories") {
+                    reader.SkipValue();
+                    return;
+                  }
+                  reader.ReadArray([&]() {
+                    toolchain.include_dirs.emplace_back();
+                    reader.ReadString(toolchain.include_dirs.back());
+                  });
+                });
+              } else {
+                reader.SkipValue();
+              }
+            });
+          } else {
+            reader.SkipValue();
+          }
+        });
+        if (!toolchain.compiler.empty()) {
+          toolchains.push_back(std::move(toolchain));
+        }
+      });
+    });
+  });
+  return true;
+}
+
+bool ReadCmakeInputs(const fspath &build_path, FsPathVec &inputs) {
+  fspath cmake_files_path;
+  try {
+    cmake_files_path = FindReplyFile(build_path, kCmakeFilesKind);
+  } catch (const std::exception &e) {
+    LOG_ERROR << "exception=" << e.what() << ", build_path=" << build_path;
+    return false;
+  }
+  if (cmake_files_path.empty()) {
+    return false;
+  }
+
+  fspath source_dir;
+  fspath unused_build_dir;
+  // (path, isCMake)
+  std::vector<std::pair<std::string, bool>> files;
+  try {
+    ReadJsonFile(cmake_files_path, [&](JsonReader &reader) {
+      reader.ReadObject([&](const std::string &key) {
+        if (key == "paths") {
+          ReadPaths(reader, source_dir, unused_build_dir);
+        } else if (key == "inputs") {
+          reader.ReadArray([&]() {
+            files.emplace_back();
+            reader.ReadObject([&](const std::string &field) {
+              if (field == "path") {
+                reader.ReadString(files.back().first);
+              } else if (field == "isCMake") {
+                files.back().second = reader.Peek() == 't';
+                reader.SkipValue();
+              } else {
+                reader.SkipValue();
+              }
+            });
+          });
+        } else {
+          reader.SkipValue();
+        }
+      });
+    });
+  } catch (const std::exception &e) {
+    LOG_ERROR << "exception=" << e.what() << ", path=" << cmake_files_path;
+    return false;
+  }
+
+  for (const auto &file : files) {
+    if (!file.second) {
+      fspath path{file.first};
+      inputs.push_back(path.is_absolute() ? path : source_dir / path);
+    }
+  }
+  return true;
+}
+
+}  // namespace symdb
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+// The CMake file API, see cmake-file-api(7). cmake writes the replies under
+// <build>/.cmake/api/v1/reply for the queries of the clients under
+// <build>/.cmake/api/v1/query, which tell the exact targets and their
+// inputs without walking the source tree.
+
+// A source compiled by a target
+struct CmakeSource {
+  fspath abs_path;
+  fspath target_dir;     // absolute, where the target is defined
+  std::string language;  // of the compile group, e.g. CXX
+  StringVecPtr flags;    // shared by the sources of a compile group
+};
+
+using CmakeSourceVec = std::vector<CmakeSource>;
+
+struct CmakeToolchain {
+  std::string language;
+  fspath compiler;
+  StringVec include_dirs;  // implicit, i.e. the system ones
+};
+
+// Ask for the codemodel-v2, cmakeFiles-v1 and toolchains-v1 replies of the
+// next cmake run. Throw on error.
+void WriteCmakeFileApiQuery(const fspath &build_path);
+
+// Return false if the query isn't written yet.
+bool HasCmakeFileApiQuery(const fspath &build_path);
+
+// Read the sources of all the targets of the codemodel-v2 reply, in the
+// order of the targets. Return false if there's no reply, e.g. cmake is
+// older than 3.14. Throw if it's malformed.
+bool ReadCmakeCodemodel(const fspath &build_path, CmakeSourceVec &sources);
+
+// Read the toolchains-v1 reply. Return false if there's none, e.g. cmake is
+// older than 3.20. Throw if it's malformed.
+bool ReadCmakeToolchains(const fspath &build_path,
+                         std::vector<CmakeToolchain> &toolchains);
+
+// Read the inputs of the cmakeFiles-v1 reply except the ones of cmake
+// itself. Return false if there's no reply.
+bool ReadCmakeInputs(const fspath &build_path, FsPathVec &inputs);
+
+}  // namespace symdb
@@ -0,0 +1,240 @@
+#include "CompileCommands.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include "JsonReader.h"
+#include "util/Exceptions.h"
+#include "util/Logger.h"
+
+namespace symdb {
+
+namespace {
+
+// The smaller files are parsed by the calling thread only.
+const size_t kMinChunkSize = 4 << 20;
+
+class MappedFile {
+public:
+  explicit MappedFile(const fspath &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      THROW_AT_FILE_LINE("open<%s> error: %s", path.c_str(), strerror(errno));
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+      int err = errno;
+      ::close(fd);
+      THROW_AT_FILE_LINE("fstat<%s> error: %s", path.c_str(), strerror(err));
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (data_ == MAP_FAILED) {
+      data_ = nullptr;
+      THROW_AT_FILE_LINE("mmap<%s> error: %s", path.c_str(), strerror(errno));
+    }
+    if (data_) {
+      (void)::madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+  }
+
+  ~MappedFile() {
+    if (data_) {
+      ::munmap(data_, size_);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *begin() const { return static_cast<const char *>(data_); }
+  const char *end() const { return begin() + size_; }
+
+private:
+  void *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+void ReadCompileCommand(JsonReader &reader, CompileCommand &command) {
+  std::string command_line;
+  bool has_arguments = false;
+
+  reader.ReadObject([&](const std::string &key) {
+    if (key == "directory") {
+      reader.ReadString(command.directory);
+    } else if (key == "file") {
+      std::string file;
+      reader.ReadString(file);
+      command.file = file;
+    } else if (key == "command") {
+      reader.ReadString(command_line);
+    } else if (key == "arguments") {
+      has_arguments = true;
+      reader.ReadArray([&]() {
+        command.arguments.emplace_back();
+        reader.ReadString(command.arguments.back());
+      });
+    } else {
+      reader.SkipValue();
+    }
+  });
+
+  if (command.file.empty()) {
+    reader.Fail("no file");
+  }
+  if (!has_arguments) {
+    SplitCommandLine(command_line, command.arguments);
+  }
+  if (command.file.is_relative()) {
+    command.file = fspath{command.directory} / command.file;
+  }
+}
+
+// Return the ranges of the entries, which are found by skipping them.
+std::vector<std::pair<const char *, const char *>> FindEntries(
+    JsonReader &reader) {
+  std::vector<std::pair<const char *, const char *>> entries;
+  reader.Expect('[');
+  if (reader.Consume(']')) {
+    return entries;
+  }
+
+  do {
+    if (reader.Peek() != '{') {
+      reader.Fail("expect an object");
+    }
+    const char *begin = reader.pos();
+    reader.SkipValue();
+    entries.emplace_back(begin, reader.pos());
+  } while (reader.Consume(','));
+  reader.Expect(']');
+
+  return entries;
+}
+
+}  // namespace
+
+void SplitCommandLine(const std::string &command, StringVec &args) {
+  std::string arg;
+  bool has_arg = false;  // "" is an empty argument
+  for (size_t i = 0; i < command.size(); ++i) {
+    char c = command[i];
+    switch (c) {
+      case ' ':
+      case '\t':
+      case '\n':
+      case '\r':
+        if (has_arg) {
+          args.push_back(std::move(arg));
+          arg.clear();
+          has_arg = false;
+        }
+        break;
+
+      case '\\':
+        has_arg = true;
+        if (i + 1 < command.size()) {
+          arg.push_back(command[++i]);
+        }
+        break;
+
+      case '\'': {
+        has_arg = true;
+        size_t end = command.find('\'', i + 1);
+        if (end == std::string::npos) {
+          end = command.size();
+        }
+        arg.append(command, i + 1, end - i - 1);
+        i = end;
+        break;
+      }
+
+      case '"':
+        has_arg = true;
+        for (++i; i < command.size() && command[i] != '"'; ++i) {
+          // Only these are escaped in the double quotes.
+          if (command[i] == '\\' && i + 1 < command.size() &&
+              strchr("\"\\$`\n", command[i + 1])) {
+            ++i;
+          }
+          arg.push_back(command[i]);
+        }
+        break;
+
+      default:
+        has_arg = true;
+        arg.push_back(c);
+        break;
+    }
+  }
+
+  if (has_arg) {
+    args.push_back(std::move(arg));
+  }
+}
+
+CompileCommandVec LoadCompileCommands(const fspath &path, size_t max_threads) {
+  MappedFile file{path};
+  JsonReader reader{file.begin(), file.end()};
+  auto entries = FindEntries(reader);
+
+  size_t size = file.end() - file.begin();
+  size_t nr_chunks = std::max<size_t>(
+      1, std::min({max_threads, size / kMinChunkSize, entries.size()}));
+
+  std::vector<CompileCommandVec> chunks(nr_chunks);
+  std::vector<std::exception_ptr> errors(nr_chunks);
+  auto parse_chunk = [&](size_t chunk) {
+    size_t first = entries.size() * chunk / nr_chunks;
+    size_t last = entries.size() * (chunk + 1) / nr_chunks;
+    try {
+      auto &commands = chunks[chunk];
+      commands.resize(last - first);
+      for (size_t i = first; i < last; ++i) {
+        JsonReader entry_reader{file.begin(), entries[i].first,
+                                entries[i].second};
+        ReadCompileCommand(entry_reader, commands[i - first]);
+      }
+    } catch (...) {
+      errors[chunk] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(nr_chunks - 1);
+  for (size_t chunk = 1; chunk < nr_chunks; ++chunk) {
+    threads.emplace_back(parse_chunk, chunk);
+  }
+  parse_chunk(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  CompileCommandVec commands = std::move(chunks.front());
+  commands.reserve(entries.size());
+  for (size_t chunk = 1; chunk < nr_chunks; ++chunk) {
+    std::move(chunks[chunk].begin(), chunks[chunk].end(),
+              std::back_inserter(commands));
+  }
+
+  LOG_INFO << "path=" << path << " size=" << size
+           << " commands=" << commands.size() << " chunks=" << nr_chunks;
+  return commands;
+}
+
+}  // namespace symdb
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+// An entry of compile_commands.json
+struct CompileCommand {
+  std::string directory;
+  fspath file;          // absolute, i.e. joined with directory if relative
+  StringVec arguments;  // of either "arguments" or the split "command"
+};
+
+using CompileCommandVec = std::vector<CompileCommand>;
+
+// Split command into the arguments the way a POSIX shell does for the
+// quotes and the backslashes, without any expansion.
+void SplitCommandLine(const std::string &command, StringVec &args);
+
+// Load the entries of a compile_commands.json in order. The file is mapped
+// rather than read, and a large one is parsed in chunks by at most
+// max_threads threads. Only the keys needed are decoded, the others are
+// skipped without allocation. Throw if it can't be read or it's malformed.
+CompileCommandVec LoadCompileCommands(const fspath &path, size_t max_threads);
+
+}  // namespace symdb
@@ -1,15 +1,20 @@
 #include "CompilerFlagCache.h"
 #include <clang-c/CXCompilationDatabase.h>
 #include <algorithm>
-#include <boost/foreach.hpp>
-#include <boost/property_tree/json_parser.hpp>
 #include <cstdlib>
+#include <fstream>
 #include <list>
+#include <optional>
+#include "CmakeFileApi.h"
+#include "CompileCommands.h"
 #include "Config.h"
 #include "Project.h"
+#include "Server.h"
+#include "SystemIncludes.h"
 #include "util/Exceptions.h"
 #include "util/Functions.h"
 #include "util/Logger.h"
+#include "util/MD5.h"
 
 namespace symdb {
 
@@ -39,9 +44,43 @@ std::initializer_list<CompilerFlagArgPair> kCompilerFlagsToSkip = {
 };
 // clang-format on
 
+// The launchers run the compiler which follows them.
+bool IsCompilerLauncher(const std::string &arg) {
+  auto name = fspath{arg}.filename().string();
+  return name == "ccache" || name == "sccache" || name == "distcc" ||
+         name == "icecc";
+}
+
+// Return the compiler of the command line args.
+template <class StringContainer>
+std::string FindCompiler(const StringContainer &args) {
+  for (const auto &arg : args) {
+    if (!arg.empty() && arg.front() != '-' && !IsCompilerLauncher(arg)) {
+      return arg;
+    }
+  }
+  return std::string{};
+}
+
+bool IsCppFile(const fspath &path) { return path.extension() != ".c"; }
+
+// A relative compiler is of the directory of the command.
+std::string MakeCompilerKey(const std::string &compiler,
+                            const std::string &directory, bool is_cpp) {
+  std::string key = is_cpp ? "c++\n" : "c\n";
+  key += compiler;
+  if (compiler.find('/') != std::string::npos && compiler.front() != '/') {
+    key += '\n';
+    key += directory;
+  }
+  return key;
+}
+
 void PruneCompilerFlags(std::list<std::string> &flags,
                         const std::string &filename) {
-  for (auto it = flags.begin(); it != flags.end() && it->front() == '-';) {
+  for (auto it = flags.begin();
+       it != flags.end() &&
+       (it->empty() || it->front() == '-' || IsCompilerLauncher(*it));) {
     it = flags.erase(it);
   }
 
@@ -78,7 +117,7 @@ void PruneCompilerFlags(std::list<std::string> &flags,
       continue;
     }
 
-    if (flag.front() == '/' && flag == filename) {
+    if (!flag.empty() && flag.front() == '/' && flag == filename) {
       it = flags.erase(it);
     } else {
       ++it;
@@ -86,32 +125,35 @@ void PruneCompilerFlags(std::list<std::string> &flags,
   }
 }
 
-class JsonCommandParser {
-  using JsonNodeType = boost::property_tree::ptree;
+// The command parsers tell the module dir of a file, and its flags without
+// the compiler and the file.
 
+class JsonCommandParser {
 public:
-  explicit JsonCommandParser(JsonNodeType &node)
-      : node_{node}, filepath_{node.get<std::string>("file")} {}
+  explicit JsonCommandParser(CompileCommand &command) : command_{command} {}
 
-  const fspath &GetFileAbsPath() const { return filepath_; }
+  const fspath &GetFileAbsPath() const { return command_.file; }
 
-  std::string GetWorkDirectory() const {
-    return node_.get<std::string>("directory");
+  const std::string &GetWorkDirectory() const { return command_.directory; }
+
+  std::optional<fspath> GetModuleDir() const {
+    return symutil::get_project_dir(command_.file);
   }
 
-  std::list<std::string> GetFlags() const {
-    std::string command = node_.get<std::string>("command");
-    std::istringstream buffer(command);
-    std::list<std::string> flags;
-    std::copy(std::istream_iterator<std::string>(buffer),
-              std::istream_iterator<std::string>(), std::back_inserter(flags));
+  // Call it before GetFlags().
+  std::string GetCompiler() const { return FindCompiler(command_.arguments); }
 
+  // The arguments are moved out, so it's called once at most.
+  std::list<std::string> GetFlags() const {
+    std::list<std::string> flags{
+        std::make_move_iterator(command_.arguments.begin()),
+        std::make_move_iterator(command_.arguments.end())};
+    PruneCompilerFlags(flags, command_.file.string());
     return flags;
   }
 
 private:
-  const JsonNodeType &node_;
-  fspath filepath_;
+  CompileCommand &command_;
 };
 
 class ClangCommandParser {
@@ -127,6 +169,22 @@ public:
     return CXStringToString(clang_CompileCommand_getDirectory(command_));
   }
 
+  std::optional<fspath> GetModuleDir() const {
+    return symutil::get_project_dir(filepath_);
+  }
+
+  std::string GetCompiler() const {
+    size_t num_flags = clang_CompileCommand_getNumArgs(command_);
+    for (size_t j = 0; j < num_flags; ++j) {
+      std::string flag =
+          CXStringToString(clang_CompileCommand_getArg(command_, j));
+      if (!flag.empty() && flag.front() != '-' && !IsCompilerLauncher(flag)) {
+        return flag;
+      }
+    }
+    return std::string{};
+  }
+
   std::list<std::string> GetFlags() const {
     std::list<std::string> flags;
 
@@ -136,6 +194,7 @@ public:
           CXStringToString(clang_CompileCommand_getArg(command_, j));
       flags.push_back(flag);
     }
+    PruneCompilerFlags(flags, filepath_.string());
     return flags;
   }
 
@@ -144,74 +203,447 @@ private:
   fspath filepath_;
 };
 
-void CompilerFlagCache::Rebuild(const fspath &cmake_file_path,
-                                const fspath &build_path,
-                                FsPathSet &abs_src_paths) {
+// The module of a source is the target's directory, which cmake tells
+// exactly, so the directories aren't walked for the CMakeLists.txt.
+class CodemodelCommandParser {
+public:
+  CodemodelCommandParser(const CmakeSource &source,
+                         const std::string &compiler)
+      : source_{source}, compiler_{compiler} {}
+
+  const fspath &GetFileAbsPath() const { return source_.abs_path; }
+
+  // The compiler is absolute.
+  std::string GetWorkDirectory() const { return std::string{}; }
+
+  std::optional<fspath> GetModuleDir() const { return source_.target_dir; }
+
+  const std::string &GetCompiler() const { return compiler_; }
+
+  // The compile group has neither the compiler nor the file.
+  std::list<std::string> GetFlags() const {
+    return std::list<std::string>{source_.flags->begin(),
+                                  source_.flags->end()};
+  }
+
+private:
+  const CmakeSource &source_;
+  const std::string &compiler_;
+};
+
+using PendingCompilerVec =
+    std::vector<std::pair<std::string, SystemIncludes::Compiler>>;
+
+// Unless they're configured, the system include directories are of the
+// compilers of the commands, which are probed at once before the commands
+// are parsed.
+template <class CommandParserType>
+void AddCompiler(const CommandParserType &parser,
+                 CompilerFlagCache::FlagState &state,
+                 PendingCompilerVec &compilers) {
+  if (!ConfigInst.default_inc_dirs().empty()) {
+    return;
+  }
+
+  bool is_cpp = IsCppFile(parser.GetFileAbsPath());
+  std::string compiler = parser.GetCompiler();
+  std::string directory = parser.GetWorkDirectory();
+  auto key = MakeCompilerKey(compiler, directory, is_cpp);
+  if (!state.system_dirs.emplace(key, nullptr).second) {
+    return;
+  }
+  compilers.emplace_back(
+      std::move(key),
+      SystemIncludes::Compiler{
+          SystemIncludes::ResolveCompiler(compiler, directory), is_cpp});
+}
+
+void ProbeCompilers(PendingCompilerVec &compilers,
+                    CompilerFlagCache::FlagState &state) {
+  if (compilers.empty()) {
+    return;
+  }
+
+  // The unknown ones, e.g. of another machine, and those failed to probe
+  // fall back to the g++ here.
+  fspath default_compiler = SystemIncludes::ResolveCompiler("g++", "");
+  std::vector<SystemIncludes::Compiler> probes;
+  probes.reserve(compilers.size() + 2);
+  if (!default_compiler.empty()) {
+    probes.push_back(SystemIncludes::Compiler{default_compiler, true});
+    probes.push_back(SystemIncludes::Compiler{default_compiler, false});
+  }
+  for (auto &compiler : compilers) {
+    if (compiler.second.path.empty()) {
+      compiler.second.path = default_compiler;
+    }
+    if (!compiler.second.path.empty()) {
+      probes.push_back(compiler.second);
+    }
+  }
+
+  SystemIncludesInst.Probe(probes, ConfigInst.max_workers());
+
+  for (const auto &compiler : compilers) {
+    if (compiler.second.path.empty()) {
+      continue;
+    }
+    auto dirs = SystemIncludesInst.Get(compiler.second.path,
+                                       compiler.second.is_cpp);
+    if (!dirs && compiler.second.path != default_compiler) {
+      LOG_WARN << "use the dirs of " << default_compiler
+               << ", compiler=" << compiler.second.path;
+      dirs = SystemIncludesInst.Get(default_compiler, compiler.second.is_cpp);
+    }
+    state.system_dirs[compiler.first] = dirs;
+  }
+}
+
+StringVecPtr CompilerFlagCache::FlagsPool::Intern(StringVec &&flags) {
+  return *flags_.insert(std::make_shared<StringVec>(std::move(flags))).first;
+}
+
+size_t CompilerFlagCache::FlagsPool::Hash::operator()(
+    const StringVecPtr &flags) const {
+  size_t seed = flags->size();
+  std::hash<std::string> hasher;
+  for (const auto &flag : *flags) {
+    seed ^= hasher(flag) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  }
+  return seed;
+}
+
+CompilerFlagCache::CompilerFlagCache(Project *project)
+    : project_{project}, cmake_process_{ServerInst.main_io_service()} {}
+
+void CompilerFlagCache::RunCmake(const fspath &cmake_file_path,
+                                 const fspath &build_path,
+                                 std::function<void(bool)> on_done) {
   if (!filesystem::exists(cmake_file_path)) {
     THROW_AT_FILE_LINE("project<%s> cmake_file_path<%s> not exists",
                        project_->name().c_str(), cmake_file_path.c_str());
   }
 
-  const char *build_dir = build_path.c_str();
+  StringVec argv{"cmake", "-DCMAKE_EXPORT_COMPILE_COMMANDS=1",
+                 "-S",    cmake_file_path.parent_path().string(),
+                 "-B",    build_path.string()};
 
-  const char *cmake_default_cmd = "cmake -DCMAKE_EXPORT_COMPILE_COMMANDS=1";
+  LOG_INFO << "project=" << project_->name() << " run cmake, build_dir="
+           << build_path;
 
-  fspath cmake_file_dir = cmake_file_path.parent_path();
+  // compile_commands.json still works without the replies.
+  try {
+    WriteCmakeFileApiQuery(build_path);
+  } catch (const std::exception &e) {
+    LOG_WARN << "project=" << project_->name()
+             << " failed to query the cmake file api: " << e.what();
+  }
 
-  char command[BUFSIZ];
-  snprintf(command, sizeof(command), "%s -S %s -B %s &> /%s/error.txt",
-           cmake_default_cmd, cmake_file_dir.c_str(), build_dir, build_dir);
+  std::string project_name = project_->name();
+  cmake_process_.Start(
+      argv, build_path / "error.txt",
+      [project_name, build_path, on_done](int exit_code) {
+        if (exit_code != 0) {
+          LOG_ERROR << "cmake failed, project=" << project_name
+                    << " exit_code=" << exit_code
+                    << " output=" << build_path / "error.txt";
+        }
+        on_done(exit_code == 0);
+      });
+}
+
+namespace {
 
-  int ret = system(command);
-  if (ret != 0) {
-    THROW_AT_FILE_LINE("command<%s> build_dir<%s> system ret<%d>: %s", command,
-                       build_dir, ret, strerror(errno));
+// The quoted strings in the set(CMAKE_MAKEFILE_DEPENDS ...) of the Makefile
+// generator.
+bool ReadMakefileDepends(const fspath &build_path, FsPathVec &inputs) {
+  std::ifstream ifs{build_path / "CMakeFiles" / "Makefile.cmake"};
+  if (!ifs) {
+    return false;
   }
 
-  module_flags_.clear();
-  rel_dir_module_map_.clear();
+  std::string line;
+  bool is_in_depends = false;
+  while (std::getline(ifs, line)) {
+    if (!is_in_depends) {
+      is_in_depends = line.find("set(CMAKE_MAKEFILE_DEPENDS") == 0;
+      continue;
+    }
+    if (line.find(')') == 0) {
+      return true;
+    }
+
+    auto begin = line.find('"');
+    auto end = line.rfind('"');
+    if (begin != std::string::npos && end > begin) {
+      inputs.push_back(
+          symutil::absolute_path(line.substr(begin + 1, end - begin - 1),
+                                 build_path));
+    }
+  }
 
-  LoadClangCompilationDatabase(build_path, abs_src_paths);
+  return false;
 }
 
-void CompilerFlagCache::LoadCompileCommandsJsonFile(const fspath &build_path,
-                                                    FsPathSet &abs_src_paths) {
-  fspath cmake_json_path = build_path / "compile_commands.json";
-  if (!filesystem::exists(cmake_json_path)) {
-    THROW_AT_FILE_LINE("compile_commands.json not exist");
+// The implicit inputs of "build build.ninja ...: RERUN_CMAKE | <inputs>" of
+// the Ninja generator.
+bool ReadNinjaDepends(const fspath &build_path, FsPathVec &inputs) {
+  std::ifstream ifs{build_path / "build.ninja"};
+  if (!ifs) {
+    return false;
   }
 
-  try {
-    std::ifstream ifs(cmake_json_path.c_str());
-    boost::property_tree::ptree pt;
-    read_json(ifs, pt);
-    BOOST_FOREACH (boost::property_tree::ptree::value_type &v, pt) {
-      JsonCommandParser parser{v.second};
-      const auto &abs_file_path = parser.GetFileAbsPath();
-      if (project_->IsFileExcluded(abs_file_path)) {
-        LOG_INFO << abs_file_path << " is excluded";
-        continue;
+  std::string line;
+  std::string statement;
+  while (std::getline(ifs, line)) {
+    if (statement.empty() && line.find("build build.ninja") != 0) {
+      continue;
+    }
+
+    // A "$" at the end continues the line.
+    if (!line.empty() && line.back() == '$') {
+      line.pop_back();
+      statement += line;
+      continue;
+    }
+    statement += line;
+    break;
+  }
+
+  auto pos = statement.find("RERUN_CMAKE");
+  if (pos == std::string::npos) {
+    return false;
+  }
+  pos = statement.find(" | ", pos);
+  if (pos == std::string::npos) {
+    return false;
+  }
+
+  std::string input;
+  for (pos += 3; pos < statement.size(); ++pos) {
+    char c = statement[pos];
+    if (c == '$' && pos + 1 < statement.size()) {
+      input.push_back(statement[++pos]);
+    } else if (c != ' ') {
+      input.push_back(c);
+    } else if (input == "||") {
+      break;
+    } else if (!input.empty()) {
+      inputs.push_back(symutil::absolute_path(input, build_path));
+      input.clear();
+    }
+  }
+  if (!input.empty() && input != "||") {
+    inputs.push_back(symutil::absolute_path(input, build_path));
+  }
+
+  return true;
+}
+
+// The md5 of the paths and the contents of inputs, or empty if any of them
+// doesn't exist.
+std::string HashFiles(FsPathVec &inputs) {
+  std::sort(inputs.begin(), inputs.end());
+  inputs.erase(std::unique(inputs.begin(), inputs.end()), inputs.end());
+
+  std::string digests;
+  for (const auto &input : inputs) {
+    try {
+      if (!filesystem::is_regular_file(input)) {
+        LOG_DEBUG << "input not exists, path=" << input;
+        return std::string{};
       }
-      abs_src_paths.insert(abs_file_path);
-      ParseFileCommand(parser, build_path);
+    } catch (const std::exception &e) {
+      LOG_ERROR << "exception=" << e.what() << ", path=" << input;
+      return std::string{};
+    }
+
+    digests += input.string();
+    digests += symutil::md5_file_str(input.c_str());
+  }
+
+  unsigned char md5[symutil::kMd5Length];
+  symutil::md5_signature(
+      reinterpret_cast<unsigned char *>(&digests[0]), digests.size(), md5);
+
+  char md5_str[symutil::kMd5StrLength];
+  for (int i = 0; i < symutil::kMd5Length; i++) {
+    snprintf(md5_str + i * 2, 3, "%02x", md5[i]);
+  }
+  return std::string{md5_str};
+}
+
+}  // namespace
+
+std::string CompilerFlagCache::HashInputs(const ProjectConfig &config) {
+  if (config.compile_db_provider() == CompileDbProvider::kCmake) {
+    return HashCmakeInputs(config.cmake_file(), config.build_path());
+  }
+
+  FsPathVec inputs = config.compile_db_files();
+  return HashFiles(inputs);
+}
+
+std::string CompilerFlagCache::HashCmakeInputs(const fspath &cmake_file_path,
+                                               const fspath &build_path) {
+  FsPathVec inputs{cmake_file_path, build_path / "CMakeCache.txt",
+                   build_path / "compile_commands.json"};
+  if (!ReadCmakeInputs(build_path, inputs)) {
+    // Run cmake once to have the replies of the query. They're never there
+    // if cmake is too old for the file api.
+    if (!HasCmakeFileApiQuery(build_path)) {
+      return std::string{};
+    }
+    if (!ReadMakefileDepends(build_path, inputs) &&
+        !ReadNinjaDepends(build_path, inputs)) {
+      return std::string{};
+    }
+  }
+
+  return HashFiles(inputs);
+}
+
+CompilerFlagCache::FlagStatePtr CompilerFlagCache::Load(
+    const fspath &home_path, const ProjectConfig &config) const {
+  auto state = std::make_shared<FlagState>();
+  if (config.compile_db_provider() == CompileDbProvider::kCmake) {
+    LoadCmakeDatabase(home_path, config.build_path(), *state);
+  } else {
+    // Any failure keeps the old flags, otherwise the sources of the failed
+    // database would be deleted.
+    for (const auto &path : config.compile_db_files()) {
+      LoadCompileCommandsJsonFile(home_path, config.build_path(), path,
+                                  *state);
+    }
+  }
+
+  LOG_INFO << "project=" << project_->name()
+           << " files=" << state->file_flags.size()
+           << " distinct_flags=" << state->flags_pool.size();
+  return state;
+}
+
+void CompilerFlagCache::LoadCmakeDatabase(const fspath &home_path,
+                                          const fspath &build_path,
+                                          FlagState &state) const {
+  try {
+    if (LoadCmakeCodemodel(home_path, build_path, state)) {
+      return;
     }
   } catch (const std::exception &e) {
-    std::cerr << "Exception " << e.what() << std::endl;
+    LOG_WARN << "project=" << project_->name() << " failed to load "
+             << "the cmake codemodel: " << e.what();
+    state = FlagState{};
+  }
+
+  try {
+    LoadCompileCommandsJsonFile(home_path, build_path,
+                                build_path / "compile_commands.json", state);
+  } catch (const std::exception &e) {
+    LOG_WARN << "project=" << project_->name() << " failed to load "
+             << "compile_commands.json: " << e.what();
+
+    state = FlagState{};
+    LoadClangCompilationDatabase(home_path, build_path, state);
   }
 }
 
-void CompilerFlagCache::LoadClangCompilationDatabase(const fspath &build_path,
-                                                     FsPathSet &abs_src_paths) {
+void CompilerFlagCache::Swap(FlagState &state, FsPathSet &abs_src_paths) {
+  file_flags_.swap(state.file_flags);
+  module_flags_.swap(state.module_flags);
+  module_dirs_ = std::move(state.module_dirs);
+  abs_src_paths.swap(state.abs_src_paths);
+  is_loaded_ = true;
+}
+
+bool CompilerFlagCache::LoadCmakeCodemodel(const fspath &home_path,
+                                           const fspath &build_path,
+                                           FlagState &state) const {
+  CmakeSourceVec sources;
+  if (!ReadCmakeCodemodel(build_path, sources)) {
+    return false;
+  }
+
+  // cmake tells the system include directories of the compilers as well.
+  std::map<std::string, std::string> compilers;  // language -> compiler
+  std::vector<CmakeToolchain> toolchains;
+  if (ReadCmakeToolchains(build_path, toolchains)) {
+    for (const auto &toolchain : toolchains) {
+      compilers[toolchain.language] = toolchain.compiler.string();
+      if (toolchain.language == "CXX" || toolchain.language == "C") {
+        SystemIncludesInst.Put(toolchain.compiler, toolchain.language == "CXX",
+                               toolchain.include_dirs);
+      }
+    }
+  }
+
+  const std::string unknown_compiler;
+  auto get_compiler = [&](const CmakeSource &source) -> const std::string & {
+    auto it = compilers.find(source.language);
+    return it != compilers.end() ? it->second : unknown_compiler;
+  };
+
+  PendingCompilerVec pending_compilers;
+  for (const auto &source : sources) {
+    AddCompiler(CodemodelCommandParser{source, get_compiler(source)}, state,
+                pending_compilers);
+  }
+  ProbeCompilers(pending_compilers, state);
+
+  for (const auto &source : sources) {
+    CodemodelCommandParser parser{source, get_compiler(source)};
+    if (project_->IsFileExcluded(source.abs_path)) {
+      continue;
+    }
+    // A source of several targets takes the flags of the first one.
+    if (!state.abs_src_paths.insert(source.abs_path).second) {
+      continue;
+    }
+    ParseFileCommand(parser, home_path, build_path, state);
+  }
+  return true;
+}
+
+void CompilerFlagCache::LoadCompileCommandsJsonFile(const fspath &home_path,
+                                                    const fspath &build_path,
+                                                    const fspath &json_path,
+                                                    FlagState &state) const {
+  if (!filesystem::exists(json_path)) {
+    THROW_AT_FILE_LINE("%s not exist", json_path.c_str());
+  }
+
+  CompileCommandVec commands =
+      LoadCompileCommands(json_path, ConfigInst.max_workers());
+
+  PendingCompilerVec pending_compilers;
+  for (auto &command : commands) {
+    AddCompiler(JsonCommandParser{command}, state, pending_compilers);
+  }
+  ProbeCompilers(pending_compilers, state);
+
+  for (auto &command : commands) {
+    JsonCommandParser parser{command};
+    const auto &abs_file_path = parser.GetFileAbsPath();
+    if (project_->IsFileExcluded(abs_file_path)) {
+      LOG_INFO << abs_file_path << " is excluded";
+      continue;
+    }
+    if (!state.abs_src_paths.insert(abs_file_path).second) {
+      continue;
+    }
+    ParseFileCommand(parser, home_path, build_path, state);
+  }
+}
+
+void CompilerFlagCache::LoadClangCompilationDatabase(const fspath &home_path,
+                                                     const fspath &build_path,
+                                                     FlagState &state) const {
   CXCompilationDatabase_Error status;
   auto database =
       clang_CompilationDatabase_fromDirectory(build_path.c_str(), &status);
   if (status != CXCompilationDatabase_NoError) {
-    LOG_WARN << "project=" << project_->name() << " failed to create "
-             << " compilation database: " << status;
-
-    LoadCompileCommandsJsonFile(build_path, abs_src_paths);
-
-    return;
+    THROW_AT_FILE_LINE("project<%s> failed to create compilation database: %d",
+                       project_->name().c_str(), status);
   }
 
   RawPointerWrap<CXCompilationDatabase> guard{
@@ -226,6 +658,13 @@ void CompilerFlagCache::LoadClangCompilationDatabase(const fspath &build_path,
     return;
   }
 
+  PendingCompilerVec pending_compilers;
+  for (size_t i = 0; i < num_commands; i++) {
+    auto command = clang_CompileCommands_getCommand(commands.get(), i);
+    AddCompiler(ClangCommandParser{command}, state, pending_compilers);
+  }
+  ProbeCompilers(pending_compilers, state);
+
   for (size_t i = 0; i < num_commands; i++) {
     auto command = clang_CompileCommands_getCommand(commands.get(), i);
 
@@ -234,8 +673,10 @@ void CompilerFlagCache::LoadClangCompilationDatabase(const fspath &build_path,
     if (project_->IsFileExcluded(abs_file_path)) {
       continue;
     }
-    abs_src_paths.insert(abs_file_path);
-    ParseFileCommand(parser, build_path);
+    if (!state.abs_src_paths.insert(abs_file_path).second) {
+      continue;
+    }
+    ParseFileCommand(parser, home_path, build_path, state);
   }
 }
 
@@ -249,6 +690,13 @@ StringVecPtr CompilerFlagCache::GetModuleCompilerFlags(
 }
 
 StringVecPtr CompilerFlagCache::GetFileCompilerFlags(const fspath &path) {
+  // They're kept after the file is deleted, since an editor may save it by
+  // replacing it.
+  auto it = file_flags_.find(path.string());
+  if (it != file_flags_.end()) {
+    return it->second;
+  }
+
   std::string name = GetModuleName(path);
   if (name.empty()) {
     return StringVecPtr{};
@@ -258,28 +706,23 @@ StringVecPtr CompilerFlagCache::GetFileCompilerFlags(const fspath &path) {
 }
 
 std::string CompilerFlagCache::GetModuleName(const fspath &path) const {
-  if (!path.is_absolute()) {
-    fspath abs_path = symutil::absolute_path(path, project_->home_path());
-    return GetModuleName(abs_path);
-  }
+  // A file is never a node of the trie, so it falls back to the directory
+  // it's in.
+  return module_dirs_.Find(
+      symutil::lexical_relative(path, project_->home_path()));
+}
 
-  fspath relative_dir;
-  if (filesystem::is_directory(path)) {
-    relative_dir = filesystem::relative(path, project_->home_path());
-  } else {
-    relative_dir =
-        filesystem::relative(path.parent_path(), project_->home_path());
-  }
-  auto it = rel_dir_module_map_.find(relative_dir);
-  if (it != rel_dir_module_map_.end()) {
-    return it->second;
-  }
-  return std::string{};
+bool CompilerFlagCache::IsModuleDir(const fspath &path) const {
+  return !module_dirs_
+              .FindExact(symutil::lexical_relative(path, project_->home_path()))
+              .empty();
 }
 
 template <class CommandParserType>
 void CompilerFlagCache::ParseFileCommand(const CommandParserType &parser,
-                                         const fspath &build_path) {
+                                         const fspath &home_path,
+                                         const fspath &build_path,
+                                         FlagState &state) const {
   fspath abs_file_path = parser.GetFileAbsPath();
   if (project_->IsFileExcluded(abs_file_path)) {
     return;
@@ -290,71 +733,76 @@ void CompilerFlagCache::ParseFileCommand(const CommandParserType &parser,
     LOG_INFO << "ignore file " << abs_file_path;
     return;
   }
-  auto subproject_dir = symutil::get_project_dir(abs_file_path);
+  auto subproject_dir = parser.GetModuleDir();
   if (!subproject_dir) {
     THROW_AT_FILE_LINE("file=%s out of cmake project", abs_file_path.c_str());
   }
 
-  if (!symutil::path_has_prefix(*subproject_dir, project_->home_path())) {
+  if (!symutil::path_has_prefix(*subproject_dir, home_path)) {
     THROW_AT_FILE_LINE("file=%s project=%s not under project root",
-                       abs_file_path.c_str(), *subproject_dir);
+                       abs_file_path.c_str(), subproject_dir->c_str());
   }
 
-  auto module_home = filesystem::relative(*subproject_dir, project_->home_path());
+  auto module_home = symutil::lexical_relative(*subproject_dir, home_path);
   const auto &module_name = module_home.string();
   fspath relative_dir =
-      filesystem::relative(abs_file_path.parent_path(), project_->home_path());
+      symutil::lexical_relative(abs_file_path.parent_path(), home_path);
 
   LOG_DEBUG << "file=" << abs_file_path << ", module=" << module_name
             << " relative_dir=" << relative_dir;
 
-  rel_dir_module_map_[relative_dir] = module_name;
+  state.module_dirs.Insert(relative_dir, module_name);
 
-  if (module_flags_.find(module_name) != module_flags_.end()) {
-    return;
+  // Before GetFlags(), which may move the compiler out.
+  const StringVec *default_sys_dirs = &ConfigInst.default_inc_dirs();
+  if (default_sys_dirs->empty()) {
+    auto it = state.system_dirs.find(
+        MakeCompilerKey(parser.GetCompiler(), parser.GetWorkDirectory(),
+                        IsCppFile(abs_file_path)));
+    if (it != state.system_dirs.end() && it->second) {
+      default_sys_dirs = it->second.get();
+    }
   }
 
-  rel_dir_module_map_[module_home] = module_name;
-
   std::list<std::string> flags = parser.GetFlags();
 
-  PruneCompilerFlags(flags, abs_file_path.string());
+  StringVec final_flags;
+  final_flags.reserve(flags.size() + default_sys_dirs->size());
 
-  const auto &default_sys_dirs = ConfigInst.default_inc_dirs();
-  StringVecPtr final_flags = std::make_shared<StringVec>();
-  final_flags->reserve(flags.size() + default_sys_dirs.size());
+  std::move(flags.begin(), flags.end(), std::back_inserter(final_flags));
 
-  std::copy(flags.begin(), flags.end(), std::back_inserter(*final_flags));
+  std::copy(default_sys_dirs->begin(), default_sys_dirs->end(),
+            std::back_inserter(final_flags));
 
-  std::copy(default_sys_dirs.begin(), default_sys_dirs.end(),
-            std::back_inserter(*final_flags));
+  StringVecPtr file_flags = state.flags_pool.Intern(std::move(final_flags));
+  state.file_flags[abs_file_path.string()] = file_flags;
 
-  module_flags_[module_name] = final_flags;
+  if (state.module_flags.emplace(module_name, file_flags).second) {
+    state.module_dirs.Insert(module_home, module_name);
+  }
 }
 
 void CompilerFlagCache::AddDirToModule(const fspath &path,
                                        const std::string &module_name) {
   assert(symutil::path_has_prefix(path, project_->home_path()));
-  assert(filesystem::is_directory(path));
-  assert(rel_dir_module_map_.find(path) == rel_dir_module_map_.end());
 
-  auto relative_dir = filesystem::relative(path, project_->home_path());
-  rel_dir_module_map_[relative_dir] = module_name;
+  auto relative_dir = symutil::lexical_relative(path, project_->home_path());
+  assert(module_dirs_.FindExact(relative_dir).empty());
+  module_dirs_.Insert(relative_dir, module_name);
 }
 
 bool CompilerFlagCache::TryRemoveDir(const fspath &path) {
   assert(symutil::path_has_prefix(path, project_->home_path()));
-  auto relative_dir = filesystem::relative(path, project_->home_path());
-  auto it = rel_dir_module_map_.find(relative_dir);
-  if (it == rel_dir_module_map_.end()) {
+  auto relative_dir = symutil::lexical_relative(path, project_->home_path());
+  auto module_name = module_dirs_.FindExact(relative_dir);
+  if (module_name.empty()) {
     LOG_WARN << "path module not found, project=" << project_->name()
              << " path=" << path;
     return false;
   }
 
-  auto module_name = it->second;
-
-  rel_dir_module_map_.erase(it);
+  // The directories under path are gone as well.
+  module_dirs_.Remove(relative_dir);
 
   LOG_STATUS << "project=" << project_->name() << " module=" << module_name
              << " remove dir " << path;
@@ -363,17 +811,15 @@ bool CompilerFlagCache::TryRemoveDir(const fspath &path) {
     return true;
   }
 
-  for (auto lit = rel_dir_module_map_.begin();
-       lit != rel_dir_module_map_.end();) {
-    if (lit->second == module_name) {
-      auto tmp_it = lit++;
-      rel_dir_module_map_.erase(tmp_it);
+  module_dirs_.RemoveModule(module_name);
+  module_flags_.erase(module_name);
+  for (auto it = file_flags_.begin(); it != file_flags_.end();) {
+    if (symutil::path_has_prefix(it->first, path)) {
+      it = file_flags_.erase(it);
     } else {
-      ++lit;
+      ++it;
     }
   }
-
-  module_flags_.erase(module_name);
   return true;
 }
 
@@ -1,29 +1,104 @@
 #ifndef COMPILERFLAGCACHE_H_R6QHBXFU
 #define COMPILERFLAGCACHE_H_R6QHBXFU
 
+#include <functional>
 #include <list>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "ChildProcess.h"
+#include "ModuleTrie.h"
 #include "util/TypeAlias.h"
 
 namespace symdb {
 
 class Project;
+class ProjectConfig;
 
 class CompilerFlagCache {
   using ModuleCompileFlagsMap = std::map<std::string, StringVecPtr>;
-  using RelativeDirModuleMap = std::map<fspath, std::string>;
+  // absolute path -> flags
+  using FileCompileFlagsMap = std::unordered_map<std::string, StringVecPtr>;
 
 public:
-  explicit CompilerFlagCache(Project *project) : project_{project} {}
+  // The files of a target mostly have the same flags, which are stored once
+  // by content and shared. A vector is freed once no file refers to it.
+  class FlagsPool {
+  public:
+    StringVecPtr Intern(StringVec &&flags);
+
+    size_t size() const { return flags_.size(); }
+
+  private:
+    struct Hash {
+      size_t operator()(const StringVecPtr &flags) const;
+    };
+    struct Equal {
+      bool operator()(const StringVecPtr &lhs, const StringVecPtr &rhs) const {
+        return *lhs == *rhs;
+      }
+    };
+
+    std::unordered_set<StringVecPtr, Hash, Equal> flags_;
+  };
+
+  // What's loaded from the compilation database. It's built by a worker,
+  // and swapped in by the main thread as a whole, so the queries never see
+  // a half loaded one.
+  struct FlagState {
+    FileCompileFlagsMap file_flags;
+    // The flags of the first file of a module, for the files which aren't
+    // in the compilation database, e.g. the new ones.
+    ModuleCompileFlagsMap module_flags;
+    ModuleTrie module_dirs;
+    FsPathSet abs_src_paths;
+    FlagsPool flags_pool;  // only for the loading
+    // The -isystem flags of the compilers, see MakeCompilerKey(). nullptr if
+    // a compiler is unknown.
+    std::unordered_map<std::string, StringVecPtr> system_dirs;
+  };
+  using FlagStatePtr = std::shared_ptr<FlagState>;
+
+  explicit CompilerFlagCache(Project *project);
 
   StringVecPtr GetModuleCompilerFlags(const std::string &module_name);
   StringVecPtr GetFileCompilerFlags(const fspath &path);
 
-  void Rebuild(const fspath &cmake_file_path, const fspath &build_path,
-               FsPathSet &abs_src_paths);
+  // Run cmake to export compile_commands.json and the replies of the cmake
+  // file api in a child process, and call on_done(ok) in the main thread
+  // once it exits. Throw if it can't be run.
+  void RunCmake(const fspath &cmake_file_path, const fspath &build_path,
+                std::function<void(bool)> on_done);
+
+  bool IsCmakeRunning() const { return cmake_process_.IsRunning(); }
+
+  // Return the md5 of the inputs of the compilation database of config, or
+  // empty if any of them is unknown. It reads the files, so call it in the
+  // workers.
+  static std::string HashInputs(const ProjectConfig &config);
 
+  // Return the md5 of compile_commands.json and all the cmake inputs listed
+  // by the cmake file api or the generated build system.
+  static std::string HashCmakeInputs(const fspath &cmake_file_path,
+                                     const fspath &build_path);
+
+  // Thread-safe. Load the compilation database of config. Throw if it fails,
+  // e.g. a database of kFile is being written.
+  FlagStatePtr Load(const fspath &home_path, const ProjectConfig &config) const;
+
+  // The sources of the new state are moved to abs_src_paths.
+  void Swap(FlagState &state, FsPathSet &abs_src_paths);
+
+  bool is_loaded() const { return is_loaded_; }
+
+  // path is either a file or a directory, absolute or relative to the
+  // project home. It's purely lexical, so path needn't exist any more.
   std::string GetModuleName(const fspath &path) const;
 
+  // Return true if path is a module home or a directory of the sources,
+  // rather than anything under them. Only those are watched.
+  bool IsModuleDir(const fspath &path) const;
+
   // This happens when directory is created under a module. We assume all
   // the files of a module share the same compiler flags. Therefore, path
   // will inherit the module name of its parent.
@@ -31,20 +106,37 @@ public:
   bool TryRemoveDir(const fspath &path);
 
 private:
-  void LoadCompileCommandsJsonFile(const fspath &build_path,
-                                   FsPathSet &abs_src_paths);
+  // The codemodel of the cmake file api is preferred, then
+  // compile_commands.json, and libclang is tried if neither can be parsed.
+  void LoadCmakeDatabase(const fspath &home_path, const fspath &build_path,
+                         FlagState &state) const;
+
+  // Return false if there's no codemodel reply.
+  bool LoadCmakeCodemodel(const fspath &home_path, const fspath &build_path,
+                          FlagState &state) const;
+
+  // The files already in state are skipped.
+  void LoadCompileCommandsJsonFile(const fspath &home_path,
+                                   const fspath &build_path,
+                                   const fspath &json_path,
+                                   FlagState &state) const;
 
-  void LoadClangCompilationDatabase(const fspath &build_path,
-                                    FsPathSet &abs_src_paths);
+  void LoadClangCompilationDatabase(const fspath &home_path,
+                                    const fspath &build_path,
+                                    FlagState &state) const;
 
   template <class CommandParserType>
   void ParseFileCommand(const CommandParserType &parser,
-                        const fspath &build_path);
+                        const fspath &home_path, const fspath &build_path,
+                        FlagState &state) const;
 
 private:
   Project *project_;
+  FileCompileFlagsMap file_flags_;
   ModuleCompileFlagsMap module_flags_;
-  RelativeDirModuleMap rel_dir_module_map_;
+  ModuleTrie module_dirs_;
+  bool is_loaded_ = false;
+  ChildProcess cmake_process_;
 };
 
 }  // namespace symdb
@@ -2,6 +2,7 @@
 #include <cstdio>
 #include <exception>
 #include <iostream>
+#include "SystemIncludes.h"
 #include "pugixml.hpp"
 #include "util/Exceptions.h"
 #include "util/Functions.h"
@@ -31,15 +32,6 @@ inline std::string child_value_or_throw(const pugi::xml_node &node,
   return child.child_value();
 }
 
-RegexPattern::RegexPattern(const std::string &orig_pattern,
-                           const std::string &used_pattern, bool is_from_global)
-    : pattern_{orig_pattern},
-      regex_{std::regex(used_pattern)},
-      is_from_global_{is_from_global} {}
-
-RegexPattern::RegexPattern(const std::string &the_pattern, bool is_from_global)
-    : RegexPattern(the_pattern, the_pattern, is_from_global) {}
-
 ProjectConfig::ProjectConfig(const std::string &name, const std::string &home)
     : name_{name} {
   fspath tmp_path{home};
@@ -68,30 +60,50 @@ void ProjectConfig::SetCmakeFile(std::string path) {
   LOG_DEBUG << "project=" << name_ << " final_cmake_file=" << cmake_file;
 }
 
+void ProjectConfig::SetCompileDb(CompileDbProvider provider,
+                                 const StringVec &files) {
+  if (provider != CompileDbProvider::kCmake && files.empty()) {
+    THROW_AT_FILE_LINE("project<%s> no compile database file", name_.c_str());
+  }
+  if (provider == CompileDbProvider::kFile && files.size() > 1) {
+    THROW_AT_FILE_LINE("project<%s> use the merge provider for %zu files",
+                       name_.c_str(), files.size());
+  }
+
+  compile_db_provider_ = provider;
+  compile_db_files_.clear();
+  for (auto path : files) {
+    symutil::replace_string(path, "{PROJECT_HOME}", home_path_.string());
+    // Not canonical since it may be generated later.
+    compile_db_files_.push_back(
+        (home_path_ / symutil::expand_env(path)).lexically_normal());
+    LOG_DEBUG << "project=" << name_
+              << " compile_db_file=" << compile_db_files_.back();
+  }
+}
+
 void ProjectConfig::AddExcludePattern(const std::string &pattern) {
   std::string used_pattern = pattern;
   symutil::replace_string(used_pattern, "{PROJECT_HOME}", home_path_.string());
-  exclude_patterns_.push_back(RegexPattern{pattern, used_pattern});
+  exclude_matcher_.Add(used_pattern);
 }
 
 void ProjectConfig::SpecializeGlobalPattern(const std::string &pattern) {
   std::string used_pattern = pattern;
   symutil::replace_string(used_pattern, "{PROJECT_HOME}", home_path_.string());
   if (used_pattern != pattern) {
-    exclude_patterns_.push_back(RegexPattern{pattern, used_pattern, true});
+    exclude_matcher_.Add(used_pattern);
   } else {
     LOG_ERROR << "no project info in pattern: " << pattern;
   }
 }
 
 bool ProjectConfig::IsFileExcluded(const fspath &path) const {
-  for (const auto &rp : exclude_patterns_) {
-    if (std::regex_match(path.string(), rp.regex())) {
-      return true;
-    }
-  }
+  return exclude_matcher_.Match(path.string());
+}
 
-  return ConfigInst.IsFileExcluded(path);
+bool ProjectConfig::IsDirTreeExcluded(const fspath &dir) const {
+  return exclude_matcher_.MatchTree((dir / "").string());
 }
 
 void ProjectConfig::UseDefaultBuildPath() {
@@ -127,6 +139,15 @@ void Config::Init(const std::string &xml_file) {
   max_workers_ =
       std::stoull(child_value_or_default(root_node, "MaxWorker", "8"));
 
+  auto watcher = child_value_or_default(root_node, "FileWatcher", "inotify");
+  if (watcher == "inotify") {
+    file_watcher_backend_ = FileWatcherBackend::kInotify;
+  } else if (watcher == "fanotify") {
+    file_watcher_backend_ = FileWatcherBackend::kFanotify;
+  } else {
+    THROW_AT_FILE_LINE("unknown file watcher<%s>", watcher.c_str());
+  }
+
   auto ensure_dir_exists = [](const std::string &dir) {
     filesystem::path dir_path(dir);
     filesystem::create_directories(dir_path);
@@ -139,6 +160,8 @@ void Config::Init(const std::string &xml_file) {
 
   symdb::InitLogger(symdb::LogLevel::DEBUG, log_file.string());
 
+  ParseLevelDBConfig(root_node.child("LevelDB"), leveldb_config_);
+
   InitGlobalExcludePattern(root_node);
   InitProjectsConfig(root_node);
   InitDefaultIncDirs(root_node);
@@ -152,7 +175,8 @@ void Config::InitGlobalExcludePattern(const pugi::xml_node &root_node) {
     if (pattern.find("{PROJECT_HOME}") != std::string::npos) {
       global_project_patterns_.push_back(pattern);
     } else {
-      global_excluded_patterns_.push_back(RegexPattern{pattern});
+      global_exclude_matcher_.Add(pattern);
+      global_excluded_patterns_.push_back(pattern);
     }
   }
 }
@@ -176,15 +200,37 @@ void Config::InitProjectsConfig(const pugi::xml_node &root) {
 
     auto build_dir = child_value_or_default(node, "BuildDir", "_build");
     pc->SetBuildPath(build_dir);
-    auto cmake_file =
-        child_value_or_default(node, "CMakeFile", "CMakeLists.txt");
-    pc->SetCmakeFile(cmake_file);
+
+    const auto &db_node = node.child("CompileDatabase");
+    std::string provider = db_node.attribute("provider").as_string("cmake");
+    StringVec db_files;
+    for (const auto &file : db_node.children("File")) {
+      db_files.push_back(file.child_value());
+    }
+    if (provider == "cmake") {
+      auto cmake_file =
+          child_value_or_default(node, "CMakeFile", "CMakeLists.txt");
+      pc->SetCmakeFile(cmake_file);
+      pc->SetCompileDb(CompileDbProvider::kCmake, db_files);
+    } else if (provider == "file") {
+      pc->SetCompileDb(CompileDbProvider::kFile, db_files);
+    } else if (provider == "merge") {
+      pc->SetCompileDb(CompileDbProvider::kMerge, db_files);
+    } else {
+      THROW_AT_FILE_LINE("project<%s> unknown compile database provider<%s>",
+                         name.c_str(), provider.c_str());
+    }
 
     pc->is_enable_file_watch(
         node.child("EnableFileWatch").text().as_bool(true));
-    for (const auto &pattern : global_project_patterns_) {
-      pc->SpecializeGlobalPattern(pattern);
-    }
+    pc->is_enable_text_index(
+        node.child("EnableTextIndex").text().as_bool(true));
+
+    LevelDBConfig ldb_config = leveldb_config_;
+    ParseLevelDBConfig(node.child("LevelDB"), ldb_config);
+    pc->leveldb_config(ldb_config);
+
+    AddGlobalExcludePatterns(*pc);
     projects_.push_back(pc);
   }
 }
@@ -200,54 +246,60 @@ void Config::InitDefaultIncDirs(const pugi::xml_node &root) {
       default_inc_dirs_.push_back(x.node().child_value());
     }
   } else {
-    const std::string command = "g++ -E -x c++ - -v < /dev/null 2>&1";
-    const std::string kSysIncSearchBegin = "#include <...> search starts here:";
-    const std::string kSysIncSearchEnd = "End of search list.";
-    FILE *stream = popen(command.c_str(), "r");
-    if (stream == nullptr) {
-      THROW_AT_FILE_LINE("popen error: %s", strerror(errno));
-    }
-
-    const char *unwanted = " \t";
+    // Probed per compiler of the compilation databases instead.
+    SystemIncludesInst.Init(fspath{db_path_} / "system_includes");
+  }
+}
 
-    std::vector<std::string> default_inc_dirs;
-    bool is_started = false;
-    char line[4096];
-    while (fgets(line, 4096, stream) != nullptr) {
-      char *start = line + strspn(line, " \t");
-      char *end = start + strlen(start);
-      if (*(end - 1) == '\n') {
-        --end;
-      }
+// Only the children present in node override the values of cfg, so a
+// project inherits the global settings.
+void Config::ParseLevelDBConfig(const pugi::xml_node &node,
+                                LevelDBConfig &cfg) {
+  if (!node) {
+    return;
+  }
 
-      std::string str_line{start, end};
-      if (is_started && str_line.find(kSysIncSearchEnd) != std::string::npos) {
-        break;
-      } else if (is_started) {
-        if (str_line.front() != '/') {
-          LOG_ERROR << "line is not a path: " << str_line;
-        } else {
-          LOG_DEBUG << "Add default inc dir: " << str_line;
-          default_inc_dirs_.push_back("-isystem");
-          default_inc_dirs_.push_back(str_line);
-        }
-      } else if (strstr(line, kSysIncSearchBegin.c_str()) != nullptr) {
-        is_started = true;
-      }
+  auto parse_size = [&node](const char *name, size_t &value) {
+    const auto &child = node.child(name);
+    if (child) {
+      value = child.text().as_ullong(value);
     }
-    pclose(stream);
+  };
+
+  parse_size("BlockCacheSize", cfg.block_cache_size);
+  parse_size("BlockSize", cfg.block_size);
+  parse_size("WriteBufferSize", cfg.write_buffer_size);
+  parse_size("BulkWriteBufferSize", cfg.bulk_write_buffer_size);
+
+  cfg.bloom_filter_bits =
+      node.child("BloomFilterBits").text().as_int(cfg.bloom_filter_bits);
+  cfg.max_open_files =
+      node.child("MaxOpenFiles").text().as_int(cfg.max_open_files);
+  cfg.use_compression =
+      node.child("Compression").text().as_bool(cfg.use_compression);
+
+  std::string format = node.child("RecordFormat").text().as_string();
+  if (format == "flat") {
+    cfg.record_format = RecordFormat::kFlat;
+  } else if (format == "protobuf") {
+    cfg.record_format = RecordFormat::kProtobuf;
+  } else if (!format.empty()) {
+    LOG_WARN << "unknown RecordFormat=" << format;
   }
 }
 
-bool Config::IsFileExcluded(const fspath &path) const {
-  for (const auto &rp : global_excluded_patterns_) {
-    bool is_matched = std::regex_match(path.string(), rp.regex());
-    if (is_matched) {
-      return true;
-    }
+void Config::AddGlobalExcludePatterns(ProjectConfig &pc) const {
+  for (const auto &pattern : global_project_patterns_) {
+    pc.SpecializeGlobalPattern(pattern);
+  }
+  // So a path is matched against all the patterns in one go.
+  for (const auto &pattern : global_excluded_patterns_) {
+    pc.AddExcludePattern(pattern);
   }
+}
 
-  return false;
+bool Config::IsFileExcluded(const fspath &path) const {
+  return global_exclude_matcher_.Match(path.string());
 }
 
 }  // namespace symdb
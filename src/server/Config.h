@@ -1,10 +1,10 @@
 #pragma once
 
 #include <map>
-#include <regex>
 #include <set>
 #include <string>
 #include <vector>
+#include "ExcludeMatcher.h"
 #include "util/TypeAlias.h"
 
 namespace pugi {
@@ -13,21 +13,35 @@ class xml_node;
 
 namespace symdb {
 
-class RegexPattern {
-public:
-  RegexPattern(const std::string &pattern, bool is_from_global = false);
+// How the index records are encoded in the database, see FlatRecord.h.
+enum class RecordFormat { kProtobuf, kFlat };
 
-  RegexPattern(const std::string &orig_pattern, const std::string &use_pattern,
-               bool is_from_global = false);
+// Where the compilation database of a project comes from.
+enum class CompileDbProvider {
+  kCmake,  // regenerated by cmake in the build dir when its inputs change
+  kFile,   // generated by others, e.g. ninja or bazel, and reloaded on change
+  kMerge,  // ditto, but several databases merged, the first one wins
+};
 
-  const std::string &pattern() const { return pattern_; }
-  const std::regex regex() const { return regex_; }
-  bool is_from_global() const { return is_from_global_; }
+// How the changes of the files are watched, see FileWatcher.
+enum class FileWatcherBackend {
+  kInotify,   // a watch per directory, limited by max_user_watches
+  kFanotify,  // a mark per filesystem, needs CAP_SYS_ADMIN
+};
 
-private:
-  std::string pattern_;
-  std::regex regex_;
-  bool is_from_global_;
+// Tuning knobs of the leveldb of a project. A freshly created database is
+// filled by a full build, so it uses a larger write buffer to flush fewer
+// level-0 files. An existing database is mostly read by the editors.
+struct LevelDBConfig {
+  size_t block_cache_size = 32 << 20;
+  size_t block_size = 16 << 10;
+  size_t write_buffer_size = 8 << 20;
+  size_t bulk_write_buffer_size = 64 << 20;
+  int bloom_filter_bits = 10;  // 0 disables the bloom filter
+  int max_open_files = 1000;
+  bool use_compression = true;
+  // Only used when the database is created. An existing one keeps its format.
+  RecordFormat record_format = RecordFormat::kFlat;
 };
 
 class ProjectConfig {
@@ -36,24 +50,38 @@ public:
 
   void SetBuildPath(std::string path);
   void SetCmakeFile(std::string path);
+  // The files may not exist yet. They're ignored by kCmake.
+  void SetCompileDb(CompileDbProvider provider, const StringVec &files);
 
   void AddExcludePattern(const std::string &pattern);
   void SpecializeGlobalPattern(const std::string &pattern);
   bool IsFileExcluded(const fspath &path) const;
+  // Return true if all the paths under dir are excluded.
+  bool IsDirTreeExcluded(const fspath &dir) const;
 
   // Try home_path_/{build,_build}
   void UseDefaultBuildPath();
 
   bool is_enable_file_watch() const { return is_enable_file_watch_; }
+  bool is_enable_text_index() const { return is_enable_text_index_; }
+  const LevelDBConfig &leveldb_config() const { return leveldb_config_; }
   const std::string &name() const { return name_; }
   const fspath &home_path() const { return home_path_; }
   const fspath &build_path() const { return build_path_; }
   const fspath &cmake_file() const { return cmake_file_; }
+  CompileDbProvider compile_db_provider() const { return compile_db_provider_; }
+  const FsPathVec &compile_db_files() const { return compile_db_files_; }
 
   void is_enable_file_watch(bool is_enabled) {
     is_enable_file_watch_ = is_enabled;
   }
 
+  void is_enable_text_index(bool is_enabled) {
+    is_enable_text_index_ = is_enabled;
+  }
+
+  void leveldb_config(const LevelDBConfig &cfg) { leveldb_config_ = cfg; }
+
 private:
   std::string name_;
   fspath home_path_;
@@ -62,8 +90,14 @@ private:
   // But few projects don't use a top CMakeLists.txt. They refer to a cmake file
   // in a sibling directory.
   fspath cmake_file_;
-  std::vector<RegexPattern> exclude_patterns_;
+  CompileDbProvider compile_db_provider_ = CompileDbProvider::kCmake;
+  FsPathVec compile_db_files_;  // absolute
+  // Its own patterns, the specialized global ones and the other global ones.
+  ExcludeMatcher exclude_matcher_;
   bool is_enable_file_watch_;
+  // The trigram index of the text, see TextIndex.
+  bool is_enable_text_index_ = true;
+  LevelDBConfig leveldb_config_;
 };
 
 using ProjectConfigPtr = std::shared_ptr<ProjectConfig>;
@@ -74,11 +108,18 @@ public:
 
   bool IsFileExcluded(const fspath &path) const;
 
+  // The project config has no fallback to the global patterns.
+  void AddGlobalExcludePatterns(ProjectConfig &pc) const;
+
   const std::string &log_path() const { return log_path_; }
   const std::string &db_path() const { return db_path_; }
   const std::string &listen_path() const { return listen_path_; }
   const StringVec &default_inc_dirs() const { return default_inc_dirs_; }
   uint32_t max_workers() const { return max_workers_; }
+  FileWatcherBackend file_watcher_backend() const {
+    return file_watcher_backend_;
+  }
+  const LevelDBConfig &leveldb_config() const { return leveldb_config_; }
 
   const std::vector<ProjectConfigPtr> &projects() { return projects_; };
 
@@ -103,6 +144,9 @@ private:
 
   void InitProjectsConfig(const pugi::xml_node &root);
 
+  static void ParseLevelDBConfig(const pugi::xml_node &node,
+                                 LevelDBConfig &cfg);
+
 private:
   Config() = default;
 
@@ -110,10 +154,13 @@ private:
   std::string log_path_;
   std::string listen_path_;
   StringVec default_inc_dirs_;
-  std::vector<RegexPattern> global_excluded_patterns_;
+  StringVec global_excluded_patterns_;
+  ExcludeMatcher global_exclude_matcher_;
   std::vector<std::string> global_project_patterns_;
   std::vector<ProjectConfigPtr> projects_;
+  LevelDBConfig leveldb_config_;
   uint32_t max_workers_ = 8;
+  FileWatcherBackend file_watcher_backend_ = FileWatcherBackend::kInotify;
 };
 
 }  // namespace symdb
@@ -0,0 +1,182 @@
+#include "DirScanner.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include "util/Logger.h"
+
+namespace symdb {
+
+namespace {
+
+// The record of getdents64(2), which glibc doesn't declare.
+struct LinuxDirent64 {
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+// Return DT_UNKNOWN if it fails.
+unsigned char StatType(int dir_fd, const char *name, int flags) {
+  struct stat st;
+  if (::fstatat(dir_fd, name, &st, flags) != 0) {
+    return DT_UNKNOWN;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    return DT_DIR;
+  } else if (S_ISREG(st.st_mode)) {
+    return DT_REG;
+  } else if (S_ISLNK(st.st_mode)) {
+    return DT_LNK;
+  }
+  return DT_UNKNOWN;
+}
+
+class TreeScanner {
+  struct Task {
+    fspath dir;
+    bool is_recursive;
+  };
+
+public:
+  TreeScanner(const std::function<bool(const fspath &)> &is_descended,
+              const std::function<bool(std::string_view)> &is_wanted_file)
+      : is_descended_{is_descended}, is_wanted_file_{is_wanted_file} {}
+
+  std::vector<ScannedDir> Run(const fspath &root, size_t max_threads) {
+    tasks_.push_back(Task{root, true});
+
+    std::vector<std::vector<ScannedDir>> results(
+        std::max<size_t>(1, max_threads));
+    std::vector<std::thread> threads;
+    threads.reserve(results.size() - 1);
+    for (size_t i = 1; i < results.size(); ++i) {
+      threads.emplace_back(&TreeScanner::Work, this, std::ref(results[i]));
+    }
+    Work(results[0]);
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    std::vector<ScannedDir> scanned_dirs = std::move(results[0]);
+    for (size_t i = 1; i < results.size(); ++i) {
+      std::move(results[i].begin(), results[i].end(),
+                std::back_inserter(scanned_dirs));
+    }
+    return scanned_dirs;
+  }
+
+private:
+  void Work(std::vector<ScannedDir> &scanned_dirs) {
+    for (;;) {
+      Task task;
+      {
+        std::unique_lock<std::mutex> lock{mutex_};
+        cond_.wait(lock, [this] { return !tasks_.empty() || nr_busy_ == 0; });
+        if (tasks_.empty()) {
+          return;
+        }
+        // Depth first, so fewer directories are queued.
+        task = std::move(tasks_.back());
+        tasks_.pop_back();
+        ++nr_busy_;
+      }
+
+      std::vector<Task> sub_tasks;
+      scanned_dirs.push_back(ScannedDir{task.dir, FsPathVec{}});
+      ReadDir(task, sub_tasks, scanned_dirs.back().files);
+
+      bool is_done = false;
+      {
+        std::lock_guard<std::mutex> guard{mutex_};
+        std::move(sub_tasks.begin(), sub_tasks.end(),
+                  std::back_inserter(tasks_));
+        --nr_busy_;
+        is_done = tasks_.empty() && nr_busy_ == 0;
+      }
+      if (is_done || !sub_tasks.empty()) {
+        cond_.notify_all();
+      }
+    }
+  }
+
+  void ReadDir(const Task &task, std::vector<Task> &sub_tasks,
+               FsPathVec &files) const {
+    int fd = ::open(task.dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+      LOG_ERROR << "open error: " << strerror(errno) << ", dir=" << task.dir;
+      return;
+    }
+
+    alignas(LinuxDirent64) char buf[32 << 10];
+    for (;;) {
+      long nread = ::syscall(SYS_getdents64, fd, buf, sizeof(buf));
+      if (nread < 0) {
+        LOG_ERROR << "getdents64 error: " << strerror(errno)
+                  << ", dir=" << task.dir;
+        break;
+      } else if (nread == 0) {
+        break;
+      }
+
+      for (long pos = 0; pos < nread;) {
+        const auto *entry = reinterpret_cast<const LinuxDirent64 *>(buf + pos);
+        pos += entry->d_reclen;
+
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+          continue;
+        }
+
+        // Some filesystems, e.g. old xfs, don't fill d_type.
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+          type = StatType(fd, name, AT_SYMLINK_NOFOLLOW);
+        }
+        bool is_link = type == DT_LNK;
+        if (is_link) {
+          type = StatType(fd, name, 0);
+        }
+
+        if (type == DT_DIR && task.is_recursive) {
+          fspath sub_dir = task.dir / name;
+          if (is_descended_(sub_dir)) {
+            sub_tasks.push_back(Task{std::move(sub_dir), !is_link});
+          }
+        } else if (type == DT_REG && is_wanted_file_(name)) {
+          files.push_back(task.dir / name);
+        }
+      }
+    }
+
+    ::close(fd);
+  }
+
+private:
+  const std::function<bool(const fspath &)> &is_descended_;
+  const std::function<bool(std::string_view)> &is_wanted_file_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<Task> tasks_;
+  size_t nr_busy_ = 0;
+};
+
+}  // namespace
+
+std::vector<ScannedDir> ScanDirTree(
+    const fspath &root, const std::function<bool(const fspath &)> &is_descended,
+    const std::function<bool(std::string_view)> &is_wanted_file,
+    size_t max_threads) {
+  return TreeScanner{is_descended, is_wanted_file}.Run(root, max_threads);
+}
+
+}  // namespace symdb
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <functional>
+#include <string_view>
+#include <vector>
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+struct ScannedDir {
+  fspath path;  // absolute
+  FsPathVec files;
+};
+
+// Walk the tree under root with getdents64(2), which tells the type of an
+// entry without a stat on most filesystems. A directory under root is read
+// only if is_descended(dir) is true, so a pruned subtree costs nothing. The
+// regular files are returned if is_wanted_file(name) is true.
+//
+// The directories are read by up to max_threads threads, so both the
+// callbacks must be thread-safe. A directory which can't be read is logged
+// and returned without files. A symbolic link to a directory is read but
+// not descended, like std::filesystem::recursive_directory_iterator.
+std::vector<ScannedDir> ScanDirTree(
+    const fspath &root, const std::function<bool(const fspath &)> &is_descended,
+    const std::function<bool(std::string_view)> &is_wanted_file,
+    size_t max_threads);
+
+}  // namespace symdb
@@ -0,0 +1,215 @@
+#include "ExcludeMatcher.h"
+#include <cctype>
+#include <cstring>
+#include "util/Logger.h"
+
+namespace symdb {
+
+namespace {
+
+// A pattern expanded to more strings is left to the regex.
+constexpr size_t kMaxExpansions = 64;
+
+// Expand a regex made of only literal chars, escaped punctuations, groups of
+// alternatives and '?' to all the strings it matches. Anything else, e.g.
+// '.', '*', a class or a lookahead, fails it.
+class LiteralExpander {
+public:
+  explicit LiteralExpander(const std::string &regex) : regex_{regex} {}
+
+  bool Expand(std::vector<std::string> &strings) {
+    return ParseAlternatives(strings) && pos_ == regex_.size();
+  }
+
+private:
+  // alternatives := sequence ('|' sequence)*
+  bool ParseAlternatives(std::vector<std::string> &strings) {
+    strings.clear();
+    for (;;) {
+      std::vector<std::string> sequence;
+      if (!ParseSequence(sequence)) {
+        return false;
+      }
+      strings.insert(strings.end(), sequence.begin(), sequence.end());
+      if (strings.size() > kMaxExpansions) {
+        return false;
+      }
+      if (pos_ == regex_.size() || regex_[pos_] != '|') {
+        return true;
+      }
+      ++pos_;
+    }
+  }
+
+  // sequence := (atom '?'?)*
+  bool ParseSequence(std::vector<std::string> &strings) {
+    strings.assign(1, std::string{});
+    while (pos_ < regex_.size() && regex_[pos_] != '|' && regex_[pos_] != ')') {
+      std::vector<std::string> atom;
+      if (!ParseAtom(atom)) {
+        return false;
+      }
+      if (pos_ < regex_.size() && regex_[pos_] == '?') {
+        ++pos_;
+        atom.emplace_back();
+      }
+      if (strings.size() * atom.size() > kMaxExpansions) {
+        return false;
+      }
+
+      std::vector<std::string> product;
+      product.reserve(strings.size() * atom.size());
+      for (const auto &head : strings) {
+        for (const auto &tail : atom) {
+          product.push_back(head + tail);
+        }
+      }
+      strings.swap(product);
+    }
+    return true;
+  }
+
+  // atom := char | '\' punctuation | '(' ['?:'] alternatives ')'
+  bool ParseAtom(std::vector<std::string> &strings) {
+    char c = regex_[pos_++];
+    if (c == '\\') {
+      // \d, \b, \1 and so on aren't literals.
+      if (pos_ == regex_.size() || std::isalnum(regex_[pos_])) {
+        return false;
+      }
+      strings.assign(1, std::string(1, regex_[pos_++]));
+      return true;
+    } else if (c == '(') {
+      if (regex_.compare(pos_, 2, "?:") == 0) {
+        pos_ += 2;
+      } else if (pos_ < regex_.size() && regex_[pos_] == '?') {
+        return false;
+      }
+      if (!ParseAlternatives(strings) || pos_ == regex_.size() ||
+          regex_[pos_] != ')') {
+        return false;
+      }
+      ++pos_;
+      return true;
+    } else if (c == '\0' || strchr(".^$|)[]{}*+?", c) != nullptr) {
+      return false;
+    }
+    strings.assign(1, std::string(1, c));
+    return true;
+  }
+
+private:
+  const std::string &regex_;
+  size_t pos_ = 0;
+};
+
+// True if the char before pos isn't escaped by an odd number of '\'.
+bool IsUnescaped(const std::string &regex, size_t pos) {
+  size_t nr_backslashes = 0;
+  while (pos > nr_backslashes && regex[pos - nr_backslashes - 1] == '\\') {
+    ++nr_backslashes;
+  }
+  return nr_backslashes % 2 == 0;
+}
+
+}  // namespace
+
+void ExcludeMatcher::Trie::Insert(const std::string &key, bool is_prefix) {
+  uint32_t node = 0;
+  for (char c : key) {
+    auto it = nodes_[node].children.find(c);
+    if (it != nodes_[node].children.end()) {
+      node = it->second;
+      continue;
+    }
+    auto child = static_cast<uint32_t>(nodes_.size());
+    nodes_[node].children.emplace(c, child);
+    nodes_.emplace_back();
+    node = child;
+  }
+
+  if (is_prefix) {
+    nodes_[node].is_prefix_end = true;
+  } else {
+    nodes_[node].is_exact_end = true;
+  }
+}
+
+void ExcludeMatcher::Add(const std::string &pattern) {
+  // regex_match() anchors both ends, so '^' and '$' are redundant.
+  std::string body = pattern;
+  if (!body.empty() && body.front() == '^') {
+    body.erase(0, 1);
+  }
+  if (!body.empty() && body.back() == '$' &&
+      IsUnescaped(body, body.size() - 1)) {
+    body.pop_back();
+  }
+
+  bool is_any_head = body.compare(0, 2, ".*") == 0;
+  if (is_any_head) {
+    body.erase(0, 2);
+  }
+  bool is_any_tail = body.size() >= 2 &&
+                     body.compare(body.size() - 2, 2, ".*") == 0 &&
+                     IsUnescaped(body, body.size() - 2);
+  if (is_any_tail) {
+    body.resize(body.size() - 2);
+  }
+
+  std::vector<std::string> strings;
+  if (!LiteralExpander{body}.Expand(strings)) {
+    std::string joined = "(?:" + pattern + ")";
+    for (const auto &rp : regex_patterns_) {
+      joined += "|(?:" + rp + ")";
+    }
+    // Nothing is changed if it throws.
+    regex_ = std::regex{joined};
+    regex_patterns_.push_back(pattern);
+    patterns_.push_back(pattern);
+    LOG_DEBUG << "pattern=" << pattern << " is left to regex";
+    return;
+  }
+
+  patterns_.push_back(pattern);
+
+  for (auto &str : strings) {
+    if (is_any_head && is_any_tail) {
+      infixes_.push_back(str);
+    } else if (is_any_head) {
+      reversed_suffixes_.Insert(std::string{str.rbegin(), str.rend()}, true);
+    } else {
+      prefixes_.Insert(str, is_any_tail);
+    }
+  }
+}
+
+bool ExcludeMatcher::Match(const std::string &path) const {
+  if (prefixes_.Match(path.begin(), path.end()) ||
+      reversed_suffixes_.Match(path.rbegin(), path.rend())) {
+    return true;
+  }
+
+  for (const auto &infix : infixes_) {
+    if (path.find(infix) != std::string::npos) {
+      return true;
+    }
+  }
+
+  return !regex_patterns_.empty() && std::regex_match(path, regex_);
+}
+
+bool ExcludeMatcher::MatchTree(const std::string &dir) const {
+  if (prefixes_.Match(dir.begin(), dir.end(), true)) {
+    return true;
+  }
+
+  for (const auto &infix : infixes_) {
+    if (dir.find(infix) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace symdb
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace symdb {
+
+// Matches a path against all the exclude patterns at once. A pattern is a
+// regex which must match the whole path, but nearly all of them are
+// literals with a leading and/or a trailing ".*", e.g.
+// "/home/me/proj/test/.*" or ".*\.(pb|generated)\.(cc|h)$". Those are
+// expanded to their literal strings, so a path is checked in one walk of a
+// trie of the prefixes and one of the reversed suffixes, instead of running
+// every regex on it. The rest are joined into a single regex.
+//
+// Add() isn't thread-safe, Match() is.
+class ExcludeMatcher {
+public:
+  // Throw std::regex_error if pattern isn't a valid regex.
+  void Add(const std::string &pattern);
+
+  bool Match(const std::string &path) const;
+
+  // Return true if every path under dir is matched, which is only known from
+  // the prefix and the infix patterns. dir should end with '/'.
+  bool MatchTree(const std::string &dir) const;
+
+  bool empty() const { return patterns_.empty(); }
+
+private:
+  // A byte trie. A key either matches an input it's a prefix of, or only the
+  // whole input.
+  class Trie {
+  public:
+    void Insert(const std::string &key, bool is_prefix);
+
+    // An exact key isn't matched if is_prefix_only.
+    template <class Iter>
+    bool Match(Iter first, Iter last, bool is_prefix_only = false) const {
+      uint32_t node = 0;
+      for (;; ++first) {
+        if (nodes_[node].is_prefix_end) {
+          return true;
+        }
+        if (first == last) {
+          return !is_prefix_only && nodes_[node].is_exact_end;
+        }
+        auto it = nodes_[node].children.find(*first);
+        if (it == nodes_[node].children.end()) {
+          return false;
+        }
+        node = it->second;
+      }
+    }
+
+  private:
+    struct Node {
+      std::map<char, uint32_t> children;
+      bool is_prefix_end = false;
+      bool is_exact_end = false;
+    };
+
+    std::vector<Node> nodes_{1};
+  };
+
+private:
+  std::vector<std::string> patterns_;
+  Trie prefixes_;  // with the exact ones
+  Trie reversed_suffixes_;
+  std::vector<std::string> infixes_;
+  std::vector<std::string> regex_patterns_;
+  std::regex regex_;
+};
+
+}  // namespace symdb
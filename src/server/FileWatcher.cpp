@@ -0,0 +1,339 @@
+#include "FileWatcher.h"
+#include <fcntl.h>
+#include <sys/fanotify.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "util/Exceptions.h"
+#include "util/Logger.h"
+
+namespace symdb {
+
+namespace {
+
+class InotifyWatcher : public FileWatcher {
+public:
+  explicit InotifyWatcher(int fd) : FileWatcher{fd} {}
+
+  const char *name() const override { return "inotify"; }
+
+  int AddWatch(const fspath &path, uint32_t mask) override {
+    int wd = inotify_add_watch(fd_, path.c_str(), mask);
+    if (wd < 0) {
+      THROW_AT_FILE_LINE("inotify_add_watch error: %s", strerror(errno));
+    }
+    return wd;
+  }
+
+  void RemoveWatch(int wd) override {
+    if (inotify_rm_watch(fd_, wd) < 0) {
+      LOG_ERROR << "inotify_rm_watch error: " << strerror(errno);
+    }
+  }
+
+protected:
+  void ParseEvents(const char *buf, size_t nread,
+                   std::vector<FileEvent> &events) override {
+    for (size_t offset = 0; offset < nread;) {
+      const auto *event = reinterpret_cast<const inotify_event *>(buf + offset);
+      offset += sizeof(inotify_event) + event->len;
+      // The name is padded with '\0'.
+      events.push_back(FileEvent{
+          event->wd, event->mask,
+          std::string_view{event->name, strnlen(event->name, event->len)}});
+    }
+  }
+};
+
+// Marks the whole filesystems, so the number of the directories costs
+// nothing in the kernel. The events report the file handle of the directory
+// and the entry name, which are looked up among the watched paths here, and
+// the others are dropped. A path is keyed by its fsid and file handle, or
+// by those of its directory and its name if it's not a directory.
+//
+// The marks are never removed, the events of a filesystem without any watch
+// are just dropped.
+class FanotifyWatcher : public FileWatcher {
+  struct Watch {
+    std::string key;
+    uint32_t mask;
+  };
+
+public:
+  explicit FanotifyWatcher(int fd) : FileWatcher{fd} {}
+
+  const char *name() const override { return "fanotify"; }
+
+  static std::string GetFsid(const fspath &path) {
+    struct statfs stfs;
+    if (::statfs(path.c_str(), &stfs) != 0) {
+      THROW_AT_FILE_LINE("statfs error: %s", strerror(errno));
+    }
+    return std::string{reinterpret_cast<const char *>(&stfs.f_fsid),
+                       sizeof(stfs.f_fsid)};
+  }
+
+  void MarkFilesystem(const fspath &path, const std::string &fsid) {
+    if (marked_fsids_.find(fsid) != marked_fsids_.end()) {
+      return;
+    }
+
+    // No FAN_MODIFY, which would report every write of the filesystem,
+    // including those of our own databases. The writers close the files.
+    const uint64_t mask = FAN_CREATE | FAN_DELETE | FAN_CLOSE_WRITE |
+                          FAN_MOVED_FROM | FAN_MOVED_TO | FAN_DELETE_SELF |
+                          FAN_MOVE_SELF | FAN_ONDIR;
+    if (fanotify_mark(fd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD,
+                      path.c_str()) != 0) {
+      THROW_AT_FILE_LINE("fanotify_mark error: %s, path=%s", strerror(errno),
+                         path.c_str());
+    }
+    marked_fsids_.insert(fsid);
+    LOG_INFO << "marked filesystem of " << path;
+  }
+
+  int AddWatch(const fspath &path, uint32_t mask) override {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+      THROW_AT_FILE_LINE("stat error: %s", strerror(errno));
+    }
+
+    std::string fsid = GetFsid(path);
+    MarkFilesystem(path, fsid);
+
+    std::string key;
+    if (S_ISDIR(st.st_mode)) {
+      key = GetHandleKey(path, fsid);
+    } else {
+      key = GetHandleKey(path.parent_path(), fsid);
+      key.push_back('/');
+      key += path.filename().string();
+    }
+
+    auto it = wds_.find(key);
+    if (it != wds_.end()) {
+      auto &watch = watches_.at(it->second);
+      watch.mask = (mask & IN_MASK_ADD) ? watch.mask | mask : mask;
+      return it->second;
+    }
+
+    int wd = next_wd_++;
+    wds_[key] = wd;
+    watches_[wd] = Watch{std::move(key), mask};
+    return wd;
+  }
+
+  void RemoveWatch(int wd) override {
+    auto it = watches_.find(wd);
+    if (it == watches_.end()) {
+      LOG_ERROR << "no such watch, wd=" << wd;
+      return;
+    }
+    wds_.erase(it->second.key);
+    watches_.erase(it);
+  }
+
+protected:
+  void ParseEvents(const char *buf, size_t nread,
+                   std::vector<FileEvent> &events) override {
+    const auto *meta = reinterpret_cast<const fanotify_event_metadata *>(buf);
+    for (auto len = static_cast<ssize_t>(nread); FAN_EVENT_OK(meta, len);
+         meta = FAN_EVENT_NEXT(meta, len)) {
+      if (meta->vers != FANOTIFY_METADATA_VERSION) {
+        LOG_ERROR << "fanotify version mismatch, vers=" << meta->vers;
+        return;
+      }
+      if (meta->fd >= 0) {
+        ::close(meta->fd);
+      }
+      if (meta->mask & FAN_Q_OVERFLOW) {
+        events.push_back(FileEvent{-1, IN_Q_OVERFLOW, std::string_view{}});
+        continue;
+      }
+      ParseEvent(meta, events);
+    }
+  }
+
+private:
+  static std::string MakeHandleKey(const std::string &fsid,
+                                   const file_handle &handle) {
+    std::string key = fsid;
+    key.append(reinterpret_cast<const char *>(&handle.handle_type),
+               sizeof(handle.handle_type));
+    key.append(reinterpret_cast<const char *>(handle.f_handle),
+               handle.handle_bytes);
+    return key;
+  }
+
+  static std::string GetHandleKey(const fspath &dir, const std::string &fsid) {
+    alignas(file_handle) char buf[sizeof(file_handle) + MAX_HANDLE_SZ];
+    auto *handle = reinterpret_cast<file_handle *>(buf);
+    handle->handle_bytes = MAX_HANDLE_SZ;
+    int mount_id;
+    if (name_to_handle_at(AT_FDCWD, dir.c_str(), handle, &mount_id, 0) != 0) {
+      THROW_AT_FILE_LINE("name_to_handle_at error: %s, path=%s",
+                         strerror(errno), dir.c_str());
+    }
+    return MakeHandleKey(fsid, *handle);
+  }
+
+  static uint32_t ToInotifyMask(uint64_t mask) {
+    static const std::pair<uint64_t, uint32_t> kMasks[] = {
+        {FAN_CREATE, IN_CREATE},
+        {FAN_DELETE, IN_DELETE},
+        {FAN_CLOSE_WRITE, IN_CLOSE_WRITE},
+        {FAN_MOVED_FROM, IN_MOVED_FROM},
+        {FAN_MOVED_TO, IN_MOVED_TO},
+        {FAN_DELETE_SELF, IN_DELETE_SELF},
+        {FAN_MOVE_SELF, IN_MOVE_SELF},
+        {FAN_ONDIR, IN_ISDIR},
+    };
+    uint32_t in_mask = 0;
+    for (const auto &kvp : kMasks) {
+      if (mask & kvp.first) {
+        in_mask |= kvp.second;
+      }
+    }
+    return in_mask;
+  }
+
+  void ParseEvent(const fanotify_event_metadata *meta,
+                  std::vector<FileEvent> &events) {
+    const char *info =
+        reinterpret_cast<const char *>(meta) + meta->metadata_len;
+    const char *end = reinterpret_cast<const char *>(meta) + meta->event_len;
+    while (info + sizeof(fanotify_event_info_header) <= end) {
+      const auto *hdr =
+          reinterpret_cast<const fanotify_event_info_header *>(info);
+      if (hdr->len == 0) {
+        break;
+      }
+      info += hdr->len;
+      if (hdr->info_type != FAN_EVENT_INFO_TYPE_DFID_NAME &&
+          hdr->info_type != FAN_EVENT_INFO_TYPE_DFID) {
+        continue;
+      }
+
+      const auto *fid = reinterpret_cast<const fanotify_event_info_fid *>(hdr);
+      const auto *handle = reinterpret_cast<const file_handle *>(fid->handle);
+      std::string_view name;
+      if (hdr->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+        name = reinterpret_cast<const char *>(handle->f_handle) +
+               handle->handle_bytes;
+      }
+
+      std::string fsid{reinterpret_cast<const char *>(&fid->fsid),
+                       sizeof(fid->fsid)};
+      key_ = MakeHandleKey(fsid, *handle);
+      uint32_t mask = ToInotifyMask(meta->mask);
+      if (name.empty() || name == ".") {
+        // An event of a watched directory itself.
+        Emit(key_, mask, std::string_view{}, events);
+        continue;
+      }
+
+      // A watched file is known by its name in the directory.
+      size_t dir_key_size = key_.size();
+      key_.push_back('/');
+      key_ += name;
+      // As inotify, a create isn't reported to the watch of the name, and
+      // the file replaced by a rename is deleted.
+      uint32_t self_mask = mask & (IN_MODIFY | IN_CLOSE_WRITE);
+      if (mask & (IN_DELETE | IN_MOVED_TO)) {
+        self_mask |= IN_DELETE_SELF;
+      }
+      if (mask & IN_MOVED_FROM) {
+        self_mask |= IN_MOVE_SELF;
+      }
+      Emit(key_, self_mask, std::string_view{}, events);
+
+      key_.resize(dir_key_size);
+      Emit(key_, mask, name, events);
+    }
+  }
+
+  void Emit(const std::string &key, uint32_t mask, std::string_view name,
+            std::vector<FileEvent> &events) const {
+    auto it = wds_.find(key);
+    if (it == wds_.end()) {
+      return;
+    }
+    const auto &watch = watches_.at(it->second);
+    uint32_t watched_mask = mask & (watch.mask | IN_ISDIR);
+    if ((watched_mask & ~IN_ISDIR) != 0) {
+      events.push_back(FileEvent{it->second, watched_mask, name});
+    }
+  }
+
+private:
+  std::string key_;  // reused for the lookups
+  std::unordered_set<std::string> marked_fsids_;
+  std::unordered_map<std::string, int> wds_;
+  std::unordered_map<int, Watch> watches_;
+  int next_wd_ = 1;
+};
+
+}  // namespace
+
+FileWatcherPtr FileWatcher::Create(FileWatcherBackend backend,
+                                   const FsPathVec &roots) {
+  if (backend == FileWatcherBackend::kFanotify) {
+    int fd = fanotify_init(
+        FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK,
+        O_RDONLY | O_LARGEFILE);
+    if (fd >= 0) {
+      std::unique_ptr<FanotifyWatcher> watcher{new FanotifyWatcher{fd}};
+      try {
+        for (const auto &root : roots) {
+          watcher->MarkFilesystem(root, FanotifyWatcher::GetFsid(root));
+        }
+        return watcher;
+      } catch (const std::exception &e) {
+        LOG_WARN << "exception=" << e.what() << ", fall back to inotify";
+      }
+    } else {
+      LOG_WARN << "fanotify_init error: " << strerror(errno)
+               << ", fall back to inotify";
+    }
+  }
+
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    THROW_AT_FILE_LINE("inotify_init1 error: %s", strerror(errno));
+  }
+  return FileWatcherPtr{new InotifyWatcher{fd}};
+}
+
+FileWatcher::~FileWatcher() { ::close(fd_); }
+
+void FileWatcher::ReadEvents(
+    const std::function<void(const std::vector<FileEvent> &)> &on_events) {
+  // Unlike inotify, FIONREAD of fanotify tells only the size of the first
+  // event, so read until it's drained.
+  for (size_t i = 0; i < kMaxReads; ++i) {
+    ssize_t nread = ::read(fd_, buffer_, sizeof(buffer_));
+    if (nread < 0 && errno == EINTR) {
+      continue;
+    } else if (nread < 0) {
+      if (errno != EAGAIN) {
+        LOG_ERROR << name() << " read error: " << strerror(errno);
+      }
+      return;
+    } else if (nread == 0) {
+      return;
+    }
+
+    events_.clear();
+    ParseEvents(buffer_, static_cast<size_t>(nread), events_);
+    if (!events_.empty()) {
+      on_events(events_);
+    }
+  }
+}
+
+}  // namespace symdb
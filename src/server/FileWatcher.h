@@ -0,0 +1,75 @@
+#pragma once
+
+#include <sys/inotify.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "Config.h"
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+// A change of a watched path. The mask is of IN_* whatever the backend is.
+struct FileEvent {
+  int wd;
+  uint32_t mask;
+  // The entry of a watched directory, or empty for the watched path itself.
+  std::string_view name;
+};
+
+// Reports the changes of the watched directories and files, and fd() is
+// readable when there're any. A watch is referred by a wd like inotify(7),
+// and a path watched again gets the same wd with the new mask, or the
+// union of both with IN_MASK_ADD.
+//
+// The events are read into a fixed buffer, which is reused. An event of
+// wd -1 with IN_Q_OVERFLOW tells that some are lost, and IN_IGNORED that
+// the kernel has removed a watch, e.g. its path is deleted.
+class FileWatcher {
+public:
+  // A fanotify one can't be used without CAP_SYS_ADMIN, or if the
+  // filesystem of any of roots can't be marked, and an inotify one is
+  // returned instead. Throw if neither can be created.
+  static std::unique_ptr<FileWatcher> Create(FileWatcherBackend backend,
+                                             const FsPathVec &roots);
+
+  virtual ~FileWatcher();
+
+  int fd() const { return fd_; }
+
+  virtual const char *name() const = 0;
+
+  // Throw if path can't be watched.
+  virtual int AddWatch(const fspath &path, uint32_t mask) = 0;
+  virtual void RemoveWatch(int wd) = 0;
+
+  // Call on_events for the events of each read, whose names are valid only
+  // during the call. It never blocks, and returns after a bounded number of
+  // reads, so a flood of events can't starve the others, while fd() stays
+  // readable for the rest.
+  void ReadEvents(
+      const std::function<void(const std::vector<FileEvent> &)> &on_events);
+
+protected:
+  explicit FileWatcher(int fd) : fd_{fd} {}
+
+  // Append the events of the nread bytes in buf to events.
+  virtual void ParseEvents(const char *buf, size_t nread,
+                           std::vector<FileEvent> &events) = 0;
+
+  int fd_;
+
+private:
+  static constexpr size_t kReadBufferSize = 64 << 10;
+  static constexpr size_t kMaxReads = 16;
+
+  // Far more than an inotify event with the longest name, which must fit.
+  alignas(8) char buffer_[kReadBufferSize];
+  std::vector<FileEvent> events_;
+};
+
+using FileWatcherPtr = std::unique_ptr<FileWatcher>;
+
+}  // namespace symdb
@@ -0,0 +1,204 @@
+#include "FlatRecord.h"
+#include <cassert>
+
+namespace symdb {
+namespace flat {
+
+namespace {
+
+const size_t kHeaderSize = 1 + 4;
+
+uint32_t DecodeFixed32(const char *ptr) {
+  auto p = reinterpret_cast<const uint8_t *>(ptr);
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void EncodeFixed32(char *ptr, uint32_t value) {
+  ptr[0] = static_cast<char>(value & 0xff);
+  ptr[1] = static_cast<char>((value >> 8) & 0xff);
+  ptr[2] = static_cast<char>((value >> 16) & 0xff);
+  ptr[3] = static_cast<char>((value >> 24) & 0xff);
+}
+
+void AppendVarint(std::string &dest, uint32_t value) {
+  while (value >= 0x80) {
+    dest.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  dest.push_back(static_cast<char>(value));
+}
+
+}  // namespace
+
+bool Cursor::ReadVarint(uint32_t &value) {
+  value = 0;
+  for (int shift = 0; shift <= 28 && pos_ < end_; shift += 7) {
+    uint32_t byte = static_cast<uint8_t>(*pos_++);
+    value |= (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Cursor::ReadBytes(leveldb::Slice &bytes) {
+  uint32_t size = 0;
+  if (!ReadVarint(size) || size > static_cast<size_t>(end_ - pos_)) {
+    return false;
+  }
+  bytes = leveldb::Slice{pos_, size};
+  pos_ += size;
+  return true;
+}
+
+bool ReadLocationRun(Cursor &cursor, LocationRun &run) {
+  leveldb::Slice bytes;
+  if (!cursor.ReadVarint(run.size_) || !cursor.ReadBytes(bytes)) {
+    return false;
+  }
+  run.cursor_ = Cursor{bytes.data(), bytes.data() + bytes.size()};
+  run.line_ = 0;
+  run.column_ = 0;
+  return true;
+}
+
+bool LocationRun::Next(uint32_t &line, uint32_t &column) {
+  if (size_ == 0) {
+    return false;
+  }
+
+  uint32_t line_delta = 0;
+  uint32_t col = 0;
+  if (!cursor_.ReadVarint(line_delta) || !cursor_.ReadVarint(col)) {
+    size_ = 0;
+    return false;
+  }
+
+  --size_;
+  line_ += line_delta;
+  column_ = line_delta == 0 ? column_ + col : col;
+  line = line_;
+  column = column_;
+  return true;
+}
+
+bool RecordView::Init(const leveldb::Slice &value, RecordKind kind) {
+  if (value.size() < kHeaderSize ||
+      static_cast<uint8_t>(value[0]) != static_cast<uint8_t>(kind)) {
+    return false;
+  }
+
+  uint32_t size = DecodeFixed32(value.data() + 1);
+  if ((value.size() - kHeaderSize) / 4 < size) {
+    return false;
+  }
+
+  value_ = value;
+  size_ = size;
+  return true;
+}
+
+bool RecordView::GetEntry(uint32_t index, Cursor &cursor) const {
+  if (index >= size_) {
+    return false;
+  }
+
+  uint32_t offset = DecodeFixed32(value_.data() + kHeaderSize + index * 4);
+  if (offset > value_.size()) {
+    return false;
+  }
+
+  cursor = Cursor{value_.data() + offset, value_.data() + value_.size()};
+  return true;
+}
+
+bool DefinitionView::Get(uint32_t index, uint32_t &file_id, uint32_t &line,
+                         uint32_t &column) const {
+  Cursor cursor;
+  return GetEntry(index, cursor) && cursor.ReadVarint(file_id) &&
+         cursor.ReadVarint(line) && cursor.ReadVarint(column);
+}
+
+bool ModuleReferences::NextFile(uint32_t &file_id, LocationRun &run) {
+  if (file_count_ == 0) {
+    return false;
+  }
+
+  uint32_t delta = 0;
+  if (!cursor_.ReadVarint(delta) || !ReadLocationRun(cursor_, run)) {
+    file_count_ = 0;
+    return false;
+  }
+
+  --file_count_;
+  file_id_ += delta;
+  file_id = file_id_;
+  return true;
+}
+
+bool ReferenceView::Get(uint32_t index, ModuleReferences &module_refs) const {
+  Cursor cursor;
+  if (!GetEntry(index, cursor) || !cursor.ReadBytes(module_refs.module_name_) ||
+      !cursor.ReadVarint(module_refs.file_count_)) {
+    return false;
+  }
+
+  module_refs.file_id_ = 0;
+  module_refs.cursor_ = cursor;
+  return true;
+}
+
+bool FileReferenceView::Get(uint32_t index, uint32_t &symbol_id,
+                            leveldb::Slice &module_name,
+                            LocationRun &run) const {
+  Cursor cursor;
+  return GetEntry(index, cursor) && cursor.ReadVarint(symbol_id) &&
+         cursor.ReadBytes(module_name) && ReadLocationRun(cursor, run);
+}
+
+RecordBuilder::RecordBuilder(RecordKind kind, uint32_t count) : count_{count} {
+  buffer_.resize(kHeaderSize + count * 4);
+  buffer_[0] = static_cast<char>(kind);
+  EncodeFixed32(&buffer_[1], count);
+}
+
+void RecordBuilder::StartEntry() {
+  assert(next_entry_ < count_);
+  EncodeFixed32(&buffer_[kHeaderSize + next_entry_ * 4],
+                static_cast<uint32_t>(buffer_.size()));
+  ++next_entry_;
+}
+
+void RecordBuilder::PutVarint(uint32_t value) { AppendVarint(buffer_, value); }
+
+void RecordBuilder::PutBytes(const std::string &bytes) {
+  AppendVarint(buffer_, static_cast<uint32_t>(bytes.size()));
+  buffer_.append(bytes);
+}
+
+void RecordBuilder::PutLocations(const std::set<LineColumn> &locations) {
+  std::string run;
+  uint32_t line = 0;
+  uint32_t column = 0;
+  for (const auto &loc : locations) {
+    uint32_t line_delta = loc.first - line;
+    AppendVarint(run, line_delta);
+    AppendVarint(run, line_delta == 0 ? loc.second - column : loc.second);
+    line = loc.first;
+    column = loc.second;
+  }
+
+  AppendVarint(buffer_, static_cast<uint32_t>(locations.size()));
+  PutBytes(run);
+}
+
+std::string RecordBuilder::Finish() {
+  assert(next_entry_ == count_);
+  return std::move(buffer_);
+}
+
+}  // namespace flat
+}  // namespace symdb
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <leveldb/slice.h>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <utility>
+
+// The flat encoding of the index records, an alternative to the protobuf
+// messages of DBInfo.proto. A record is read in place from the value, i.e.
+// no parse and no allocation. All the records are laid out as:
+//
+//    u8   kind
+//    u32  count                  little endian, ditto
+//    u32  offsets[count]         of the entries, from the start of the record
+//    ...  entries
+//
+// The entries are made of varints. A run of sorted locations is encoded as:
+//
+//    varint count, varint nbytes, (varint line_delta, varint column) * count
+//
+// where column is a delta as well if line_delta is 0. nbytes lets a reader
+// skip the run without decoding it.
+namespace symdb {
+namespace flat {
+
+using LineColumn = std::pair<uint32_t, uint32_t>;
+
+enum class RecordKind : uint8_t {
+  // DB_SymbolDefinitionInfo, entry: file_id, line, column
+  kDefinition = 1,
+  // DB_SymbolReferenceInfo, entry: module, file count, (file_id delta, run)*
+  kReference = 2,
+  // DB_FileReferenceInfo, entry: symbol_id, module, run
+  kFileReference = 3,
+};
+
+class Cursor {
+public:
+  Cursor() = default;
+  Cursor(const char *begin, const char *end) : pos_{begin}, end_{end} {}
+
+  bool ReadVarint(uint32_t &value);
+  bool ReadBytes(leveldb::Slice &bytes);
+
+  bool empty() const { return pos_ >= end_; }
+
+private:
+  const char *pos_ = nullptr;
+  const char *end_ = nullptr;
+};
+
+class LocationRun {
+public:
+  LocationRun() = default;
+
+  uint32_t size() const { return size_; }
+
+  // Return false at the end or if the record is corrupted.
+  bool Next(uint32_t &line, uint32_t &column);
+
+private:
+  friend bool ReadLocationRun(Cursor &cursor, LocationRun &run);
+
+  Cursor cursor_;
+  uint32_t size_ = 0;
+  uint32_t line_ = 0;
+  uint32_t column_ = 0;
+};
+
+bool ReadLocationRun(Cursor &cursor, LocationRun &run);
+
+// The base of the record views. A view refers to the value it's created
+// from, which must outlive it.
+class RecordView {
+public:
+  // Return false if value is not a record of kind.
+  bool Init(const leveldb::Slice &value, RecordKind kind);
+
+  uint32_t size() const { return size_; }
+
+protected:
+  bool GetEntry(uint32_t index, Cursor &cursor) const;
+
+private:
+  leveldb::Slice value_;
+  uint32_t size_ = 0;
+};
+
+class DefinitionView : public RecordView {
+public:
+  bool Init(const leveldb::Slice &value) {
+    return RecordView::Init(value, RecordKind::kDefinition);
+  }
+
+  bool Get(uint32_t index, uint32_t &file_id, uint32_t &line,
+           uint32_t &column) const;
+};
+
+// The references of a symbol in one module.
+class ModuleReferences {
+public:
+  const leveldb::Slice &module_name() const { return module_name_; }
+
+  uint32_t file_count() const { return file_count_; }
+
+  // Return false at the end or if the record is corrupted.
+  bool NextFile(uint32_t &file_id, LocationRun &run);
+
+private:
+  friend class ReferenceView;
+
+  leveldb::Slice module_name_;
+  uint32_t file_count_ = 0;
+  uint32_t file_id_ = 0;
+  Cursor cursor_;
+};
+
+class ReferenceView : public RecordView {
+public:
+  bool Init(const leveldb::Slice &value) {
+    return RecordView::Init(value, RecordKind::kReference);
+  }
+
+  bool Get(uint32_t index, ModuleReferences &module_refs) const;
+};
+
+class FileReferenceView : public RecordView {
+public:
+  bool Init(const leveldb::Slice &value) {
+    return RecordView::Init(value, RecordKind::kFileReference);
+  }
+
+  bool Get(uint32_t index, uint32_t &symbol_id, leveldb::Slice &module_name,
+           LocationRun &run) const;
+};
+
+// Since the offset table is fixed-width, the number of entries must be known
+// before any of them is added.
+class RecordBuilder {
+public:
+  RecordBuilder(RecordKind kind, uint32_t count);
+
+  void StartEntry();
+
+  void PutVarint(uint32_t value);
+  void PutBytes(const std::string &bytes);
+  void PutLocations(const std::set<LineColumn> &locations);
+
+  std::string Finish();
+
+private:
+  std::string buffer_;
+  uint32_t count_;
+  uint32_t next_entry_ = 0;
+};
+
+}  // namespace flat
+}  // namespace symdb
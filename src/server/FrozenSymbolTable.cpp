@@ -0,0 +1,300 @@
+#include "FrozenSymbolTable.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "util/Logger.h"
+
+namespace symdb {
+
+namespace {
+
+const char kMagic[8] = {'S', 'Y', 'M', 'T', 'A', 'B', '\0', '\0'};
+const uint32_t kFormatVersion = 1;
+
+// About the number of ids in a bucket if they are dense.
+const uint32_t kIdsPerBucket = 4;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+  uint32_t bucket_shift;
+  uint32_t bucket_count;
+  uint64_t file_size;
+};
+
+static_assert(sizeof(Header) == 32, "unexpected padding");
+
+size_t AlignUp(size_t n, size_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+uint32_t BitWidth(uint32_t n) {
+  uint32_t bits = 0;
+  for (; n; n >>= 1) {
+    ++bits;
+  }
+  return bits;
+}
+
+struct Layout {
+  size_t buckets_offset;
+  size_t ids_offset;
+  size_t offsets_offset;
+  size_t payload_offset;
+};
+
+Layout MakeLayout(uint32_t count, uint32_t bucket_count) {
+  Layout layout;
+  layout.buckets_offset = sizeof(Header);
+  layout.ids_offset =
+      layout.buckets_offset + (bucket_count + 1) * sizeof(uint32_t);
+  layout.offsets_offset =
+      AlignUp(layout.ids_offset + count * sizeof(uint32_t), sizeof(uint64_t));
+  layout.payload_offset =
+      layout.offsets_offset + (count + 1) * sizeof(uint64_t);
+  return layout;
+}
+
+bool SyncDir(const fspath &dir) {
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return false;
+  }
+  int ret = ::fsync(fd);
+  ::close(fd);
+  return ret == 0;
+}
+
+}  // namespace
+
+bool FrozenSymbolTable::Open(const fspath &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      Close();
+      return true;
+    }
+    LOG_ERROR << "open " << path << " failed: " << strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+    LOG_ERROR << "bad symbol table " << path;
+    ::close(fd);
+    return false;
+  }
+
+  size_t length = st.st_size;
+  void *addr = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    LOG_ERROR << "mmap " << path << " failed: " << strerror(errno);
+    return false;
+  }
+
+  const auto *header = static_cast<const Header *>(addr);
+  bool ok = memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 &&
+            header->version == kFormatVersion &&
+            header->file_size == length && header->bucket_count > 0;
+
+  Layout layout{};
+  if (ok) {
+    layout = MakeLayout(header->count, header->bucket_count);
+    ok = layout.payload_offset <= length;
+  }
+
+  const auto *base = static_cast<const char *>(addr);
+  if (ok) {
+    const auto *offsets =
+        reinterpret_cast<const uint64_t *>(base + layout.offsets_offset);
+    ok = offsets[header->count] == length - layout.payload_offset;
+  }
+
+  if (!ok) {
+    LOG_ERROR << "bad symbol table " << path;
+    ::munmap(addr, length);
+    return false;
+  }
+
+  Close();
+  addr_ = addr;
+  length_ = length;
+  count_ = header->count;
+  bucket_shift_ = header->bucket_shift;
+  bucket_count_ = header->bucket_count;
+  buckets_ = reinterpret_cast<const uint32_t *>(base + layout.buckets_offset);
+  ids_ = reinterpret_cast<const uint32_t *>(base + layout.ids_offset);
+  offsets_ = reinterpret_cast<const uint64_t *>(base + layout.offsets_offset);
+  payload_ = base + layout.payload_offset;
+  payload_size_ = length - layout.payload_offset;
+
+  // The lookups are random.
+  (void)::madvise(addr_, length_, MADV_RANDOM);
+
+  LOG_INFO << "symbol table " << path << " symbols=" << count_
+           << " size=" << length_;
+  return true;
+}
+
+void FrozenSymbolTable::Close() {
+  if (addr_) {
+    ::munmap(addr_, length_);
+  }
+
+  addr_ = nullptr;
+  length_ = 0;
+  count_ = 0;
+  bucket_shift_ = 0;
+  bucket_count_ = 0;
+  buckets_ = nullptr;
+  ids_ = nullptr;
+  offsets_ = nullptr;
+  payload_ = nullptr;
+  payload_size_ = 0;
+}
+
+bool FrozenSymbolTable::Lookup(uint32_t id, uint32_t &index) const {
+  if (count_ == 0) {
+    return false;
+  }
+
+  uint32_t bucket = id >> bucket_shift_;
+  if (bucket >= bucket_count_) {
+    return false;
+  }
+
+  uint32_t begin = buckets_[bucket];
+  uint32_t end = std::min(buckets_[bucket + 1], count_);
+  if (begin >= end) {
+    return false;
+  }
+
+  const uint32_t *it = std::lower_bound(ids_ + begin, ids_ + end, id);
+  if (it == ids_ + end || *it != id) {
+    return false;
+  }
+
+  index = it - ids_;
+  return true;
+}
+
+bool FrozenSymbolTable::Contains(uint32_t id) const {
+  uint32_t index = 0;
+  return Lookup(id, index);
+}
+
+bool FrozenSymbolTable::Find(uint32_t id, leveldb::Slice &value) const {
+  uint32_t index = 0;
+  if (!Lookup(id, index)) {
+    return false;
+  }
+
+  value = Get(index).second;
+  return true;
+}
+
+FrozenSymbolTable::Entry FrozenSymbolTable::Get(uint32_t index) const {
+  uint64_t begin = offsets_[index];
+  uint64_t end = offsets_[index + 1];
+  if (begin > end || end > payload_size_) {
+    LOG_ERROR << "bad offsets of symbol " << ids_[index];
+    return Entry{ids_[index], leveldb::Slice{}};
+  }
+
+  return Entry{ids_[index], leveldb::Slice{payload_ + begin, end - begin}};
+}
+
+bool FrozenSymbolTable::Write(const fspath &path,
+                              const std::vector<Entry> &entries) {
+  uint32_t count = entries.size();
+  uint32_t max_id = entries.empty() ? 0 : entries.back().first;
+
+  uint32_t bucket_bits = BitWidth(count / kIdsPerBucket);
+  uint32_t id_bits = BitWidth(max_id);
+  uint32_t bucket_shift = id_bits > bucket_bits ? id_bits - bucket_bits : 0;
+  uint32_t bucket_count = (max_id >> bucket_shift) + 1;
+
+  std::vector<uint32_t> buckets(bucket_count + 1, count);
+  std::vector<uint32_t> ids;
+  std::vector<uint64_t> offsets;
+  ids.reserve(count);
+  offsets.reserve(count + 1);
+
+  uint64_t payload_size = 0;
+  uint32_t next_bucket = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t bucket = entries[i].first >> bucket_shift;
+    for (; next_bucket <= bucket; ++next_bucket) {
+      buckets[next_bucket] = i;
+    }
+    ids.push_back(entries[i].first);
+    offsets.push_back(payload_size);
+    payload_size += entries[i].second.size();
+  }
+  offsets.push_back(payload_size);
+
+  Layout layout = MakeLayout(count, bucket_count);
+
+  Header header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kFormatVersion;
+  header.count = count;
+  header.bucket_shift = bucket_shift;
+  header.bucket_count = bucket_count;
+  header.file_size = layout.payload_offset + payload_size;
+
+  fspath tmp_path = path;
+  tmp_path += ".tmp";
+
+  FILE *fp = fopen(tmp_path.c_str(), "wb");
+  if (!fp) {
+    LOG_ERROR << "open " << tmp_path << " failed: " << strerror(errno);
+    return false;
+  }
+
+  static const char kPadding[sizeof(uint64_t)] = {};
+  size_t padding =
+      layout.offsets_offset - layout.ids_offset - count * sizeof(uint32_t);
+
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(buckets.data(), sizeof(uint32_t), buckets.size(), fp) ==
+                buckets.size() &&
+            fwrite(ids.data(), sizeof(uint32_t), ids.size(), fp) ==
+                ids.size() &&
+            fwrite(kPadding, 1, padding, fp) == padding &&
+            fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), fp) ==
+                offsets.size();
+  for (size_t i = 0; ok && i < entries.size(); ++i) {
+    const auto &value = entries[i].second;
+    ok = fwrite(value.data(), 1, value.size(), fp) == value.size();
+  }
+
+  ok = ok && fflush(fp) == 0 && ::fsync(fileno(fp)) == 0;
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok) {
+    LOG_ERROR << "write " << tmp_path << " failed: " << strerror(errno);
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+
+  if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG_ERROR << "rename " << tmp_path << " failed: " << strerror(errno);
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+
+  if (!SyncDir(path.parent_path())) {
+    LOG_WARN << "fsync the directory of " << path << " failed";
+  }
+
+  return true;
+}
+
+}  // namespace symdb
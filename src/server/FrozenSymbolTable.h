@@ -0,0 +1,66 @@
+#pragma once
+
+#include <leveldb/slice.h>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+// A read-only table of the symbol definitions, which is memory-mapped from a
+// file. The values are the same as the ones of the symdef: keys in the
+// database. The file is laid out in the native byte order as:
+//
+//    header
+//    u32 buckets[bucket_count + 1]   index range of the ids of a bucket
+//    u32 ids[count]                  sorted
+//    u64 offsets[count + 1]          value i is payload[offsets[i], offsets[i+1])
+//    payload
+//
+// The ids are allocated sequentially, so bucketing them by the high bits
+// leaves a few ids per bucket. A lookup reads a bucket, a short range of ids
+// and an offset pair, i.e. a handful of cache lines.
+class FrozenSymbolTable {
+public:
+  using Entry = std::pair<uint32_t, leveldb::Slice>;
+
+  FrozenSymbolTable() = default;
+  FrozenSymbolTable(const FrozenSymbolTable &) = delete;
+  FrozenSymbolTable &operator=(const FrozenSymbolTable &) = delete;
+
+  ~FrozenSymbolTable() { Close(); }
+
+  // A missing file is taken as an empty table. Return false if the file is
+  // corrupted, and the current table is kept.
+  bool Open(const fspath &path);
+  void Close();
+
+  uint32_t size() const { return count_; }
+
+  bool Contains(uint32_t id) const;
+  bool Find(uint32_t id, leveldb::Slice &value) const;
+
+  // index is in [0, size()).
+  Entry Get(uint32_t index) const;
+
+  // entries must be sorted by id and unique.
+  static bool Write(const fspath &path, const std::vector<Entry> &entries);
+
+private:
+  bool Lookup(uint32_t id, uint32_t &index) const;
+
+private:
+  void *addr_ = nullptr;
+  size_t length_ = 0;
+  uint32_t count_ = 0;
+  uint32_t bucket_shift_ = 0;
+  uint32_t bucket_count_ = 0;
+  const uint32_t *buckets_ = nullptr;
+  const uint32_t *ids_ = nullptr;
+  const uint64_t *offsets_ = nullptr;
+  const char *payload_ = nullptr;
+  uint64_t payload_size_ = 0;
+};
+
+}  // namespace symdb
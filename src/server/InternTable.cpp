@@ -0,0 +1,141 @@
+#include "InternTable.h"
+#include "util/Functions.h"
+#include "util/Logger.h"
+
+namespace symdb {
+
+namespace {
+
+const char *kInternKeyDelimiter{":"};
+
+const size_t kMaxReadCacheSize = 64 << 10;
+
+bool GetValue(leveldb::DB *db, const std::string &key, std::string &value) {
+  if (db == nullptr) {
+    return false;
+  }
+
+  leveldb::Status s = db->Get(leveldb::ReadOptions{}, key, &value);
+  if (!s.ok() && !s.IsNotFound()) {
+    LOG_ERROR << "LevelDB::Get failed, key=" << key
+              << ", error=" << s.ToString();
+  }
+  return s.ok();
+}
+
+}  // namespace
+
+void InternTable::Reset(leveldb::DB *db) {
+  db_ = db;
+  str_ids_.clear();
+  id_strs_.clear();
+  read_str_ids_.clear();
+  read_id_strs_.clear();
+  pending_.clear();
+  next_id_ = kInvalidId + 1;
+
+  std::string value;
+  if (GetValue(db_, MakeNextIdKey(), value)) {
+    next_id_ = std::stoul(value);
+  }
+}
+
+InternId InternTable::Find(const std::string &str) const {
+  auto it = str_ids_.find(str);
+  if (it != str_ids_.end()) {
+    return it->second;
+  }
+  it = read_str_ids_.find(str);
+  if (it != read_str_ids_.end()) {
+    return it->second;
+  }
+
+  std::string value;
+  if (!GetValue(db_, MakeStrKey(str), value)) {
+    return kInvalidId;
+  }
+
+  InternId id = std::stoul(value);
+  CacheRead(str, id);
+  return id;
+}
+
+InternId InternTable::Intern(const std::string &str) {
+  InternId id = Find(str);
+  if (id != kInvalidId) {
+    return id;
+  }
+
+  id = next_id_++;
+  Cache(str, id);
+  pending_.emplace_back(str, id);
+  return id;
+}
+
+std::string InternTable::Lookup(InternId id) const {
+  auto it = id_strs_.find(id);
+  if (it != id_strs_.end()) {
+    return it->second;
+  }
+  it = read_id_strs_.find(id);
+  if (it != read_id_strs_.end()) {
+    return it->second;
+  }
+
+  std::string str;
+  if (!GetValue(db_, MakeIdKey(id), str)) {
+    LOG_ERROR << "unknown id, ns=" << ns_ << " id=" << id;
+    return std::string{};
+  }
+
+  CacheRead(str, id);
+  return str;
+}
+
+int InternTable::Flush(leveldb::WriteBatch &batch) {
+  if (pending_.empty()) {
+    return 0;
+  }
+
+  for (const auto &kvp : pending_) {
+    batch.Put(MakeStrKey(kvp.first), std::to_string(kvp.second));
+    batch.Put(MakeIdKey(kvp.second), kvp.first);
+    CacheRead(kvp.first, kvp.second);
+  }
+  str_ids_.clear();
+  id_strs_.clear();
+  batch.Put(MakeNextIdKey(), std::to_string(next_id_));
+
+  int count = pending_.size();
+  pending_.clear();
+  return count;
+}
+
+std::string InternTable::MakeStrKey(const std::string &str) const {
+  return symutil::str_join(kInternKeyDelimiter, ns_, "str", str);
+}
+
+std::string InternTable::MakeIdKey(InternId id) const {
+  return symutil::str_join(kInternKeyDelimiter, ns_, "id", id);
+}
+
+std::string InternTable::MakeNextIdKey() const {
+  return symutil::str_join(kInternKeyDelimiter, ns_, "next_id");
+}
+
+void InternTable::Cache(const std::string &str, InternId id) {
+  str_ids_[str] = id;
+  id_strs_[id] = str;
+}
+
+void InternTable::CacheRead(const std::string &str, InternId id) const {
+  if (read_str_ids_.size() >= kMaxReadCacheSize ||
+      read_id_strs_.size() >= kMaxReadCacheSize) {
+    read_str_ids_.clear();
+    read_id_strs_.clear();
+  }
+  read_str_ids_[str] = id;
+  read_id_strs_[id] = str;
+}
+
+}  // namespace symdb
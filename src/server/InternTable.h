@@ -0,0 +1,69 @@
+#pragma once
+
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace symdb {
+
+using InternId = uint32_t;
+
+// Maps the long strings which are repeated all over the database, e.g. the
+// USRs, to compact integer ids. Both directions are persisted in the
+// project database:
+//    <ns>:str:<string> -> id
+//    <ns>:id:<id>      -> string
+// The ids are allocated from 1, so 0 is never a valid one.
+//
+// The strings interned but not flushed yet are kept in memory, since they
+// aren't in the database. The flushed ones and those read from the database
+// are cached up to a bound, so memory doesn't grow with every string.
+class InternTable {
+public:
+  static constexpr InternId kInvalidId = 0;
+
+  explicit InternTable(const std::string &ns) : ns_{ns} {}
+
+  // Forget everything cached and bind to another database.
+  void Reset(leveldb::DB *db);
+
+  // Return kInvalidId if str has never been interned.
+  InternId Find(const std::string &str) const;
+
+  // Allocate a new id if it's not interned yet. The new entries are kept in
+  // memory until Flush() is called.
+  InternId Intern(const std::string &str);
+
+  // Return an empty string if id is unknown.
+  std::string Lookup(InternId id) const;
+
+  // Move the entries which are not persisted yet to batch, and to the bounded
+  // cache. Return the number of the entries.
+  int Flush(leveldb::WriteBatch &batch);
+
+private:
+  std::string MakeStrKey(const std::string &str) const;
+  std::string MakeIdKey(InternId id) const;
+  std::string MakeNextIdKey() const;
+
+  void Cache(const std::string &str, InternId id);
+  void CacheRead(const std::string &str, InternId id) const;
+
+private:
+  std::string ns_;
+  leveldb::DB *db_ = nullptr;
+  InternId next_id_ = kInvalidId + 1;
+  // The pending ones only.
+  std::unordered_map<std::string, InternId> str_ids_;
+  std::unordered_map<InternId, std::string> id_strs_;
+  // Dropped as a whole once it's full.
+  mutable std::unordered_map<std::string, InternId> read_str_ids_;
+  mutable std::unordered_map<InternId, std::string> read_id_strs_;
+  std::vector<std::pair<std::string, InternId>> pending_;
+};
+
+}  // namespace symdb
@@ -0,0 +1,195 @@
+#include "JsonReader.h"
+#include <algorithm>
+#include <cstring>
+#include "util/Exceptions.h"
+
+namespace symdb {
+
+namespace {
+
+void AppendUtf8(std::string &value, uint32_t code) {
+  if (code < 0x80) {
+    value.push_back(static_cast<char>(code));
+  } else if (code < 0x800) {
+    value.push_back(static_cast<char>(0xc0 | (code >> 6)));
+    value.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+  } else if (code < 0x10000) {
+    value.push_back(static_cast<char>(0xe0 | (code >> 12)));
+    value.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+    value.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+  } else {
+    value.push_back(static_cast<char>(0xf0 | (code >> 18)));
+    value.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3f)));
+    value.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+    value.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+  }
+}
+
+}  // namespace
+
+void JsonReader::SkipSpaces() {
+  while (p_ < end_ &&
+         (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+    ++p_;
+  }
+}
+
+bool JsonReader::Consume(char c) {
+  SkipSpaces();
+  if (p_ < end_ && *p_ == c) {
+    ++p_;
+    return true;
+  }
+  return false;
+}
+
+void JsonReader::Expect(char c) {
+  if (!Consume(c)) {
+    const char what[] = {'e', 'x', 'p', 'e', 'c', 't', ' ', c, '\0'};
+    Fail(what);
+  }
+}
+
+char JsonReader::Peek() {
+  SkipSpaces();
+  if (p_ >= end_) {
+    Fail("unexpected end");
+  }
+  return *p_;
+}
+
+void JsonReader::ReadString(std::string &value) {
+  Expect('"');
+  value.clear();
+  for (;;) {
+    const char *run = p_;
+    while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+      ++p_;
+    }
+    value.append(run, p_);
+    if (p_ >= end_) {
+      Fail("unterminated string");
+    }
+    if (*p_++ == '"') {
+      return;
+    }
+    ReadEscape(value);
+  }
+}
+
+int64_t JsonReader::ReadInt() {
+  SkipSpaces();
+  bool is_negative = Consume('-');
+  if (p_ >= end_ || *p_ < '0' || *p_ > '9') {
+    Fail("expect an integer");
+  }
+
+  int64_t value = 0;
+  while (p_ < end_ && *p_ >= '0' && *p_ <= '9') {
+    value = value * 10 + (*p_++ - '0');
+  }
+  return is_negative ? -value : value;
+}
+
+void JsonReader::SkipString() {
+  Expect('"');
+  for (;;) {
+    p_ = std::find_if(p_, end_, [](char c) { return c == '"' || c == '\\'; });
+    if (p_ >= end_) {
+      Fail("unterminated string");
+    }
+    if (*p_++ == '"') {
+      return;
+    }
+    ++p_;  // the escaped one
+  }
+}
+
+void JsonReader::SkipValue() {
+  switch (Peek()) {
+    case '"':
+      SkipString();
+      return;
+
+    case '{':
+    case '[': {
+      // Only the strings may have the brackets.
+      int depth = 0;
+      do {
+        char c = Peek();
+        if (c == '"') {
+          SkipString();
+          continue;
+        }
+        if (c == '{' || c == '[') {
+          ++depth;
+        } else if (c == '}' || c == ']') {
+          --depth;
+        }
+        ++p_;
+      } while (depth > 0);
+      return;
+    }
+
+    default:
+      // true, false, null or a number
+      while (p_ < end_ && !strchr(",}] \n\r\t", *p_)) {
+        ++p_;
+      }
+      return;
+  }
+}
+
+void JsonReader::Fail(const char *what) {
+  THROW_AT_FILE_LINE("bad json at offset %zu: %s",
+                     static_cast<size_t>(p_ - begin_), what);
+}
+
+void JsonReader::ReadEscape(std::string &value) {
+  if (p_ >= end_) {
+    Fail("unterminated escape");
+  }
+  char c = *p_++;
+  switch (c) {
+    case 'b': value.push_back('\b'); return;
+    case 'f': value.push_back('\f'); return;
+    case 'n': value.push_back('\n'); return;
+    case 'r': value.push_back('\r'); return;
+    case 't': value.push_back('\t'); return;
+    case 'u': break;
+    default: value.push_back(c); return;
+  }
+
+  uint32_t code = ReadHex4();
+  // A surrogate pair
+  if (code >= 0xd800 && code < 0xdc00 && end_ - p_ >= 6 && p_[0] == '\\' &&
+      p_[1] == 'u') {
+    p_ += 2;
+    uint32_t low = ReadHex4();
+    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+  }
+  AppendUtf8(value, code);
+}
+
+uint32_t JsonReader::ReadHex4() {
+  if (end_ - p_ < 4) {
+    Fail("bad \\u escape");
+  }
+  uint32_t code = 0;
+  for (int i = 0; i < 4; ++i) {
+    char c = *p_++;
+    code <<= 4;
+    if (c >= '0' && c <= '9') {
+      code |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      code |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      code |= c - 'A' + 10;
+    } else {
+      Fail("bad \\u escape");
+    }
+  }
+  return code;
+}
+
+}  // namespace symdb
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+// A pull parser of the JSON text in [begin, end), which decodes only the
+// values asked for and skips the others without allocation. It's for the
+// large files generated by the tools, e.g. compile_commands.json, so it
+// doesn't validate what's skipped.
+//
+// All the Read*() throw if the text is malformed or ends unexpectedly.
+class JsonReader {
+public:
+  JsonReader(const char *begin, const char *end)
+      : JsonReader{begin, begin, end} {}
+
+  // p is where to start, begin is only for the offsets of the errors.
+  JsonReader(const char *begin, const char *p, const char *end)
+      : begin_{begin}, p_{p}, end_{end} {}
+
+  const char *pos() const { return p_; }
+
+  void SkipSpaces();
+
+  // Skip the spaces, and consume c if it's the next one.
+  bool Consume(char c);
+  void Expect(char c);
+
+  // Return the next character after the spaces without consuming it.
+  char Peek();
+
+  void ReadString(std::string &value);
+  int64_t ReadInt();
+  void SkipValue();
+
+  // Call fn(key) for each member, which must read or skip the value.
+  template <typename Fn>
+  void ReadObject(Fn &&fn) {
+    std::string key;
+    Expect('{');
+    if (Consume('}')) {
+      return;
+    }
+    do {
+      ReadString(key);
+      Expect(':');
+      fn(key);
+    } while (Consume(','));
+    Expect('}');
+  }
+
+  // Call fn() for each element, which must read or skip it.
+  template <typename Fn>
+  void ReadArray(Fn &&fn) {
+    Expect('[');
+    if (Consume(']')) {
+      return;
+    }
+    do {
+      fn();
+    } while (Consume(','));
+    Expect(']');
+  }
+
+  [[noreturn]] void Fail(const char *what);
+
+private:
+  void SkipString();
+  void ReadEscape(std::string &value);
+  uint32_t ReadHex4();
+
+private:
+  const char *begin_;
+  const char *p_;
+  const char *end_;
+};
+
+}  // namespace symdb
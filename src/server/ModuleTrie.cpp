@@ -0,0 +1,164 @@
+#include "ModuleTrie.h"
+
+namespace symdb {
+
+namespace {
+
+const std::string kEmptyName;
+
+// Like "." and "" which don't move to another directory.
+bool IsNoopComponent(const std::string &component) {
+  return component.empty() || component == ".";
+}
+
+}  // namespace
+
+void ModuleTrie::Clear() {
+  root_.module = kNoModule;
+  root_.children.clear();
+  component_ids_.clear();
+  module_ids_.clear();
+  module_names_.assign(1, kEmptyName);
+}
+
+void ModuleTrie::Insert(const fspath &relative_dir,
+                        const std::string &module_name) {
+  Node *node = &root_;
+  for (const auto &elem : relative_dir) {
+    auto component = elem.string();
+    if (IsNoopComponent(component)) {
+      continue;
+    }
+    if (component == "..") {
+      return;
+    }
+    auto &child = node->children[InternComponent(component)];
+    if (!child) {
+      child.reset(new Node);
+    }
+    node = child.get();
+  }
+  node->module = InternModule(module_name);
+}
+
+const std::string &ModuleTrie::Find(const fspath &relative_path) const {
+  auto node = Walk(relative_path, false);
+  return node ? module_names_[node->module] : kEmptyName;
+}
+
+const std::string &ModuleTrie::FindExact(const fspath &relative_dir) const {
+  auto node = Walk(relative_dir, true);
+  return node ? module_names_[node->module] : kEmptyName;
+}
+
+void ModuleTrie::Remove(const fspath &relative_dir) {
+  Node *parent = nullptr;
+  ComponentId last = 0;
+
+  Node *node = &root_;
+  for (const auto &elem : relative_dir) {
+    auto component = elem.string();
+    if (IsNoopComponent(component)) {
+      continue;
+    }
+    auto id = FindComponent(component);
+    auto it = node->children.find(id);
+    if (it == node->children.end()) {
+      return;
+    }
+    parent = node;
+    last = id;
+    node = it->second.get();
+  }
+
+  if (parent) {
+    parent->children.erase(last);
+  } else {
+    root_.module = kNoModule;
+    root_.children.clear();
+  }
+}
+
+void ModuleTrie::RemoveModule(const std::string &module_name) {
+  auto it = module_ids_.find(module_name);
+  if (it != module_ids_.end()) {
+    RemoveModule(root_, it->second);
+  }
+}
+
+bool ModuleTrie::RemoveModule(Node &node, ModuleId module) {
+  for (auto it = node.children.begin(); it != node.children.end();) {
+    if (RemoveModule(*it->second, module)) {
+      it = node.children.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  if (node.module == module) {
+    node.module = kNoModule;
+  }
+  return node.module == kNoModule && node.children.empty();
+}
+
+const ModuleTrie::Node *ModuleTrie::Walk(const fspath &relative_path,
+                                         bool exact) const {
+  const Node *node = &root_;
+  const Node *deepest = node->module != kNoModule ? node : nullptr;
+
+  for (const auto &elem : relative_path) {
+    auto component = elem.string();
+    if (IsNoopComponent(component)) {
+      continue;
+    }
+    if (component == "..") {
+      return nullptr;
+    }
+
+    auto it = node->children.find(FindComponent(component));
+    if (it == node->children.end()) {
+      return exact ? nullptr : deepest;
+    }
+
+    node = it->second.get();
+    if (node->module != kNoModule) {
+      deepest = node;
+    }
+  }
+
+  if (exact) {
+    return node->module != kNoModule ? node : nullptr;
+  }
+  return deepest;
+}
+
+ModuleTrie::ComponentId ModuleTrie::FindComponent(
+    const std::string &component) const {
+  auto it = component_ids_.find(component);
+  // The ids are allocated from 1, so 0 never matches any child.
+  return it != component_ids_.end() ? it->second : 0;
+}
+
+ModuleTrie::ComponentId ModuleTrie::InternComponent(
+    const std::string &component) {
+  auto it = component_ids_.find(component);
+  if (it != component_ids_.end()) {
+    return it->second;
+  }
+  ComponentId id = component_ids_.size() + 1;
+  component_ids_.emplace(component, id);
+  return id;
+}
+
+ModuleTrie::ModuleId ModuleTrie::InternModule(const std::string &module_name) {
+  auto it = module_ids_.find(module_name);
+  if (it != module_ids_.end()) {
+    return it->second;
+  }
+  ModuleId id = module_names_.size();
+  module_names_.push_back(module_name);
+  module_ids_.emplace(module_name, id);
+  return id;
+}
+
+}  // namespace symdb
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+// Maps the directories of a project to the modules they belong to. The
+// directories are stored as a trie of interned path components, relative to
+// the project home. A path belongs to the module of its deepest ancestor
+// directory (the path itself included) which is registered.
+//
+// All the operations are lexical, i.e. no syscall. Not thread-safe.
+class ModuleTrie {
+  using ComponentId = uint32_t;
+  using ModuleId = uint32_t;
+
+  static constexpr ModuleId kNoModule = 0;
+
+  struct Node {
+    ModuleId module = kNoModule;
+    std::map<ComponentId, std::unique_ptr<Node>> children;
+  };
+
+public:
+  ModuleTrie() { Clear(); }
+
+  void Clear();
+
+  // relative_dir must be a lexically normal path relative to the project home.
+  void Insert(const fspath &relative_dir, const std::string &module_name);
+
+  // Return an empty string if relative_path isn't under any module.
+  const std::string &Find(const fspath &relative_path) const;
+
+  // Return an empty string if relative_dir itself is not registered.
+  const std::string &FindExact(const fspath &relative_dir) const;
+
+  // Remove relative_dir and all the directories under it.
+  void Remove(const fspath &relative_dir);
+
+  // Remove all the directories which belong to module_name.
+  void RemoveModule(const std::string &module_name);
+
+private:
+  const Node *Walk(const fspath &relative_path, bool exact) const;
+
+  ComponentId FindComponent(const std::string &component) const;
+  ComponentId InternComponent(const std::string &component);
+
+  ModuleId InternModule(const std::string &module_name);
+
+  // Return true if node has nothing left and can be pruned.
+  static bool RemoveModule(Node &node, ModuleId module);
+
+private:
+  Node root_;
+  std::unordered_map<std::string, ComponentId> component_ids_;
+  std::unordered_map<std::string, ModuleId> module_ids_;
+  std::vector<std::string> module_names_;
+};
+
+}  // namespace symdb
@@ -0,0 +1,30 @@
+#include "PathTable.h"
+#include "util/Functions.h"
+
+namespace symdb {
+
+fspath PathTable::ToRelative(const fspath &path) const {
+  return symutil::lexical_relative(path, home_);
+}
+
+fspath PathTable::ToAbsolute(const fspath &path) const {
+  return symutil::lexical_absolute(path, home_);
+}
+
+FileId PathTable::Find(const fspath &path) const {
+  return table_.Find(ToRelative(path).string());
+}
+
+FileId PathTable::Intern(const fspath &path) {
+  return table_.Intern(ToRelative(path).string());
+}
+
+fspath PathTable::AbsolutePath(FileId id) const {
+  auto rel_path = table_.Lookup(id);
+  if (rel_path.empty()) {
+    return fspath{};
+  }
+  return ToAbsolute(rel_path);
+}
+
+}  // namespace symdb
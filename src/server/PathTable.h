@@ -0,0 +1,42 @@
+#pragma once
+
+#include "InternTable.h"
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+using FileId = InternId;
+
+// The files of a project are referred by the ids of their relative paths,
+// which stay the same even if the project home changes. All the conversions
+// between the relative and absolute paths are lexical, i.e. no syscall.
+//
+// Not thread-safe except ToRelative() and ToAbsolute().
+class PathTable {
+public:
+  static constexpr FileId kInvalidId = InternTable::kInvalidId;
+
+  PathTable() : table_{"path"} {}
+
+  void Reset(leveldb::DB *db) { table_.Reset(db); }
+
+  void set_home(const fspath &home) { home_ = home; }
+
+  fspath ToRelative(const fspath &path) const;
+  fspath ToAbsolute(const fspath &path) const;
+
+  // path may be either absolute or relative.
+  FileId Find(const fspath &path) const;
+  FileId Intern(const fspath &path);
+
+  fspath RelativePath(FileId id) const { return fspath{table_.Lookup(id)}; }
+  fspath AbsolutePath(FileId id) const;
+
+  int Flush(leveldb::WriteBatch &batch) { return table_.Flush(batch); }
+
+private:
+  InternTable table_;
+  fspath home_;
+};
+
+}  // namespace symdb
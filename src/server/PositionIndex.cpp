@@ -0,0 +1,115 @@
+#include "PositionIndex.h"
+#include <algorithm>
+
+namespace symdb {
+
+namespace {
+
+const size_t kHeaderSize = 4;
+const size_t kEntrySize = 4 * 4;
+const uint32_t kDefinitionBit = 1u << 31;
+
+uint32_t DecodeFixed32(const char *ptr) {
+  auto p = reinterpret_cast<const uint8_t *>(ptr);
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void AppendFixed32(std::string &dest, uint32_t value) {
+  char buf[4];
+  buf[0] = static_cast<char>(value & 0xff);
+  buf[1] = static_cast<char>((value >> 8) & 0xff);
+  buf[2] = static_cast<char>((value >> 16) & 0xff);
+  buf[3] = static_cast<char>((value >> 24) & 0xff);
+  dest.append(buf, sizeof(buf));
+}
+
+bool IsBefore(const SymbolPosition &lhs, const SymbolPosition &rhs) {
+  return lhs.line < rhs.line ||
+         (lhs.line == rhs.line && lhs.column < rhs.column);
+}
+
+}  // namespace
+
+std::string PositionIndexBuilder::Finish() {
+  std::stable_sort(positions_.begin(), positions_.end(), IsBefore);
+  auto last = std::unique(positions_.begin(), positions_.end(),
+                          [](const SymbolPosition &lhs,
+                             const SymbolPosition &rhs) {
+                            return !IsBefore(lhs, rhs) && !IsBefore(rhs, lhs);
+                          });
+  positions_.erase(last, positions_.end());
+
+  std::string value;
+  value.reserve(kHeaderSize + positions_.size() * kEntrySize);
+  AppendFixed32(value, positions_.size());
+  for (const auto &pos : positions_) {
+    AppendFixed32(value, pos.line);
+    AppendFixed32(value, pos.column);
+    AppendFixed32(value, pos.end_column);
+    AppendFixed32(value, (pos.symbol & ~kDefinitionBit) |
+                             (pos.is_definition ? kDefinitionBit : 0));
+  }
+
+  positions_.clear();
+  return value;
+}
+
+bool PositionIndexView::Init(const leveldb::Slice &value) {
+  if (value.size() < kHeaderSize) {
+    return false;
+  }
+
+  uint32_t size = DecodeFixed32(value.data());
+  if ((value.size() - kHeaderSize) / kEntrySize < size) {
+    return false;
+  }
+
+  entries_ = value.data() + kHeaderSize;
+  size_ = size;
+  return true;
+}
+
+SymbolPosition PositionIndexView::Get(uint32_t index) const {
+  const char *entry = entries_ + index * kEntrySize;
+  uint32_t symbol = DecodeFixed32(entry + 12);
+  return SymbolPosition{DecodeFixed32(entry), DecodeFixed32(entry + 4),
+                        DecodeFixed32(entry + 8), symbol & ~kDefinitionBit,
+                        (symbol & kDefinitionBit) != 0};
+}
+
+bool PositionIndexView::Find(uint32_t line, uint32_t column,
+                             SymbolPosition &pos) const {
+  // The first one after line:column.
+  uint32_t lo = 0;
+  uint32_t hi = size_;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    const char *entry = entries_ + mid * kEntrySize;
+    uint32_t mid_line = DecodeFixed32(entry);
+    if (mid_line < line ||
+        (mid_line == line && DecodeFixed32(entry + 4) <= column)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // The occurrences don't span lines. The nearest one is checked first since
+  // it's the innermost if they nest.
+  for (uint32_t i = lo; i > 0; --i) {
+    SymbolPosition candidate = Get(i - 1);
+    if (candidate.line != line) {
+      break;
+    }
+    if (column < candidate.end_column) {
+      pos = candidate;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+}  // namespace symdb
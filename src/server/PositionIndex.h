@@ -0,0 +1,60 @@
+#pragma once
+
+#include <leveldb/slice.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace symdb {
+
+struct SymbolPosition {
+  uint32_t line;
+  uint32_t column;
+  uint32_t end_column;  // exclusive
+  uint32_t symbol;
+  bool is_definition;
+};
+
+// The occurrences of the symbols in a file, i.e. the definitions and the
+// references, sorted by position to find the symbol under a cursor. It's
+// stored in the file:sympos: key as fixed size entries, so that a lookup is a
+// binary search in place:
+//
+//    u32  count                                    little endian, ditto
+//    (u32 line, u32 column, u32 end_column, u32 symbol) * count
+//
+// The top bit of symbol tells whether it's a definition.
+class PositionIndexBuilder {
+public:
+  // If more than one occurrence starts at the same position, the first one
+  // added is kept.
+  void Add(const SymbolPosition &pos) { positions_.push_back(pos); }
+
+  bool empty() const { return positions_.empty(); }
+
+  std::string Finish();
+
+private:
+  std::vector<SymbolPosition> positions_;
+};
+
+class PositionIndexView {
+public:
+  // Return false if value is corrupted.
+  bool Init(const leveldb::Slice &value);
+
+  uint32_t size() const { return size_; }
+
+  // index is in [0, size()).
+  SymbolPosition Get(uint32_t index) const;
+
+  // Find the occurrence covering line:column. The columns are in bytes, the
+  // same as libclang.
+  bool Find(uint32_t line, uint32_t column, SymbolPosition &pos) const;
+
+private:
+  const char *entries_ = nullptr;
+  uint32_t size_ = 0;
+};
+
+}  // namespace symdb
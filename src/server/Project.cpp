@@ -6,6 +6,11 @@
 #include <ctime>
 #include <istream>
 #include "Config.h"
+#include "DirScanner.h"
+#include "FileWatcher.h"
+#include "FlatRecord.h"
+#include "PositionIndex.h"
+#include "ProvisionalIndex.h"
 #include "Server.h"
 #include "TranslationUnit.h"
 #include "proto/DBInfo.pb.h"
@@ -18,6 +23,90 @@ namespace symdb {
 
 const char *kSymdbKeyDelimiter{":"};
 const std::string kSymdbProjectHomeKey = "home";
+const std::string kSymdbVersionKey = "version";
+// The md5 of the inputs of the last loaded compilation database. It keeps
+// the old name, from when only cmake was supported, so that the existing
+// databases stay compatible.
+const std::string kSymdbCompileDbHashKey = "cmake_inputs_hash";
+// Version 2 refers to the symbols by the ids of InternTable.
+// Version 3 refers to the files by the ids of PathTable.
+// Version 4 stores the qualified names of the defined symbols.
+// Version 5 stores the symbol positions of the files.
+// Version 6 stores the call graph.
+// Version 7 stores the edges of all the kinds, see EdgeKind.
+// Version 8 stores where the edges are found, and the includes.
+// Version 9 stores the metadata of the defined symbols.
+// Version 10 stores the macros and their expansions.
+const std::string kSymdbVersion = "10";
+// The encoding of the index records. The databases created before it is
+// introduced have no such key and use protobuf.
+const std::string kSymdbFormatKey = "format";
+const std::string kSymdbFormatProtobuf = "protobuf";
+const std::string kSymdbFormatFlat = "flat";
+// Under the directory of the database.
+const char *kFrozenSymbolTableFile = "symdef.tab";
+// The files read by a worker task for the text index and the provisional
+// definitions
+const size_t kLexicalScanBatchSize = 64;
+// The directions of the edge keys
+const char *kEdgeOut = "out";
+const char *kEdgeIn = "in";
+// Freeze when the symdef: keys are more than both of them.
+const size_t kMinSymdefDeltaToFreeze = 4096;
+const size_t kSymdefDeltaRatioToFreeze = 8;  // 1/8 of the frozen table
+
+namespace {
+
+// LevelDB copies a value out even if it's read in place. The values are
+// copied into the recycled buffers of the thread instead, so that a lookup
+// allocates nothing once the buffers are warm.
+class ValueBuffer {
+public:
+  ValueBuffer() {
+    auto &pool = Pool();
+    if (!pool.empty()) {
+      buffer_.swap(pool.back());
+      pool.pop_back();
+    }
+  }
+
+  ~ValueBuffer() {
+    // Don't hold the memory of an unusually large value.
+    if (buffer_.capacity() <= kMaxCachedCapacity) {
+      buffer_.clear();
+      Pool().push_back(std::move(buffer_));
+    }
+  }
+
+  std::string &get() { return buffer_; }
+
+private:
+  static constexpr size_t kMaxCachedCapacity = 1 << 20;
+
+  static std::vector<std::string> &Pool() {
+    thread_local std::vector<std::string> pool;
+    return pool;
+  }
+
+  std::string buffer_;
+};
+
+struct EdgeKindName {
+  const char *edge;  // of the edge keys
+  const char *file;  // of the file keys
+};
+
+const EdgeKindName &GetEdgeKindName(EdgeKind kind) {
+  static const EdgeKindName kNames[] = {
+      {"call", "calls"},
+      {"derive", "derives"},
+      {"override", "overrides"},
+      {"include", "includes"},
+  };
+  return kNames[static_cast<int>(kind)];
+}
+
+}  // namespace
 
 class BatchWriter {
 public:
@@ -39,9 +128,37 @@ public:
     ++batch_count_;
   }
 
-  template <typename PBType>
-  void PutSymbol(const std::string &symbol, const PBType &pb) {
-    Put(project_->MakeSymbolDefineKey(symbol), pb.SerializeAsString());
+  void PutSymbol(SymbolId symbol, const DB_SymbolDefinitionInfo &st) {
+    // An empty protobuf value would be taken as deleted anyway.
+    if (st.locations().empty()) {
+      DeleteSymbol(symbol);
+      return;
+    }
+    changed_symdefs_.push_back(symbol);
+    Put(project_->MakeSymbolDefineKey(symbol),
+        project_->EncodeSymbolDefinitionInfo(st));
+  }
+
+  void PutSymbolName(SymbolId symbol, const std::string &qualified_name) {
+    name_changes_.push_back(SymbolNameChange{symbol, false, qualified_name});
+    Put(project_->MakeSymbolNameKey(symbol), qualified_name);
+  }
+
+  void DeleteSymbol(SymbolId symbol) {
+    name_changes_.push_back(SymbolNameChange{symbol, true, std::string{}});
+    Delete(project_->MakeSymbolNameKey(symbol));
+    Delete(project_->MakeSymbolMetadataKey(symbol));
+
+    auto key = project_->MakeSymbolDefineKey(symbol);
+    // The running freeze may add it to the frozen table.
+    if (project_->frozen_symdefs_.Contains(symbol) ||
+        project_->is_freezing_symdefs_) {
+      // Mask the frozen one.
+      changed_symdefs_.push_back(symbol);
+      Put(key, std::string{});
+    } else {
+      Delete(key);
+    }
   }
 
   template <typename PBType>
@@ -57,10 +174,9 @@ public:
 
   void WriteSrcPath() {
     DB_ProjectInfo pt;
-    pt.mutable_rel_paths()->Reserve(project_->abs_src_paths_.size());
+    pt.mutable_file_ids()->Reserve(project_->abs_src_paths_.size());
     for (const auto &abs_path : project_->abs_src_paths_) {
-      fspath rel_path = filesystem::relative(abs_path, project_->home_path());
-      pt.add_rel_paths(rel_path.string());
+      pt.add_file_ids(project_->path_table_.Intern(abs_path));
     }
     Put(project_->name_, pt);
   }
@@ -68,9 +184,15 @@ public:
   void Clear() {
     batch_.Clear();
     batch_count_ = 0;
+    changed_symdefs_.clear();
+    name_changes_.clear();
   }
 
   ~BatchWriter() {
+    // The interned strings are written even if the batch is cleared. It
+    // does no harm but keeps the ids consistent with the memory.
+    batch_count_ += project_->usr_table_.Flush(batch_);
+    batch_count_ += project_->path_table_.Flush(batch_);
     if (batch_count_) {
       leveldb::WriteOptions write_options;
       write_options.sync = false;
@@ -78,42 +200,82 @@ public:
       if (!s.ok()) {
         LOG_ERROR << "failed to write, error=" << s.ToString()
                   << " project=" << project_->name_;
+        return;
+      }
+    }
+
+    // The memory follows the database only after it's written.
+    for (SymbolId symbol : changed_symdefs_) {
+      project_->MarkSymbolDefinitionChanged(symbol);
+    }
+    for (const auto &change : name_changes_) {
+      if (change.is_deleted) {
+        project_->symbol_names_.Remove(change.symbol);
+      } else {
+        project_->symbol_names_.Add(change.symbol, change.name);
       }
     }
   }
 
 private:
+  struct SymbolNameChange {
+    SymbolId symbol;
+    bool is_deleted;
+    std::string name;
+  };
+
   Project *project_;
   leveldb::WriteBatch batch_;
   int batch_count_ = 0;
+  std::vector<SymbolId> changed_symdefs_;
+  std::vector<SymbolNameChange> name_changes_;
 };
 
-ProjectFileWatcher::ProjectFileWatcher(const fspath &abs_path)
-    : abs_path_{abs_path}, fd_{-1} {
-  int mask = (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE |
-              IN_DELETE_SELF | IN_MOVED_TO);
-  fd_ = inotify_add_watch(ServerInst.inotify_fd(), abs_path.c_str(), mask);
-  if (fd_ < 0) {
-    THROW_AT_FILE_LINE("inotify_add_watch error: %s", strerror(errno));
+void SerializeSymbolReferenceInfo(const SymbolReferenceLocationMap &sym_locs,
+                                  DB_SymbolReferenceInfo &db_info) {
+  db_info.mutable_items()->Reserve(sym_locs.size());
+  for (const auto &kvp : sym_locs) {
+    auto *item = db_info.add_items();
+    item->set_module_name(kvp.first);
+    item->mutable_path_locs()->Reserve(kvp.second.size());
+    for (const auto &kvp2 : kvp.second) {
+      auto *path_loc = item->add_path_locs();
+      path_loc->set_file_id(kvp2.first);
+      path_loc->mutable_locations()->Reserve(kvp2.second.size());
+      for (const auto &loc : kvp2.second) {
+        auto *pb_loc = path_loc->add_locations();
+        pb_loc->set_line(loc.first);
+        pb_loc->set_column(loc.second);
+      }
+    }
   }
 }
 
+ProjectFileWatcher::ProjectFileWatcher(Project *project,
+                                       const fspath &abs_path)
+    : ProjectFileWatcher{project, abs_path,
+                         IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE |
+                             IN_DELETE_SELF | IN_MOVED_TO} {}
+
+ProjectFileWatcher::ProjectFileWatcher(Project *project,
+                                       const fspath &abs_path, uint32_t mask)
+    : project_{project}, abs_path_{abs_path}, fd_{-1} {
+  fd_ = ServerInst.AddWatch(project, abs_path, mask);
+}
+
 ProjectFileWatcher::~ProjectFileWatcher() {
   assert(fd_ >= 0);
-  int inotify_fd = ServerInst.inotify_fd();
-  if (inotify_fd >= 0) {
-    int ret = inotify_rm_watch(inotify_fd, fd_);
-    if (ret < 0) {
-      LOG_ERROR << "inotify_rm_watch error: " << strerror(errno);
-    }
-  }
-  ::close(fd_);
+  // fd_ is a watch descriptor of the watcher, which is never closed.
+  ServerInst.RemoveWatch(project_, fd_);
 }
 
 Project::Project(const std::string &name)
     : name_{name},
+      record_format_{RecordFormat::kProtobuf},
+      usr_table_{"usr"},
       smart_sync_timer_{ServerInst.main_io_service()},
       force_sync_timer_{ServerInst.main_io_service()},
+      compile_db_reload_timer_{ServerInst.main_io_service()},
       flag_cache_{this} {
   StartSmartSyncTimer();
   StartForceSyncTimer();
@@ -165,6 +327,8 @@ ProjectPtr Project::CreateFromConfig(std::shared_ptr<ProjectConfig> config) {
     project->InitializeLevelDB(false, false);
     if (!project->LoadProjectInfo()) {
       LOG_WARN << "rmdir " << db_path << " after loading failed";
+      project->symbol_db_.reset();
+      project->frozen_symdefs_.Close();
       filesystem::remove_all(db_path);
     }
   }
@@ -182,9 +346,43 @@ void Project::InitializeLevelDB(bool create_if_missing, bool error_if_exists) {
 
   db_path /= name_ + ".ldb";
 
+  // Close the old one first since the cache and filter are shared with it.
+  symbol_db_.reset();
+  frozen_symdefs_.Close();
+  symdef_delta_.clear();
+  ++symdef_freeze_generation_;
+  is_freezing_symdefs_ = false;
+  symdef_changed_in_freeze_.clear();
+  symbol_names_.Clear();
+
+  const LevelDBConfig &cfg =
+      config_ ? config_->leveldb_config() : ConfigInst.leveldb_config();
+
+  block_cache_.reset(leveldb::NewLRUCache(cfg.block_cache_size));
+  if (cfg.bloom_filter_bits > 0) {
+    // Most lookups of the editors are negative ones, e.g. the symbols of the
+    // system headers. The filter saves the disk reads of all the levels.
+    filter_policy_.reset(leveldb::NewBloomFilterPolicy(cfg.bloom_filter_bits));
+  } else {
+    filter_policy_.reset();
+  }
+
   leveldb::Options options;
   options.create_if_missing = create_if_missing;
   options.error_if_exists = error_if_exists;
+  options.block_cache = block_cache_.get();
+  options.filter_policy = filter_policy_.get();
+  options.block_size = cfg.block_size;
+  options.max_open_files = cfg.max_open_files;
+  options.compression = cfg.use_compression ? leveldb::kSnappyCompression
+                                            : leveldb::kNoCompression;
+  // A new database is going to be filled by a full build.
+  options.write_buffer_size =
+      error_if_exists ? cfg.bulk_write_buffer_size : cfg.write_buffer_size;
+
+  LOG_DEBUG << "project=" << name_ << " block_cache=" << cfg.block_cache_size
+            << " bloom_bits=" << cfg.bloom_filter_bits
+            << " write_buffer=" << options.write_buffer_size;
 
   leveldb::DB *raw_ptr = nullptr;
   leveldb::Status status =
@@ -195,39 +393,62 @@ void Project::InitializeLevelDB(bool create_if_missing, bool error_if_exists) {
   }
 
   symbol_db_.reset(raw_ptr);
+  usr_table_.Reset(symbol_db_.get());
+  path_table_.Reset(symbol_db_.get());
+
+  if (!error_if_exists) {
+    return;
+  }
+
+  record_format_ = cfg.record_format;
+  const auto &format = record_format_ == RecordFormat::kFlat
+                           ? kSymdbFormatFlat
+                           : kSymdbFormatProtobuf;
+  if (!PutSingleKey(kSymdbVersionKey, kSymdbVersion) ||
+      !PutSingleKey(kSymdbFormatKey, format)) {
+    THROW_AT_FILE_LINE("project<%s> put version failed", name_.c_str());
+  }
 }
 
-FsPathSet Project::GetWatchDirs() {
+FsPathSet Project::GetWatchDirs(FsPathVec &header_paths) {
   FsPathSet sub_dirs;
 
   LOG_DEBUG << "project=" << name_ << " home=" << home_path_;
 
-  filesystem::recursive_directory_iterator rdi(home_path_);
-  filesystem::recursive_directory_iterator end_rdi;
-  for (; rdi != end_rdi; ++rdi) {
-    fspath abs_path;
-    if (rdi->path().is_absolute()) {
-      abs_path = rdi->path();
-    } else {
-      abs_path = symutil::absolute_path(rdi->path(), home_path_);
-    }
-
-    if (!filesystem::is_directory(abs_path)) {
-      continue;
-    }
+  // A directory is pruned if whatever is under it is excluded, e.g. the
+  // build directory, so it's never read. The regex and suffix patterns can't
+  // tell that, so they're checked on each entry below.
+  auto is_descended = [this](const fspath &dir) {
+    return !symutil::path_has_prefix(dir, config_->build_path()) &&
+           !config_->IsDirTreeExcluded(dir);
+  };
+  auto is_header = [](std::string_view name) {
+    auto pos = name.rfind('.');
+    return pos != std::string_view::npos &&
+           symutil::is_cpp_header_ext(name.substr(pos));
+  };
 
-    if (IsFileExcluded(abs_path)) {
+  auto scanned_dirs = ScanDirTree(home_path_, is_descended, is_header,
+                                  ConfigInst.max_workers());
+  for (auto &scanned : scanned_dirs) {
+    const auto &abs_path = scanned.path;
+    // The home itself isn't a sub directory.
+    if (abs_path == home_path_ || IsFileExcluded(abs_path)) {
       continue;
     }
 
-    fspath relative_path = filesystem::relative(abs_path, home_path_);
-    auto module_name = flag_cache_.GetModuleName(relative_path);
-    if (module_name.empty()) {
+    fspath relative_path = path_table_.ToRelative(abs_path);
+    if (!flag_cache_.IsModuleDir(relative_path)) {
       continue;
     }
 
     LOG_DEBUG << "project=" << name_ << " sub_dir=" << relative_path;
     sub_dirs.insert(abs_path);
+    for (auto &path : scanned.files) {
+      if (!IsFileExcluded(path)) {
+        header_paths.push_back(std::move(path));
+      }
+    }
   }
 
   return sub_dirs;
@@ -236,13 +457,12 @@ FsPathSet Project::GetWatchDirs() {
 void Project::AddFileWatch(const fspath &path) {
   assert(path.is_absolute());
 
-  auto module_name = GetModuleName(path);
-  if (module_name.empty()) {
+  if (!flag_cache_.IsModuleDir(path)) {
     return;
   }
 
   try {
-    WatcherPtr watcher{new ProjectFileWatcher{path}};
+    WatcherPtr watcher{new ProjectFileWatcher{this, path}};
     watchers_[watcher->fd()] = std::move(watcher);
     LOG_INFO << "project=" << name_ << " watch_path=" << path;
   } catch (const std::exception &e) {
@@ -266,7 +486,7 @@ void Project::RemoveFileWatch(const fspath &path) {
   LOG_INFO << "watch not added, project=" << name_ << " path=" << path;
 }
 
-void Project::UpdateWatchDirs() {
+void Project::UpdateWatchDirs(const FsPathSet &new_watch_dirs) {
   if (!config_->is_enable_file_watch()) {
     return;
   }
@@ -276,7 +496,6 @@ void Project::UpdateWatchDirs() {
     old_watch_dirs.insert(kvp.second->abs_path());
   }
 
-  FsPathSet new_watch_dirs = GetWatchDirs();
   LOG_DEBUG << "project=" << name_
             << " new_watch_dirs=" << new_watch_dirs.size();
 
@@ -296,6 +515,95 @@ void Project::UpdateWatchDirs() {
             << " wd_size=" << watchers_.size();
 }
 
+void Project::BuildLexicalIndexes(const FsPathVec &header_paths) {
+  ++lexical_generation_;
+  text_index_.Clear();
+  provisional_defs_.Clear();
+
+  FsPathVec abs_paths;
+  abs_paths.reserve(abs_src_paths_.size() + header_paths.size());
+  for (const auto &abs_path : abs_src_paths_) {
+    if (!IsFileExcluded(abs_path)) {
+      abs_paths.push_back(abs_path);
+    }
+  }
+  // The headers aren't in the compilation database.
+  abs_paths.insert(abs_paths.end(), header_paths.begin(), header_paths.end());
+
+  LOG_INFO << "project=" << name_ << " lexical_files=" << abs_paths.size();
+  UpdateLexicalIndexes(abs_paths);
+}
+
+void Project::UpdateLexicalIndexes(const FsPathVec &abs_paths) {
+  bool with_trigrams = config_->is_enable_text_index();
+  for (size_t i = 0; i < abs_paths.size(); i += kLexicalScanBatchSize) {
+    auto last = abs_paths.begin() +
+                std::min(abs_paths.size(), i + kLexicalScanBatchSize);
+    ServerInst.PostToWorker(std::bind(
+        &Project::ScanLexicalFiles, shared_from_this(), lexical_generation_,
+        with_trigrams, FsPathVec{abs_paths.begin() + i, last}));
+  }
+}
+
+void Project::ScanLexicalFiles(uint64_t generation, bool with_trigrams,
+                               FsPathVec abs_paths) {
+  assert(!ServerInst.IsInMainThread());
+
+  auto files = std::make_shared<std::vector<LexicalFile>>();
+  files->reserve(abs_paths.size());
+  std::string content;
+  for (auto &abs_path : abs_paths) {
+    LexicalFile file{std::move(abs_path), false, {}, {}};
+    file.is_readable = TextIndex::ReadFile(file.abs_path, content);
+    if (file.is_readable) {
+      if (with_trigrams) {
+        TextIndex::ExtractTrigrams(content, file.trigrams);
+      }
+      ScanProvisionalDefinitions(content, file.definitions);
+    }
+    files->push_back(std::move(file));
+  }
+
+  ServerInst.PostToMain(std::bind(&Project::ApplyLexicalFiles,
+                                  shared_from_this(), generation, files));
+}
+
+void Project::ApplyLexicalFiles(uint64_t generation, LexicalFileVecPtr files) {
+  assert(ServerInst.IsInMainThread());
+
+  if (generation != lexical_generation_) {
+    return;
+  }
+
+  bool with_trigrams = config_->is_enable_text_index();
+  for (auto &file : *files) {
+    if (!file.is_readable) {
+      LOG_DEBUG << "not indexed, project=" << name_
+                << " path=" << file.abs_path;
+      text_index_.Remove(file.abs_path);
+      provisional_defs_.Remove(file.abs_path);
+      continue;
+    }
+
+    if (with_trigrams) {
+      text_index_.Update(file.abs_path, file.trigrams);
+    }
+
+    // The compiled ones have the semantic definitions.
+    if (abs_src_paths_.find(file.abs_path) != abs_src_paths_.end() &&
+        VisitKeyValue(MakeFileInfoKey(file.abs_path),
+                      [](const leveldb::Slice &) {})) {
+      provisional_defs_.Remove(file.abs_path);
+    } else {
+      provisional_defs_.Update(file.abs_path, std::move(file.definitions));
+    }
+  }
+
+  if (text_index_.NeedCompact()) {
+    text_index_.Compact();
+  }
+}
+
 void Project::Build() {
   // excludeDeclsFromPCH = 1, displayDiagnostics=0
   SmartCXIndex cx_index{clang_createIndex(1, 0), clang_disposeIndex};
@@ -323,7 +631,7 @@ void Project::Build() {
 void Project::RebuildFile(const fspath &abs_path) {
   assert(filesystem::exists(abs_path));
 
-  fspath relative_path = filesystem::relative(abs_path, home_path_);
+  fspath relative_path = path_table_.ToRelative(abs_path);
   if (in_parsing_files_.find(relative_path) != in_parsing_files_.end()) {
     return;
   }
@@ -345,7 +653,7 @@ void Project::RebuildFile(const fspath &abs_path) {
 }
 
 void Project::BuildFile(SmartCXIndex cx_index, const fspath &abs_path) {
-  fspath relative_path = filesystem::relative(abs_path, home_path_);
+  fspath relative_path = path_table_.ToRelative(abs_path);
   if (in_parsing_files_.find(relative_path) != in_parsing_files_.end()) {
     LOG_INFO << "file is in parsing, project=" << name_
              << " relative_path=" << relative_path;
@@ -388,7 +696,8 @@ void Project::ChangeHomeNoCheck(fspath &&new_path) {
                        new_path.c_str());
   }
 
-  if (!filesystem::exists(config_->cmake_file())) {
+  if (config_->compile_db_provider() == CompileDbProvider::kCmake &&
+      !filesystem::exists(config_->cmake_file())) {
     THROW_AT_FILE_LINE("project<%s> new_home<%s> has no CMakeLists.txt",
                        name_.c_str(), new_path.c_str());
   }
@@ -399,9 +708,8 @@ void Project::ChangeHomeNoCheck(fspath &&new_path) {
   }
 
   home_path_.swap(new_path);
+  path_table_.set_home(home_path_);
 
-  // Although it may take some seconds and block the main thread, we think
-  // it's acceptable. It's complicated to post the task to the workers.
   ForceSync();
 }
 
@@ -418,7 +726,7 @@ void Project::ClangParseFile(SmartCXIndex cx_index, fspath home_path,
     return;
   }
 
-  fspath relative_path = filesystem::relative(abs_path, home_path);
+  fspath relative_path = symutil::lexical_relative(abs_path, home_path);
 
   auto file_info_key = MakeFileInfoKey(relative_path);
   DB_FileBasicInfo file_info;
@@ -464,7 +772,7 @@ void Project::ClangParseFile(SmartCXIndex cx_index, fspath home_path,
 void Project::WriteCompiledFile(TranslationUnitPtr tu, fspath relative_path,
                                 CompiledFileInfo info) {
   if (relative_path.is_absolute()) {
-    relative_path = symutil::absolute_path(relative_path, home_path_);
+    relative_path = path_table_.ToRelative(relative_path);
   }
 
   BatchWriter writer{this};
@@ -478,6 +786,20 @@ void Project::WriteCompiledFile(TranslationUnitPtr tu, fspath relative_path,
   try {
     WriteFileDefinitions(tu, relative_path, writer);
     WriteFileReferences(tu, relative_path, writer);
+    WriteFilePositions(tu, relative_path, writer);
+    WriteHeaderMacros(tu, writer);
+
+    FileId file_id = path_table_.Intern(relative_path);
+    WriteFileEdges(EdgeKind::kCall, InternSymbolEdges(tu->calls(), file_id),
+                   relative_path, writer);
+    WriteFileEdges(EdgeKind::kDerive,
+                   InternSymbolEdges(tu->derivations(), file_id),
+                   relative_path, writer);
+    WriteFileEdges(EdgeKind::kOverride,
+                   InternSymbolEdges(tu->overrides(), file_id), relative_path,
+                   writer);
+    WriteFileEdges(EdgeKind::kInclude, InternIncludeEdges(tu->includes()),
+                   relative_path, writer);
   } catch (const std::exception &e) {
     LOG_ERROR << "project=" << name_ << " file=" << relative_path
               << " error=" << e.what();
@@ -487,24 +809,27 @@ void Project::WriteCompiledFile(TranslationUnitPtr tu, fspath relative_path,
 
 void Project::WriteFileDefinitions(TranslationUnitPtr tu, fspath relative_path,
                                    BatchWriter &writer) {
-  const auto &new_symbols = tu->defined_symbols();
+  // Replaced by the semantic ones.
+  provisional_defs_.Remove(path_table_.ToAbsolute(relative_path));
+
+  SymbolIdLocationMap new_symbols;
+  for (const auto &kv : tu->defined_symbols()) {
+    new_symbols.emplace(usr_table_.Intern(kv.first), kv.second);
+  }
+
   LOG_INFO << "project=" << name_ << " file=" << relative_path
            << " symbols=" << new_symbols.size();
 
-  SymbolDefinitionMap old_symbols;
+  SymbolIdLocationMap old_symbols;
   (void)LoadFileDefinedSymbolInfo(relative_path, old_symbols);
 
   std::string module_name = GetModuleName(relative_path);
 
-  auto put_symbol = [&](const std::string &symbol, const Location &loc) {
-    auto symkey = MakeSymbolDefineKey(symbol);
-
+  auto put_symbol = [&](SymbolId symbol, const Location &loc) {
     DB_SymbolDefinitionInfo st;
-    (void)LoadKeyPBValue(symkey, st);
+    (void)GetSymbolDefinitionInfo(symbol, st);
     AddSymbolLocation(st, module_name, loc);
-
-    auto loc_str = st.SerializeAsString();
-    writer.Put(symkey, loc_str);
+    writer.PutSymbol(symbol, st);
   };
 
   bool is_symbol_changed = false;
@@ -512,9 +837,8 @@ void Project::WriteFileDefinitions(TranslationUnitPtr tu, fspath relative_path,
     auto it = new_symbols.find(kv.first);
     if (it == new_symbols.end()) {
       LOG_INFO << "project=" << name_ << " file=" << relative_path
-               << " deleted_symbol=" << kv.first;
-      auto symkey = MakeSymbolDefineKey(kv.first);
-      writer.Delete(symkey);
+               << " deleted_symbol=" << usr_table_.Lookup(kv.first);
+      writer.DeleteSymbol(kv.first);
       is_symbol_changed = true;
     } else {
       Location location = QuerySymbolDefinition(kv.first, relative_path);
@@ -535,14 +859,43 @@ void Project::WriteFileDefinitions(TranslationUnitPtr tu, fspath relative_path,
     Location new_loc{relative_path.string(), kv.second.line_number(),
                      kv.second.column_number()};
     put_symbol(kv.first, new_loc);
+
+    auto name_it = tu->defined_symbol_names().find(usr_table_.Lookup(kv.first));
+    if (name_it != tu->defined_symbol_names().end()) {
+      writer.PutSymbolName(kv.first, name_it->second);
+    }
+  }
+
+  // The metadata may change while the location doesn't, e.g. the type.
+  for (const auto &kv : tu->defined_symbol_metadata()) {
+    SymbolId symbol = usr_table_.Find(kv.first);
+    if (symbol == InternTable::kInvalidId) {
+      continue;
+    }
+
+    DB_SymbolMetadata metadata;
+    metadata.set_kind(kv.second.kind);
+    metadata.set_display_name(kv.second.display_name);
+    metadata.set_type(kv.second.type);
+    metadata.set_brief_comment(kv.second.brief_comment);
+
+    std::string value = metadata.SerializeAsString();
+    auto key = MakeSymbolMetadataKey(symbol);
+    bool is_same = false;
+    (void)VisitKeyValue(key, [&](const leveldb::Slice &old_value) {
+      is_same = old_value == leveldb::Slice{value};
+    });
+    if (!is_same) {
+      writer.Put(key, value);
+    }
   }
 
   if (is_symbol_changed) {
     auto file_symbol_key = MakeFileSymbolDefineKey(relative_path.string());
     DB_FileSymbolInfo file_symbol_info;
-    file_symbol_info.mutable_symbols()->Reserve(new_symbols.size());
+    file_symbol_info.mutable_symbol_ids()->Reserve(new_symbols.size());
     for (const auto &kv : new_symbols) {
-      file_symbol_info.add_symbols(kv.first);
+      file_symbol_info.add_symbol_ids(kv.first);
     }
 
     if (new_symbols.empty()) {
@@ -558,7 +911,7 @@ void Project::WriteFileReferences(TranslationUnitPtr tu, fspath relative_path,
   FileSymbolReferenceMap new_symbols;
   int nr_referred = 0;
   for (const auto &kvp : tu->reference_symbols()) {
-    const auto &symbol = kvp.first.first;
+    SymbolId symbol = usr_table_.Intern(kvp.first.first);
     const auto &path = kvp.first.second;
     std::string module_name = GetModuleName(path);
     SymbolModulePair sym_mod{symbol, module_name};
@@ -575,31 +928,16 @@ void Project::WriteFileReferences(TranslationUnitPtr tu, fspath relative_path,
   FileSymbolReferenceMap old_symbols;
   (void)LoadFileReferredSymbolInfo(relative_path, old_symbols);
 
-  auto put_symbol_reference = [&](const std::string &symbol_name,
+  FileId file_id = path_table_.Intern(relative_path);
+
+  auto put_symbol_reference = [&](SymbolId symbol,
                                   const SymbolReferenceLocationMap &sym_locs) {
-    auto symbol_key = MakeSymbolReferKey(symbol_name);
+    auto symbol_key = MakeSymbolReferKey(symbol);
     if (sym_locs.empty()) {
       writer.Delete(symbol_key);
       return;
     }
-    DB_SymbolReferenceInfo db_info;
-    db_info.mutable_items()->Reserve(sym_locs.size());
-    for (const auto &kvp : sym_locs) {
-      auto *item = db_info.add_items();
-      item->set_module_name(kvp.first);
-      item->mutable_path_locs()->Reserve(kvp.second.size());
-      for (const auto &kvp2 : kvp.second) {
-        auto *path_loc = item->add_path_locs();
-        path_loc->set_path(kvp2.first.string());
-        path_loc->mutable_locations()->Reserve(kvp2.second.size());
-        for (const auto &loc : kvp2.second) {
-          auto *pb_loc = path_loc->add_locations();
-          pb_loc->set_line(loc.first);
-          pb_loc->set_column(loc.second);
-        }
-      }
-    }
-    writer.Put(symbol_key, db_info);
+    writer.Put(symbol_key, EncodeSymbolReferenceInfo(sym_locs));
   };
 
   bool is_symbol_changed = false;
@@ -609,12 +947,12 @@ void Project::WriteFileReferences(TranslationUnitPtr tu, fspath relative_path,
       continue;
     }
 
-    const auto &sym_name = kv.first.first;
+    SymbolId sym_id = kv.first.first;
     const auto &mod_name = kv.first.second;
 
     SymbolReferenceLocationMap sym_locs;
-    if (!LoadSymbolReferenceInfo(sym_name, sym_locs)) {
-      LOG_DEBUG << "symref=" << sym_name << " not in db";
+    if (!LoadSymbolReferenceInfo(sym_id, sym_locs)) {
+      LOG_DEBUG << "symref=" << sym_id << " not in db";
       continue;
     }
 
@@ -624,49 +962,246 @@ void Project::WriteFileReferences(TranslationUnitPtr tu, fspath relative_path,
     }
 
     is_symbol_changed = true;
-    ref_it->second.erase(relative_path);
+    ref_it->second.erase(file_id);
     if (ref_it->second.empty()) {
       sym_locs.erase(ref_it);
     }
-    put_symbol_reference(sym_name, sym_locs);
+    put_symbol_reference(sym_id, sym_locs);
   }
 
   for (const auto &kv : new_symbols) {
-    const auto &sym_name = kv.first.first;
+    SymbolId sym_id = kv.first.first;
     const auto &mod_name = kv.first.second;
     auto it = old_symbols.find(kv.first);
     if (it == old_symbols.end() || it->second != kv.second) {
       SymbolReferenceLocationMap sym_locs;
-      (void)LoadSymbolReferenceInfo(sym_name, sym_locs);
-      sym_locs[mod_name][relative_path] = kv.second;
+      (void)LoadSymbolReferenceInfo(sym_id, sym_locs);
+      sym_locs[mod_name][file_id] = kv.second;
       is_symbol_changed = true;
-      put_symbol_reference(sym_name, sym_locs);
+      put_symbol_reference(sym_id, sym_locs);
     }
   }
 
   if (is_symbol_changed) {
     auto file_symbol_key = MakeFileSymbolReferKey(relative_path.string());
-    DB_FileReferenceInfo file_symbol_info;
-    file_symbol_info.mutable_symbols()->Reserve(new_symbols.size());
-    for (const auto &kv : new_symbols) {
-      auto item = file_symbol_info.add_symbols();
-      item->mutable_locations()->Reserve(kv.second.size());
-      item->set_symbol_name(kv.first.first);
-      item->set_module_name(kv.first.second);
-      for (const auto &loc : kv.second) {
-        auto *pb_loc = item->add_locations();
-        pb_loc->set_line(loc.first);
-        pb_loc->set_column(loc.second);
+    writer.Put(file_symbol_key, EncodeFileReferenceInfo(new_symbols));
+  }
+}
+
+void Project::WriteFilePositions(TranslationUnitPtr tu, fspath relative_path,
+                                 BatchWriter &writer) {
+  const auto &sizes = tu->symbol_sizes();
+  auto make_position = [&](SymbolId symbol, uint32_t line, uint32_t column,
+                           bool is_definition) {
+    auto it = sizes.find(LineColPair{line, column});
+    uint32_t size = it == sizes.end() ? 1 : std::max<uint32_t>(it->second, 1);
+    return SymbolPosition{line, column, column + size, symbol, is_definition};
+  };
+
+  // The definitions are added first, which win if a reference is at the
+  // same position.
+  PositionIndexBuilder builder;
+  for (const auto &kv : tu->defined_symbols()) {
+    builder.Add(make_position(usr_table_.Intern(kv.first),
+                              kv.second.line_number(),
+                              kv.second.column_number(), true));
+  }
+
+  for (const auto &kvp : tu->reference_symbols()) {
+    SymbolId symbol = usr_table_.Intern(kvp.first.first);
+    for (const auto &lcp : kvp.second) {
+      builder.Add(make_position(symbol, lcp.first, lcp.second, false));
+    }
+  }
+
+  auto key = MakeFilePositionKey(relative_path);
+  if (builder.empty()) {
+    writer.Delete(key);
+  } else {
+    writer.Put(key, builder.Finish());
+  }
+}
+
+void Project::WriteHeaderMacros(TranslationUnitPtr tu, BatchWriter &writer) {
+  for (const auto &kv : tu->header_macros()) {
+    const fspath path{kv.first};
+    const HeaderMacros &macros = kv.second;
+    if (IsFileExcluded(path)) {
+      continue;
+    }
+
+    auto key = MakeHeaderMacroKey(path);
+    DB_HeaderMacroInfo old_info;
+    bool has_old = LoadKeyPBValue(key, old_info);
+
+    std::set<SymbolId> old_symbols{old_info.symbol_ids().begin(),
+                                   old_info.symbol_ids().end()};
+    std::set<SymbolId> new_symbols;
+    bool is_changed = !has_old || old_info.last_mtime() != macros.last_mtime;
+    if (is_changed) {
+      // Written by a unit before the header changes.
+      for (SymbolId symbol : old_symbols) {
+        writer.DeleteSymbol(symbol);
+      }
+      old_symbols.clear();
+    }
+
+    // The same header seen by another unit may only differ in the macros
+    // hidden by #if, which are added. Nothing is written for the most.
+    for (const auto &def : macros.definitions) {
+      SymbolId symbol = usr_table_.Find(def.first);
+      if (symbol != InternTable::kInvalidId &&
+          old_symbols.find(symbol) != old_symbols.end()) {
+        continue;
       }
+
+      symbol = usr_table_.Intern(def.first);
+      new_symbols.insert(symbol);
+
+      DB_SymbolDefinitionInfo st;
+      AddSymbolLocation(st, GetModuleName(path), def.second);
+      writer.PutSymbol(symbol, st);
+
+      const auto &name = macros.names.at(def.first);
+      writer.PutSymbolName(symbol, name);
+
+      DB_SymbolMetadata metadata;
+      metadata.set_kind(CXCursor_MacroDefinition);
+      metadata.set_display_name(name);
+      writer.Put(MakeSymbolMetadataKey(symbol), metadata);
+    }
+
+    if (!is_changed && new_symbols.empty()) {
+      continue;
+    }
+
+    LOG_DEBUG << "project=" << name_ << " header=" << path
+              << " new_macros=" << new_symbols.size()
+              << " is_changed=" << is_changed;
+
+    new_symbols.insert(old_symbols.begin(), old_symbols.end());
+    DB_HeaderMacroInfo new_info;
+    new_info.set_last_mtime(macros.last_mtime);
+    new_info.mutable_symbol_ids()->Reserve(new_symbols.size());
+    for (SymbolId symbol : new_symbols) {
+      new_info.add_symbol_ids(symbol);
+    }
+    writer.Put(key, new_info);
+  }
+}
+
+EdgeSiteMap Project::InternSymbolEdges(const EdgeLineMap &usr_edges,
+                                       FileId file) {
+  EdgeSiteMap edges;
+  for (const auto &kv : usr_edges) {
+    edges.emplace(std::make_pair(usr_table_.Intern(kv.first.first),
+                                 usr_table_.Intern(kv.first.second)),
+                  EdgeSite{file, kv.second});
+  }
+  return edges;
+}
+
+EdgeSiteMap Project::InternIncludeEdges(const EdgeLineMap &path_edges) {
+  // The files out of the project, e.g. the system headers, are ignored.
+  // By the whole components, so /a/proj2 isn't in /a/proj.
+  auto is_in_home = [this](const std::string &path) {
+    auto relative_path = symutil::lexical_relative(path, home_path_);
+    return !relative_path.empty() && *relative_path.begin() != "..";
+  };
+
+  EdgeSiteMap edges;
+  for (const auto &kv : path_edges) {
+    const auto &includer = kv.first.first;
+    const auto &included = kv.first.second;
+    if (!is_in_home(includer) || !is_in_home(included)) {
+      continue;
+    }
+
+    FileId includer_id = path_table_.Intern(includer);
+    edges.emplace(std::make_pair(includer_id, path_table_.Intern(included)),
+                  EdgeSite{includer_id, kv.second});
+  }
+  return edges;
+}
+
+void Project::WriteFileEdges(EdgeKind kind, const EdgeSiteMap &new_edges,
+                             const fspath &relative_path,
+                             BatchWriter &writer) {
+  EdgeSiteMap old_edges;
+  (void)LoadFileEdges(kind, relative_path, old_edges);
+  if (new_edges == old_edges) {
+    return;
+  }
+
+  FileId file_id = path_table_.Intern(relative_path);
+  for (const auto &kv : old_edges) {
+    if (new_edges.find(kv.first) == new_edges.end()) {
+      const auto &edge = kv.first;
+      writer.Delete(MakeEdgeKey(kind, kEdgeOut, edge.first, edge.second, file_id));
+      writer.Delete(MakeEdgeKey(kind, kEdgeIn, edge.second, edge.first, file_id));
+    }
+  }
+
+  for (const auto &kv : new_edges) {
+    auto it = old_edges.find(kv.first);
+    if (it == old_edges.end() || !(it->second == kv.second)) {
+      const auto &edge = kv.first;
+      auto site = symutil::str_join(kSymdbKeyDelimiter, kv.second.file,
+                                    kv.second.line);
+      writer.Put(MakeEdgeKey(kind, kEdgeOut, edge.first, edge.second, file_id),
+                 site);
+      writer.Put(MakeEdgeKey(kind, kEdgeIn, edge.second, edge.first, file_id),
+                 site);
     }
-    writer.Put(file_symbol_key, file_symbol_info);
   }
+
+  auto file_edge_key = MakeFileEdgeKey(kind, relative_path);
+  if (new_edges.empty()) {
+    writer.Delete(file_edge_key);
+    return;
+  }
+
+  DB_FileEdgeInfo db_info;
+  db_info.mutable_from_ids()->Reserve(new_edges.size());
+  db_info.mutable_to_ids()->Reserve(new_edges.size());
+  db_info.mutable_site_file_ids()->Reserve(new_edges.size());
+  db_info.mutable_site_lines()->Reserve(new_edges.size());
+  for (const auto &kv : new_edges) {
+    db_info.add_from_ids(kv.first.first);
+    db_info.add_to_ids(kv.first.second);
+    db_info.add_site_file_ids(kv.second.file);
+    db_info.add_site_lines(kv.second.line);
+  }
+  writer.Put(file_edge_key, db_info);
+}
+
+bool Project::LoadFileEdges(EdgeKind kind, const fspath &path,
+                            EdgeSiteMap &edges) const {
+  std::string value;
+  if (!LoadKey(MakeFileEdgeKey(kind, path), value)) {
+    return false;
+  }
+
+  DB_FileEdgeInfo db_info;
+  int size = db_info.ParseFromString(value) ? db_info.from_ids_size() : -1;
+  if (size < 0 || db_info.to_ids_size() != size ||
+      db_info.site_file_ids_size() != size ||
+      db_info.site_lines_size() != size) {
+    LOG_ERROR << "bad edge info, project=" << name_ << " path=" << path;
+    return false;
+  }
+
+  for (int i = 0; i < size; ++i) {
+    edges.emplace(std::make_pair(db_info.from_ids(i), db_info.to_ids(i)),
+                  EdgeSite{db_info.site_file_ids(i), db_info.site_lines(i)});
+  }
+  return true;
 }
 
 void Project::RemoveParsingFile(fspath relative_path) {
   assert(ServerInst.IsInMainThread());
 
-  fspath abs_path = symutil::absolute_path(relative_path, home_path_);
+  fspath abs_path = path_table_.ToAbsolute(relative_path);
   if (in_parsing_files_.erase(relative_path) == 0) {
     LOG_INFO << "path is not in built, project=" << name_
              << " path=" << relative_path;
@@ -677,6 +1212,14 @@ void Project::RemoveParsingFile(fspath relative_path) {
              << " in_parsing_files=" << in_parsing_files_.size();
   }
 
+  // All the written files are in the database now.
+  if (in_parsing_files_.empty()) {
+    TryFreezeSymbolDefinitions();
+    if (symbol_names_.NeedCompact()) {
+      symbol_names_.Compact();
+    }
+  }
+
   if (abs_src_paths_.find(abs_path) == abs_src_paths_.end()) {
     LOG_INFO << "path already deleted, project=" << name_
              << " path=" << abs_path;
@@ -685,6 +1228,23 @@ void Project::RemoveParsingFile(fspath relative_path) {
 }
 
 bool Project::LoadProjectInfo() {
+  std::string version;
+  if (!LoadKey(kSymdbVersionKey, version) || version != kSymdbVersion) {
+    LOG_WARN << "project=" << name_ << " incompatible version=" << version
+             << ", expected=" << kSymdbVersion;
+    return false;
+  }
+
+  std::string format;
+  if (!LoadKey(kSymdbFormatKey, format) || format == kSymdbFormatProtobuf) {
+    record_format_ = RecordFormat::kProtobuf;
+  } else if (format == kSymdbFormatFlat) {
+    record_format_ = RecordFormat::kFlat;
+  } else {
+    LOG_WARN << "project=" << name_ << " unknown format=" << format;
+    return false;
+  }
+
   std::string home_dir;
   if (!LoadKey(kSymdbProjectHomeKey, home_dir)) {
     return false;
@@ -695,23 +1255,28 @@ bool Project::LoadProjectInfo() {
     return false;
   }
 
+  if (!LoadFrozenSymbolTable() || !LoadSymbolNames()) {
+    return false;
+  }
+
   LOG_DEBUG << "project=" << name_ << ", home=" << home_dir;
 
   home_path_ = fspath{home_dir};
+  path_table_.set_home(home_path_);
 
   // This project may not exist in config.
   if (!config_) {
     RestoreConfig();
   }
 
-  for (const auto &rel_path : db_info.rel_paths()) {
-    LOG_DEBUG << "relative source file: " << rel_path;
-    fspath p = home_path_ / rel_path;
-    if (!filesystem::exists(p)) {
-      LOG_DEBUG << "file doesn't exist on disk: " << rel_path;
+  for (FileId file_id : db_info.file_ids()) {
+    fspath p = path_table_.AbsolutePath(file_id);
+    LOG_DEBUG << "source file: " << p;
+    if (p.empty() || !filesystem::exists(p)) {
+      LOG_DEBUG << "file doesn't exist on disk: " << p;
       continue;
     }
-    abs_src_paths_.insert(symutil::absolute_path(rel_path, home_path_));
+    abs_src_paths_.insert(p);
   }
 
   ChangeHomeNoCheck(home_dir);
@@ -720,7 +1285,7 @@ bool Project::LoadProjectInfo() {
 }
 
 bool Project::LoadFileDefinedSymbolInfo(const fspath &file_path,
-                                        SymbolDefinitionMap &symbols) const {
+                                        SymbolIdLocationMap &symbols) const {
   std::string file_key = MakeFileSymbolDefineKey(file_path);
 
   DB_FileSymbolInfo db_info;
@@ -728,7 +1293,7 @@ bool Project::LoadFileDefinedSymbolInfo(const fspath &file_path,
     return false;
   }
 
-  for (const auto &symbol : db_info.symbols()) {
+  for (SymbolId symbol : db_info.symbol_ids()) {
     Location location = QuerySymbolDefinition(symbol, file_path);
     if (!location.IsValid()) {
       LOG_ERROR << "QuerySymbolDefinition failed, project=" << name_
@@ -745,13 +1310,34 @@ bool Project::LoadFileReferredSymbolInfo(
     const fspath &file_path, FileSymbolReferenceMap &symbols) const {
   std::string file_key = MakeFileSymbolReferKey(file_path);
 
+  if (record_format_ == RecordFormat::kFlat) {
+    return VisitKeyValue(file_key, [&](const leveldb::Slice &value) {
+      flat::FileReferenceView view;
+      if (!view.Init(value)) {
+        LOG_ERROR << "bad record, project=" << name_ << " key=" << file_key;
+        return;
+      }
+
+      SymbolId symbol = 0;
+      leveldb::Slice module_name;
+      flat::LocationRun run;
+      uint32_t line = 0, column = 0;
+      for (uint32_t i = 0; view.Get(i, symbol, module_name, run); ++i) {
+        auto &lcs = symbols[{symbol, module_name.ToString()}];
+        while (run.Next(line, column)) {
+          lcs.insert({line, column});
+        }
+      }
+    });
+  }
+
   DB_FileReferenceInfo db_info;
   if (!LoadKeyPBValue(file_key, db_info)) {
     return false;
   }
 
   for (const auto &symbol : db_info.symbols()) {
-    SymbolModulePair smp{symbol.symbol_name(), symbol.module_name()};
+    SymbolModulePair smp{symbol.symbol_id(), symbol.module_name()};
     auto &lcs = symbols[smp];
     for (const auto &item : symbol.locations()) {
       lcs.insert({item.line(), item.column()});
@@ -764,18 +1350,53 @@ bool Project::LoadFileReferredSymbolInfo(
 bool Project::LoadSymbolReferenceInfo(
     const std::string &symbol_name,
     SymbolReferenceLocationMap &sym_locs) const {
-  auto symbol_key = MakeSymbolReferKey(symbol_name);
+  SymbolId symbol = usr_table_.Find(symbol_name);
+  if (symbol == InternTable::kInvalidId) {
+    LOG_DEBUG << "symbol=" << symbol_name << " not interned";
+    return false;
+  }
+
+  return LoadSymbolReferenceInfo(symbol, sym_locs);
+}
+
+bool Project::LoadSymbolReferenceInfo(
+    SymbolId symbol, SymbolReferenceLocationMap &sym_locs) const {
+  auto symbol_key = MakeSymbolReferKey(symbol);
+
+  if (record_format_ == RecordFormat::kFlat) {
+    return VisitKeyValue(symbol_key, [&](const leveldb::Slice &value) {
+      flat::ReferenceView view;
+      if (!view.Init(value)) {
+        LOG_ERROR << "bad record, project=" << name_ << " key=" << symbol_key;
+        return;
+      }
+
+      flat::ModuleReferences module_refs;
+      flat::LocationRun run;
+      FileId file_id = 0;
+      uint32_t line = 0, column = 0;
+      for (uint32_t i = 0; view.Get(i, module_refs); ++i) {
+        auto &sym_refs = sym_locs[module_refs.module_name().ToString()];
+        while (module_refs.NextFile(file_id, run)) {
+          auto &file_info = sym_refs[file_id];
+          while (run.Next(line, column)) {
+            file_info.insert({line, column});
+          }
+        }
+      }
+    });
+  }
 
   DB_SymbolReferenceInfo db_info;
   if (!LoadKeyPBValue(symbol_key, db_info)) {
-    LOG_DEBUG << "symbol=" << symbol_name << " no references";
+    LOG_DEBUG << "symbol=" << symbol << " no references";
     return false;
   }
 
   for (const auto &item : db_info.items()) {
     auto &sym_refs = sym_locs[item.module_name()];
     for (const auto &path_loc : item.path_locs()) {
-      auto &file_info = sym_refs[path_loc.path()];
+      auto &file_info = sym_refs[path_loc.file_id()];
       for (const auto &loc : path_loc.locations()) {
         file_info.insert({loc.line(), loc.column()});
       }
@@ -785,124 +1406,512 @@ bool Project::LoadSymbolReferenceInfo(
   return true;
 }
 
-bool Project::GetSymbolDefinitionInfo(const std::string &symbol,
-                                      DB_SymbolDefinitionInfo &st) const {
-  std::string symbol_key = MakeSymbolDefineKey(symbol);
-
-  if (!LoadKeyPBValue(symbol_key, st)) {
+bool Project::VisitSymbolReferences(const std::string &symbol_name,
+                                    const fspath &path,
+                                    const ReferenceVisitor &visitor) const {
+  SymbolId symbol = usr_table_.Find(symbol_name);
+  if (symbol == InternTable::kInvalidId) {
+    LOG_DEBUG << "symbol=" << symbol_name << " not interned";
     return false;
   }
 
-  return true;
-}
+  std::string module_name;
+  if (!path.empty()) {
+    module_name = GetModuleName(path);
+  }
 
-std::vector<Location> Project::QuerySymbolDefinition(
-    const std::string &symbol) const {
-  std::vector<Location> locations;
+  auto symbol_key = MakeSymbolReferKey(symbol);
 
-  DB_SymbolDefinitionInfo db_info;
-  if (!GetSymbolDefinitionInfo(symbol, db_info)) {
-    LOG_ERROR << "GetSymbolDefinitionInfo failed, project=" << name_
-              << " symbol=" << symbol;
-    return locations;
-  }
+  if (record_format_ == RecordFormat::kProtobuf) {
+    DB_SymbolReferenceInfo db_info;
+    if (!LoadKeyPBValue(symbol_key, db_info)) {
+      return false;
+    }
 
-  locations.reserve(db_info.locations_size());
-  for (const auto &pb_loc : db_info.locations()) {
-    fspath rel_path(pb_loc.path());
-    fspath abs_path = symutil::absolute_path(rel_path, home_path_);
-    locations.emplace_back(abs_path.string(), pb_loc.line(), pb_loc.column());
+    auto visit_item = [&](const DB_SymbolReferenceItem &item) {
+      for (const auto &path_loc : item.path_locs()) {
+        for (const auto &loc : path_loc.locations()) {
+          visitor(path_loc.file_id(), loc.line(), loc.column());
+        }
+      }
+    };
+
+    for (const auto &item : db_info.items()) {
+      if (!module_name.empty() && item.module_name() == module_name) {
+        visit_item(item);
+        return true;
+      }
+    }
+    for (const auto &item : db_info.items()) {
+      visit_item(item);
+    }
+    return true;
   }
 
-  return locations;
-}
+  return VisitKeyValue(symbol_key, [&](const leveldb::Slice &value) {
+    flat::ReferenceView view;
+    if (!view.Init(value)) {
+      LOG_ERROR << "bad record, project=" << name_ << " key=" << symbol_key;
+      return;
+    }
 
-// A symbol may appear more than once. Get the one match abs_path or the first
-// one if there's none.
-Location Project::QuerySymbolDefinition(const std::string &symbol,
-                                        const fspath &abs_path) const {
-  DB_SymbolDefinitionInfo db_info;
-  if (!GetSymbolDefinitionInfo(symbol, db_info)) {
-    return Location{};
-  }
+    auto visit_module = [&](flat::ModuleReferences &module_refs) {
+      flat::LocationRun run;
+      FileId file_id = 0;
+      uint32_t line = 0, column = 0;
+      while (module_refs.NextFile(file_id, run)) {
+        while (run.Next(line, column)) {
+          visitor(file_id, line, column);
+        }
+      }
+    };
+
+    flat::ModuleReferences module_refs;
+    if (!module_name.empty()) {
+      for (uint32_t i = 0; view.Get(i, module_refs); ++i) {
+        if (module_refs.module_name() == module_name) {
+          visit_module(module_refs);
+          return;
+        }
+      }
+    }
+    for (uint32_t i = 0; view.Get(i, module_refs); ++i) {
+      visit_module(module_refs);
+    }
+  });
+}
 
-  Location location = GetSymbolLocation(db_info, abs_path);
-  if (location.IsValid()) {
-    return location;
+template <typename Fn>
+bool Project::VisitSymbolDefinitionValue(SymbolId symbol, Fn &&fn) const {
+  if (symdef_delta_.find(symbol) != symdef_delta_.end()) {
+    bool is_deleted = false;
+    bool is_found = VisitKeyValue(
+        MakeSymbolDefineKey(symbol), [&](const leveldb::Slice &value) {
+          is_deleted = value.empty();
+          if (!is_deleted) {
+            fn(value);
+          }
+        });
+    if (is_found) {
+      return !is_deleted;
+    }
   }
 
-  if (db_info.locations().empty()) {
-    return Location{};
+  leveldb::Slice value;
+  if (!frozen_symdefs_.Find(symbol, value)) {
+    return false;
   }
 
-  return Location{db_info.locations(0)};
+  fn(value);
+  return true;
 }
 
-std::string Project::MakeFileInfoKey(const fspath &file_path) const {
-  if (file_path.is_absolute()) {
-    return MakeFileInfoKey(filesystem::relative(file_path, home_path_));
+bool Project::GetSymbolDefinitionInfo(SymbolId symbol,
+                                      DB_SymbolDefinitionInfo &st) const {
+  if (record_format_ == RecordFormat::kProtobuf) {
+    bool ok = true;
+    bool is_found =
+        VisitSymbolDefinitionValue(symbol, [&](const leveldb::Slice &value) {
+          ok = st.ParseFromArray(value.data(), value.size());
+        });
+    if (is_found && !ok) {
+      LOG_ERROR << "ParseFromArray failed, project=" << name_
+                << " symbol=" << symbol;
+    }
+    return is_found && ok;
   }
 
-  return symutil::str_join(kSymdbKeyDelimiter, "file", "info", file_path);
+  return VisitSymbolDefinitions(
+      symbol, [&st](FileId file_id, uint32_t line, uint32_t column) {
+        auto *db_loc = st.add_locations();
+        db_loc->set_file_id(file_id);
+        db_loc->set_line(line);
+        db_loc->set_column(column);
+        return true;
+      });
 }
 
-std::string Project::MakeFileSymbolDefineKey(const fspath &file_path) const {
-  if (file_path.is_absolute()) {
-    return MakeFileSymbolDefineKey(filesystem::relative(file_path, home_path_));
+template <typename Fn>
+bool Project::VisitSymbolDefinitions(SymbolId symbol, Fn &&fn) const {
+  if (record_format_ == RecordFormat::kProtobuf) {
+    DB_SymbolDefinitionInfo st;
+    if (!GetSymbolDefinitionInfo(symbol, st)) {
+      return false;
+    }
+    for (const auto &db_loc : st.locations()) {
+      if (!fn(db_loc.file_id(), db_loc.line(), db_loc.column())) {
+        break;
+      }
+    }
+    return true;
   }
 
-  return symutil::str_join(kSymdbKeyDelimiter, "file", "symdef", file_path);
+  return VisitSymbolDefinitionValue(symbol, [&](const leveldb::Slice &value) {
+    flat::DefinitionView view;
+    if (!view.Init(value)) {
+      LOG_ERROR << "bad record, project=" << name_ << " symbol=" << symbol;
+      return;
+    }
+
+    FileId file_id = 0;
+    uint32_t line = 0, column = 0;
+    for (uint32_t i = 0; view.Get(i, file_id, line, column); ++i) {
+      if (!fn(file_id, line, column)) {
+        break;
+      }
+    }
+  });
 }
 
-std::string Project::MakeFileSymbolReferKey(const fspath &file_path) const {
-  if (file_path.is_absolute()) {
-    return MakeFileSymbolReferKey(filesystem::relative(file_path, home_path_));
+std::string Project::EncodeSymbolDefinitionInfo(
+    const DB_SymbolDefinitionInfo &st) const {
+  if (record_format_ == RecordFormat::kProtobuf) {
+    return st.SerializeAsString();
   }
 
-  return symutil::str_join(kSymdbKeyDelimiter, "file", "symref", file_path);
+  flat::RecordBuilder builder{flat::RecordKind::kDefinition,
+                              static_cast<uint32_t>(st.locations_size())};
+  for (const auto &db_loc : st.locations()) {
+    builder.StartEntry();
+    builder.PutVarint(db_loc.file_id());
+    builder.PutVarint(db_loc.line());
+    builder.PutVarint(db_loc.column());
+  }
+  return builder.Finish();
+}
+
+std::string Project::EncodeSymbolReferenceInfo(
+    const SymbolReferenceLocationMap &sym_locs) const {
+  if (record_format_ == RecordFormat::kProtobuf) {
+    DB_SymbolReferenceInfo db_info;
+    SerializeSymbolReferenceInfo(sym_locs, db_info);
+    return db_info.SerializeAsString();
+  }
+
+  flat::RecordBuilder builder{flat::RecordKind::kReference,
+                              static_cast<uint32_t>(sym_locs.size())};
+  for (const auto &kvp : sym_locs) {
+    builder.StartEntry();
+    builder.PutBytes(kvp.first);
+    builder.PutVarint(kvp.second.size());
+    FileId last_file_id = 0;
+    for (const auto &kvp2 : kvp.second) {
+      // The files are sorted by id.
+      builder.PutVarint(kvp2.first - last_file_id);
+      builder.PutLocations(kvp2.second);
+      last_file_id = kvp2.first;
+    }
+  }
+  return builder.Finish();
 }
 
-std::string Project::MakeSymbolDefineKey(const std::string &symbol_name) const {
-  return symutil::str_join(kSymdbKeyDelimiter, "symdef", symbol_name);
+std::string Project::EncodeFileReferenceInfo(
+    const FileSymbolReferenceMap &symbols) const {
+  if (record_format_ == RecordFormat::kFlat) {
+    flat::RecordBuilder builder{flat::RecordKind::kFileReference,
+                                static_cast<uint32_t>(symbols.size())};
+    for (const auto &kv : symbols) {
+      builder.StartEntry();
+      builder.PutVarint(kv.first.first);
+      builder.PutBytes(kv.first.second);
+      builder.PutLocations(kv.second);
+    }
+    return builder.Finish();
+  }
+
+  DB_FileReferenceInfo file_symbol_info;
+  file_symbol_info.mutable_symbols()->Reserve(symbols.size());
+  for (const auto &kv : symbols) {
+    auto item = file_symbol_info.add_symbols();
+    item->mutable_locations()->Reserve(kv.second.size());
+    item->set_symbol_id(kv.first.first);
+    item->set_module_name(kv.first.second);
+    for (const auto &loc : kv.second) {
+      auto *pb_loc = item->add_locations();
+      pb_loc->set_line(loc.first);
+      pb_loc->set_column(loc.second);
+    }
+  }
+  return file_symbol_info.SerializeAsString();
 }
 
-std::string Project::MakeSymbolReferKey(const std::string &symbol_name) const {
-  return symutil::str_join(kSymdbKeyDelimiter, "symref", symbol_name);
+bool Project::VisitEdges(EdgeKind kind, const std::string &symbol_name,
+                         bool is_forward, uint32_t max_depth,
+                         const EdgeVisitor &visitor) const {
+  SymbolId symbol = usr_table_.Find(symbol_name);
+  if (symbol == InternTable::kInvalidId) {
+    return false;
+  }
+  return VisitEdgeGraph(kind, symbol, is_forward, max_depth, visitor);
 }
 
-Location Project::GetSymbolLocation(const DB_SymbolDefinitionInfo &st,
-                                    const fspath &file_path) const {
-  std::string module_name = GetModuleName(file_path);
-  if (module_name.empty()) {
-    return Location{};
+bool Project::VisitIncludes(const fspath &path, bool is_forward,
+                            uint32_t max_depth,
+                            const EdgeVisitor &visitor) const {
+  FileId file = path_table_.Find(path);
+  if (file == PathTable::kInvalidId) {
+    return false;
   }
+  return VisitEdgeGraph(EdgeKind::kInclude, file, is_forward, max_depth,
+                        visitor);
+}
 
-  for (const auto &pb_loc : st.locations()) {
-    auto abs_path = symutil::absolute_path(home_path_, pb_loc.path());
-    if (!filesystem::exists(abs_path)) {
-      LOG_WARN << "file may be deleted! project=" << name_
-               << " path=" << pb_loc.path() << " abs_path=" << abs_path;
-      continue;
+bool Project::VisitEdgeGraph(EdgeKind kind, InternId start, bool is_forward,
+                             uint32_t max_depth,
+                             const EdgeVisitor &visitor) const {
+  const char *direction = is_forward ? kEdgeOut : kEdgeIn;
+
+  // Parse the leading number of str, and skip the delimiter after it.
+  auto parse_id = [](leveldb::Slice &str, uint32_t &id) {
+    size_t i = 0;
+    id = 0;
+    for (; i < str.size() && ::isdigit((unsigned char)str[i]); ++i) {
+      id = id * 10 + (str[i] - '0');
     }
-    auto pb_module_name = GetModuleName(pb_loc.path());
-    if (pb_module_name.empty()) {
-      LOG_WARN << "pb_module_name empty, project=" << name_
-               << " path=" << pb_loc.path();
-      continue;
-    }
-    if (module_name == pb_module_name) {
-      fspath rel_path(pb_loc.path());
-      fspath abs_path = symutil::absolute_path(rel_path, home_path_);
-      return Location{abs_path.string(), pb_loc.line(), pb_loc.column()};
+    str.remove_prefix(std::min(i + 1, str.size()));
+    return i > 0;
+  };
+
+  std::unordered_set<InternId> visited{start};
+  std::vector<InternId> level{start};
+  std::unique_ptr<leveldb::Iterator> it{
+      symbol_db_->NewIterator(leveldb::ReadOptions{})};
+
+  for (uint32_t depth = 1; depth <= max_depth && !level.empty(); ++depth) {
+    std::vector<InternId> next_level;
+    for (InternId from : level) {
+      const std::string prefix = symutil::str_join(
+          kSymdbKeyDelimiter, GetEdgeKindName(kind).edge, direction, from, "");
+
+      // The keys of the same edge are adjacent, one per file.
+      InternId last_to = InternTable::kInvalidId;
+      for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix);
+           it->Next()) {
+        leveldb::Slice rest = it->key();
+        rest.remove_prefix(prefix.size());
+
+        InternId to = 0;
+        if (!parse_id(rest, to) || to == last_to) {
+          continue;
+        }
+        last_to = to;
+
+        EdgeSite site{PathTable::kInvalidId, 0};
+        leveldb::Slice value = it->value();
+        (void)(parse_id(value, site.file) && parse_id(value, site.line));
+
+        bool is_continued = is_forward ? visitor(from, to, depth, site)
+                                       : visitor(to, from, depth, site);
+        if (!is_continued) {
+          return true;
+        }
+
+        if (visited.insert(to).second) {
+          next_level.push_back(to);
+        }
+      }
+
+      if (!it->status().ok()) {
+        LOG_ERROR << "iterate edges failed, project=" << name_
+                  << " error=" << it->status().ToString();
+        return false;
+      }
     }
+    level.swap(next_level);
+  }
+
+  return true;
+}
+
+bool Project::FindSymbolAtPosition(const fspath &path, uint32_t line,
+                                   uint32_t column, SymbolId &symbol) const {
+  bool is_found = false;
+  bool is_ok = VisitKeyValue(
+      MakeFilePositionKey(path), [&](const leveldb::Slice &value) {
+        PositionIndexView view;
+        SymbolPosition pos;
+        if (!view.Init(value)) {
+          LOG_ERROR << "bad position index, project=" << name_
+                    << " path=" << path;
+        } else if (view.Find(line, column, pos)) {
+          symbol = pos.symbol;
+          is_found = true;
+        }
+      });
+
+  return is_ok && is_found;
+}
+
+bool Project::LoadSymbolMetadata(SymbolId symbol,
+                                 SymbolMetadata &metadata) const {
+  DB_SymbolMetadata pb;
+  bool ok = true;
+  bool is_found = VisitKeyValue(
+      MakeSymbolMetadataKey(symbol), [&](const leveldb::Slice &value) {
+        ok = pb.ParseFromArray(value.data(), value.size());
+      });
+  if (!is_found) {
+    return false;
+  }
+  if (!ok) {
+    LOG_ERROR << "ParseFromArray failed, project=" << name_
+              << " symbol=" << symbol;
+    return false;
+  }
+
+  metadata.kind = pb.kind();
+  metadata.display_name = pb.display_name();
+  metadata.type = pb.type();
+  metadata.brief_comment = pb.brief_comment();
+  return true;
+}
+
+bool Project::LoadSymbolMetadata(const std::string &symbol_name,
+                                 SymbolMetadata &metadata) const {
+  SymbolId symbol = usr_table_.Find(symbol_name);
+  return symbol != InternTable::kInvalidId &&
+         LoadSymbolMetadata(symbol, metadata);
+}
+
+std::vector<Location> Project::QuerySymbolDefinition(
+    const std::string &symbol_name) const {
+  SymbolId symbol = usr_table_.Find(symbol_name);
+  if (symbol == InternTable::kInvalidId) {
+    LOG_ERROR << "symbol not interned, project=" << name_
+              << " symbol=" << symbol_name;
+    return std::vector<Location>{};
+  }
+
+  return QuerySymbolDefinition(symbol);
+}
+
+std::vector<Location> Project::QuerySymbolDefinition(SymbolId symbol) const {
+  std::vector<Location> locations;
+
+  bool ok = VisitSymbolDefinitions(
+      symbol, [&](FileId file_id, uint32_t line, uint32_t column) {
+        locations.push_back(MakeLocation(file_id, line, column));
+        return true;
+      });
+  if (!ok) {
+    LOG_ERROR << "VisitSymbolDefinitions failed, project=" << name_
+              << " symbol=" << symbol;
+  }
+
+  return locations;
+}
+
+// A symbol may appear more than once. Get the one match abs_path or the first
+// one if there's none.
+Location Project::QuerySymbolDefinition(const std::string &symbol_name,
+                                        const fspath &abs_path) const {
+  SymbolId symbol = usr_table_.Find(symbol_name);
+  if (symbol == InternTable::kInvalidId) {
+    return Location{};
   }
 
-  return Location{};
+  return QuerySymbolDefinition(symbol, abs_path);
+}
+
+// Without a definition in the module of abs_path, the first one is returned,
+// the same as locations(0) of DB_SymbolDefinitionInfo before.
+Location Project::QuerySymbolDefinition(SymbolId symbol,
+                                        const fspath &abs_path) const {
+  std::string module_name = GetModuleName(abs_path);
+
+  Location location;
+  bool is_first = true;
+  VisitSymbolDefinitions(
+      symbol, [&](FileId file_id, uint32_t line, uint32_t column) {
+        bool is_matched = false;
+        if (!module_name.empty()) {
+          auto rel_path = path_table_.RelativePath(file_id);
+          is_matched = GetModuleName(rel_path) == module_name;
+          // Only the matched one is checked, the paths are lexical.
+          if (is_matched &&
+              !filesystem::exists(path_table_.AbsolutePath(file_id))) {
+            LOG_WARN << "file may be deleted! project=" << name_
+                     << " path=" << rel_path;
+            is_matched = false;
+          }
+        }
+        if (is_first || is_matched) {
+          location = MakeLocation(file_id, line, column);
+          is_first = false;
+        }
+        return !is_matched;
+      });
+
+  return location;
+}
+
+std::string Project::MakeFileInfoKey(const fspath &file_path) const {
+  return symutil::str_join(kSymdbKeyDelimiter, "file", "info",
+                           path_table_.ToRelative(file_path));
+}
+
+std::string Project::MakeFileSymbolDefineKey(const fspath &file_path) const {
+  return symutil::str_join(kSymdbKeyDelimiter, "file", "symdef",
+                           path_table_.ToRelative(file_path));
+}
+
+std::string Project::MakeFileSymbolReferKey(const fspath &file_path) const {
+  return symutil::str_join(kSymdbKeyDelimiter, "file", "symref",
+                           path_table_.ToRelative(file_path));
+}
+
+std::string Project::MakeFilePositionKey(const fspath &file_path) const {
+  return symutil::str_join(kSymdbKeyDelimiter, "file", "sympos",
+                           path_table_.ToRelative(file_path));
+}
+
+std::string Project::MakeHeaderMacroKey(const fspath &file_path) const {
+  return symutil::str_join(kSymdbKeyDelimiter, "file", "macro",
+                           path_table_.ToRelative(file_path));
+}
+
+std::string Project::MakeFileEdgeKey(EdgeKind kind,
+                                     const fspath &file_path) const {
+  return symutil::str_join(kSymdbKeyDelimiter, "file",
+                           GetEdgeKindName(kind).file,
+                           path_table_.ToRelative(file_path));
+}
+
+std::string Project::MakeEdgeKey(EdgeKind kind, const char *direction,
+                                 InternId from, InternId to,
+                                 FileId file) const {
+  return symutil::str_join(kSymdbKeyDelimiter, GetEdgeKindName(kind).edge,
+                           direction, from, to, file);
+}
+
+std::string Project::MakeSymbolDefineKey(SymbolId symbol) const {
+  return symutil::str_join(kSymdbKeyDelimiter, "symdef", symbol);
+}
+
+std::string Project::MakeSymbolNameKey(SymbolId symbol) const {
+  return symutil::str_join(kSymdbKeyDelimiter, "symname", symbol);
+}
+
+std::string Project::MakeSymbolMetadataKey(SymbolId symbol) const {
+  return symutil::str_join(kSymdbKeyDelimiter, "symmeta", symbol);
+}
+
+std::string Project::MakeSymbolReferKey(SymbolId symbol) const {
+  return symutil::str_join(kSymdbKeyDelimiter, "symref", symbol);
+}
+
+Location Project::MakeLocation(FileId file, uint32_t line,
+                               uint32_t column) const {
+  fspath abs_path = path_table_.AbsolutePath(file);
+  if (abs_path.empty()) {
+    return Location{};
+  }
+  return Location{abs_path.string(), line, column};
 }
 
 bool Project::LoadKey(const std::string &key, std::string &value) const {
   leveldb::ReadOptions options;
-  options.fill_cache = false;
+  options.fill_cache = true;
   leveldb::Status s = symbol_db_->Get(options, key, &value);
   if (!s.ok() && !s.IsNotFound()) {
     LOG_ERROR << "LevelDB::Get failed, key=" << key
@@ -912,6 +1921,17 @@ bool Project::LoadKey(const std::string &key, std::string &value) const {
   return s.ok();
 }
 
+template <typename Fn>
+bool Project::VisitKeyValue(const std::string &key, Fn &&fn) const {
+  ValueBuffer buffer;
+  if (!LoadKey(key, buffer.get())) {
+    return false;
+  }
+
+  fn(leveldb::Slice{buffer.get()});
+  return true;
+}
+
 template <typename PBType>
 bool Project::LoadKeyPBValue(const std::string &key, PBType &pb) const {
   std::string value;
@@ -943,15 +1963,70 @@ bool Project::PutSingleKey(const std::string &key, const std::string &value) {
 }
 
 std::string Project::GetModuleName(const fspath &path) const {
-  if (!path.is_absolute()) {
-    fspath abs_path = symutil::absolute_path(path, home_path_);
-    return GetModuleName(abs_path);
+  return flag_cache_.GetModuleName(path);
+}
+
+void Project::HandleFileEvents(const std::vector<const FileEvent *> &events) {
+  FsPathVec lexical_paths;
+  for (const auto *event : events) {
+    try {
+      // They're watched by the files, so the events have no name.
+      if (HandleCompileDbEvent(event->wd, event->mask)) {
+        continue;
+      }
+
+      // An earlier event may have removed the directory.
+      if (watchers_.find(event->wd) == watchers_.end()) {
+        continue;
+      }
+
+      // The watched directory itself, which has no name.
+      if (event->mask & IN_DELETE_SELF) {
+        HandleWatchedDirDeleted(event->wd);
+        continue;
+      }
+
+      if (event->name.empty()) {
+        LOG_WARN << "event=" << event->mask << ", watch_fd=" << event->wd;
+        continue;
+      }
+
+      std::string name{event->name};
+      bool is_dir = !!(event->mask & IN_ISDIR);
+      if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        HandleEntryCreate(event->wd, is_dir, name, lexical_paths);
+      }
+
+      if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE)) {
+        HandleFileModified(event->wd, name, lexical_paths);
+      }
+
+      if (event->mask & IN_DELETE) {
+        HandleEntryDeleted(event->wd, is_dir, name);
+      }
+    } catch (const std::exception &e) {
+      LOG_ERROR << "exception: " << e.what() << " project=" << name_;
+    }
   }
 
-  return flag_cache_.GetModuleName(path);
+  if (lexical_paths.empty()) {
+    return;
+  }
+
+  // A file is mostly modified by several events in a row.
+  std::sort(lexical_paths.begin(), lexical_paths.end());
+  lexical_paths.erase(std::unique(lexical_paths.begin(), lexical_paths.end()),
+                      lexical_paths.end());
+  UpdateLexicalIndexes(lexical_paths);
 }
 
-void Project::HandleEntryCreate(int wd, bool is_dir, const std::string &path) {
+void Project::HandleEventsLost() {
+  // Rescan the directories, and rebuild the files modified since.
+  ForceSync();
+}
+
+void Project::HandleEntryCreate(int wd, bool is_dir, const std::string &path,
+                                FsPathVec &lexical_paths) {
   auto it = watchers_.find(wd);
   assert(it != watchers_.end());
   assert(path.front() != '/');
@@ -977,9 +2052,13 @@ void Project::HandleEntryCreate(int wd, bool is_dir, const std::string &path) {
     abs_src_paths_.insert(fs_path);
     modified_files_.push_back(fs_path);
   }
+  if (symutil::is_cpp_ext(ext) && !IsFileExcluded(fs_path)) {
+    lexical_paths.push_back(fs_path);
+  }
 }
 
-void Project::HandleFileModified(int wd, const std::string &path) {
+void Project::HandleFileModified(int wd, const std::string &path,
+                                 FsPathVec &lexical_paths) {
   auto it = watchers_.find(wd);
   assert(it != watchers_.end());
   assert(path.front() != '/');
@@ -993,13 +2072,17 @@ void Project::HandleFileModified(int wd, const std::string &path) {
     return;
   }
 
-  if (filesystem::equivalent(config_->cmake_file(), fs_path)) {
+  if (config_->compile_db_provider() == CompileDbProvider::kCmake &&
+      filesystem::equivalent(config_->cmake_file(), fs_path)) {
     ForceSync();
   } else {
     auto ext = fs_path.extension().string();
     if (symutil::is_cpp_source_ext(ext)) {
       modified_files_.push_back(fs_path);
     }
+    if (symutil::is_cpp_ext(ext) && !IsFileExcluded(fs_path)) {
+      lexical_paths.push_back(fs_path);
+    }
   }
 }
 
@@ -1015,6 +2098,8 @@ void Project::HandleEntryDeleted(int wd, bool is_dir, const std::string &path) {
   }
 
   if (!is_dir) {
+    text_index_.Remove(fs_path);
+    provisional_defs_.Remove(fs_path);
     DeleteUnexistFile(fs_path);
     return;
   }
@@ -1035,10 +2120,9 @@ void Project::HandleEntryDeleted(int wd, bool is_dir, const std::string &path) {
   }
 }
 
-void Project::HandleWatchedDirDeleted(int wd, const std::string &path) {
+void Project::HandleWatchedDirDeleted(int wd) {
   auto it = watchers_.find(wd);
   assert(it != watchers_.end());
-  assert(path.front() != '/');
 
   const auto &fs_path = it->second->abs_path();
   LOG_DEBUG << "project=" << name_ << " wd=" << wd << " path=" << fs_path;
@@ -1090,23 +2174,350 @@ void Project::StartForceSyncTimer() {
 }
 
 void Project::ForceSync() {
-  FsPathSet old_abs_paths(std::move(abs_src_paths_));
+  // The cmake files may change again while syncing, which is picked up by
+  // another sync after this one.
+  if (is_syncing_) {
+    is_sync_pending_ = true;
+    return;
+  }
+
+  is_syncing_ = true;
+  ServerInst.PostToWorker(std::bind(&Project::HashCompileDbInputs,
+                                    shared_from_this(), config_));
+}
+
+void Project::HashCompileDbInputs(std::shared_ptr<ProjectConfig> config) {
+  assert(!ServerInst.IsInMainThread());
+
+  std::string hash = CompilerFlagCache::HashInputs(*config);
+  ServerInst.PostToMain(std::bind(&Project::UpdateCompileDbIfChanged,
+                                  shared_from_this(), hash));
+}
 
+void Project::LoadCompilerFlags(fspath home_path,
+                                std::shared_ptr<ProjectConfig> config) {
+  assert(!ServerInst.IsInMainThread());
+
+  CompilerFlagCache::FlagStatePtr state;
   try {
-    flag_cache_.Rebuild(config_->cmake_file(), config_->build_path(),
-                        abs_src_paths_);
-    UpdateWatchDirs();
-    for (const auto &abs_path : old_abs_paths) {
-      if (abs_src_paths_.find(abs_path) == abs_src_paths_.end()) {
-        DeleteUnexistFile(abs_path);
-      }
+    state = flag_cache_.Load(home_path, *config);
+  } catch (const std::exception &e) {
+    LOG_ERROR << "exception: " << e.what() << " project=" << name_;
+  }
+
+  // Of the inputs just loaded, e.g. by cmake
+  std::string hash;
+  if (state) {
+    hash = CompilerFlagCache::HashInputs(*config);
+  }
+  ServerInst.PostToMain(std::bind(&Project::ApplyCompilerFlags,
+                                  shared_from_this(), state, hash));
+}
+
+void Project::UpdateCompileDbIfChanged(std::string hash) {
+  assert(ServerInst.IsInMainThread());
+
+  std::string saved_hash;
+  if (!hash.empty() && LoadKey(kSymdbCompileDbHashKey, saved_hash) &&
+      saved_hash == hash) {
+    LOG_INFO << "compile database inputs unchanged, project=" << name_;
+    if (flag_cache_.is_loaded()) {
+      SyncFiles();
+    } else {
+      OnCompileDbUpdated(true);
+    }
+    return;
+  }
+
+  // The others are generated by the tools we don't know.
+  if (config_->compile_db_provider() != CompileDbProvider::kCmake) {
+    OnCompileDbUpdated(true);
+    return;
+  }
+
+  try {
+    flag_cache_.RunCmake(
+        config_->cmake_file(), config_->build_path(),
+        std::bind(&Project::OnCompileDbUpdated, shared_from_this(),
+                  std::placeholders::_1));
+  } catch (const std::exception &e) {
+    LOG_ERROR << "exception: " << e.what() << " project=" << name_;
+    SyncFiles();
+  }
+}
+
+void Project::OnCompileDbUpdated(bool ok) {
+  if (!ok) {
+    // Keep the old flags.
+    SyncFiles();
+    return;
+  }
+
+  ServerInst.PostToWorker(std::bind(&Project::LoadCompilerFlags,
+                                    shared_from_this(), home_path_, config_));
+}
+
+void Project::ApplyCompilerFlags(CompilerFlagCache::FlagStatePtr state,
+                                 std::string hash) {
+  assert(ServerInst.IsInMainThread());
+
+  if (!state) {
+    SyncFiles();
+    return;
+  }
+
+  FsPathSet old_abs_paths(std::move(abs_src_paths_));
+  flag_cache_.Swap(*state, abs_src_paths_);
+  if (!hash.empty()) {
+    (void)PutSingleKey(kSymdbCompileDbHashKey, hash);
+  }
+
+  LOG_INFO << "project=" << name_ << " sources=" << abs_src_paths_.size();
+
+  for (const auto &abs_path : old_abs_paths) {
+    if (abs_src_paths_.find(abs_path) == abs_src_paths_.end()) {
+      DeleteUnexistFile(abs_path);
     }
+  }
+
+  SyncFiles();
+}
+
+void Project::SyncFiles() {
+  try {
+    // The headers are found by the same walk.
+    FsPathVec header_paths;
+    FsPathSet watch_dirs = GetWatchDirs(header_paths);
+    UpdateWatchDirs(watch_dirs);
+    WatchCompileDbFiles();
+    // Before Build(), so the text and the provisional definitions are ready
+    // long before the symbols.
+    BuildLexicalIndexes(header_paths);
 
     Build();
     modified_files_.clear();
   } catch (const std::exception &e) {
     LOG_ERROR << "exception: " << e.what() << " project=" << name_;
   }
+
+  is_syncing_ = false;
+  if (is_sync_pending_) {
+    is_sync_pending_ = false;
+    ForceSync();
+  }
+}
+
+fspath Project::GetFrozenSymbolTablePath() const {
+  fspath path{ConfigInst.db_path()};
+  path /= name_ + ".ldb";
+  path /= kFrozenSymbolTableFile;
+  return path;
+}
+
+bool Project::LoadFrozenSymbolTable() {
+  if (!frozen_symdefs_.Open(GetFrozenSymbolTablePath())) {
+    return false;
+  }
+
+  symdef_delta_.clear();
+
+  const std::string prefix = symutil::str_join(kSymdbKeyDelimiter, "symdef", "");
+  std::unique_ptr<leveldb::Iterator> it{
+      symbol_db_->NewIterator(leveldb::ReadOptions{})};
+  for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix);
+       it->Next()) {
+    auto id_str = it->key().ToString().substr(prefix.size());
+    symdef_delta_.insert(std::strtoul(id_str.c_str(), nullptr, 10));
+  }
+
+  LOG_INFO << "project=" << name_ << " frozen_symbols=" << frozen_symdefs_.size()
+           << " symdef_delta=" << symdef_delta_.size();
+  return it->status().ok();
+}
+
+bool Project::LoadSymbolNames() {
+  symbol_names_.Clear();
+
+  const std::string prefix =
+      symutil::str_join(kSymdbKeyDelimiter, "symname", "");
+  std::unique_ptr<leveldb::Iterator> it{
+      symbol_db_->NewIterator(leveldb::ReadOptions{})};
+  for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix);
+       it->Next()) {
+    auto id_str = it->key().ToString().substr(prefix.size());
+    symbol_names_.Add(std::strtoul(id_str.c_str(), nullptr, 10),
+                      it->value().ToString());
+  }
+  symbol_names_.Compact();
+
+  LOG_INFO << "project=" << name_ << " symbol_names=" << symbol_names_.size();
+  return it->status().ok();
+}
+
+void Project::MarkSymbolDefinitionChanged(SymbolId symbol) {
+  symdef_delta_.insert(symbol);
+  if (is_freezing_symdefs_) {
+    symdef_changed_in_freeze_.insert(symbol);
+  }
+}
+
+void Project::TryFreezeSymbolDefinitions() {
+  assert(ServerInst.IsInMainThread());
+
+  if (is_freezing_symdefs_) {
+    return;
+  }
+
+  size_t threshold = std::max(kMinSymdefDeltaToFreeze,
+                              frozen_symdefs_.size() / kSymdefDeltaRatioToFreeze);
+  if (symdef_delta_.size() < threshold) {
+    return;
+  }
+
+  is_freezing_symdefs_ = true;
+  symdef_changed_in_freeze_.clear();
+  ServerInst.PostToWorker(std::bind(&Project::FreezeSymbolDefinitions,
+                                    shared_from_this(),
+                                    ++symdef_freeze_generation_,
+                                    symbol_db_->GetSnapshot()));
+}
+
+void Project::FreezeSymbolDefinitions(uint64_t generation,
+                                      const leveldb::Snapshot *snapshot) {
+  assert(!ServerInst.IsInMainThread());
+
+  auto merged = std::make_shared<std::vector<SymbolId>>();
+  bool is_written = false;
+
+  // Run once, so that the snapshot is released on every return.
+  do {
+    // The delta may be stale, so it's read from the database.
+    std::map<SymbolId, std::string> delta;
+    const std::string prefix =
+        symutil::str_join(kSymdbKeyDelimiter, "symdef", "");
+    leveldb::ReadOptions read_options;
+    read_options.snapshot = snapshot;
+    read_options.fill_cache = false;
+    std::unique_ptr<leveldb::Iterator> it{
+        symbol_db_->NewIterator(read_options)};
+    for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix);
+         it->Next()) {
+      auto id_str = it->key().ToString().substr(prefix.size());
+      delta[std::strtoul(id_str.c_str(), nullptr, 10)] = it->value().ToString();
+    }
+    if (!it->status().ok()) {
+      LOG_ERROR << "iterate symdef failed, project=" << name_
+                << " error=" << it->status().ToString();
+      break;
+    }
+    it.reset();
+
+    // The one of the main thread is only replaced after this file is.
+    auto path = GetFrozenSymbolTablePath();
+    FrozenSymbolTable frozen;
+    if (!frozen.Open(path)) {
+      LOG_ERROR << "open failed, project=" << name_ << " path=" << path;
+      break;
+    }
+
+    std::vector<FrozenSymbolTable::Entry> entries;
+    entries.reserve(frozen.size() + delta.size());
+
+    auto dit = delta.begin();
+    auto add_delta =
+        [&entries](const std::pair<const SymbolId, std::string> &kv) {
+          // Drop the deleted ones.
+          if (!kv.second.empty()) {
+            entries.emplace_back(kv.first, leveldb::Slice{kv.second});
+          }
+        };
+
+    for (uint32_t i = 0; i < frozen.size(); ++i) {
+      auto entry = frozen.Get(i);
+      for (; dit != delta.end() && dit->first < entry.first; ++dit) {
+        add_delta(*dit);
+      }
+      if (dit != delta.end() && dit->first == entry.first) {
+        add_delta(*dit++);
+      } else {
+        entries.push_back(entry);
+      }
+    }
+    for (; dit != delta.end(); ++dit) {
+      add_delta(*dit);
+    }
+
+    if (!FrozenSymbolTable::Write(path, entries)) {
+      LOG_ERROR << "freeze failed, project=" << name_ << " path=" << path;
+      break;
+    }
+
+    merged->reserve(delta.size());
+    for (const auto &kv : delta) {
+      merged->push_back(kv.first);
+    }
+    is_written = true;
+  } while (false);
+
+  symbol_db_->ReleaseSnapshot(snapshot);
+
+  ServerInst.PostToMain(std::bind(&Project::ApplyFrozenSymbolTable,
+                                  shared_from_this(), generation, is_written,
+                                  merged));
+}
+
+void Project::ApplyFrozenSymbolTable(
+    uint64_t generation, bool is_written,
+    std::shared_ptr<std::vector<SymbolId>> merged) {
+  assert(ServerInst.IsInMainThread());
+
+  if (generation != symdef_freeze_generation_) {
+    return;
+  }
+
+  is_freezing_symdefs_ = false;
+  std::unordered_set<SymbolId> changed;
+  changed.swap(symdef_changed_in_freeze_);
+  if (!is_written) {
+    return;
+  }
+
+  // The delta keys are kept for the next freeze, which rewrites the file.
+  auto path = GetFrozenSymbolTablePath();
+  if (!frozen_symdefs_.Open(path)) {
+    LOG_ERROR << "open frozen table failed, project=" << name_
+              << " path=" << path;
+    return;
+  }
+
+  // Crashing before the keys are deleted does no harm, they would be merged
+  // into the table again. The ones changed after the snapshot are newer than
+  // the table.
+  leveldb::WriteBatch batch;
+  std::vector<SymbolId> deleted;
+  deleted.reserve(merged->size());
+  for (SymbolId symbol : *merged) {
+    if (changed.find(symbol) == changed.end()) {
+      batch.Delete(MakeSymbolDefineKey(symbol));
+      deleted.push_back(symbol);
+    }
+  }
+  leveldb::WriteOptions write_options;
+  write_options.sync = true;
+  leveldb::Status s = symbol_db_->Write(write_options, &batch);
+  if (!s.ok()) {
+    LOG_ERROR << "failed to write, error=" << s.ToString()
+              << " project=" << name_;
+    return;
+  }
+
+  for (SymbolId symbol : deleted) {
+    symdef_delta_.erase(symbol);
+  }
+
+  LOG_INFO << "project=" << name_ << " frozen_symbols=" << frozen_symdefs_.size()
+           << " merged=" << merged->size()
+           << " symdef_delta=" << symdef_delta_.size();
 }
 
 void Project::StartSmartSyncTimer() {
@@ -1114,11 +2525,81 @@ void Project::StartSmartSyncTimer() {
   smart_sync_timer_.async_wait([this](const boost::system::error_code &ec) {
     if (!ec) {
       this->SmartSync();
+      // For the databases generated after the last try.
+      if (config_ &&
+          compile_db_watchers_.size() < config_->compile_db_files().size()) {
+        WatchCompileDbFiles();
+      }
       StartSmartSyncTimer();
     }
   });
 }
 
+void Project::WatchCompileDbFiles() {
+  if (!config_->is_enable_file_watch() ||
+      config_->compile_db_provider() == CompileDbProvider::kCmake) {
+    return;
+  }
+
+  FsPathSet watched_files;
+  for (const auto &kvp : compile_db_watchers_) {
+    watched_files.insert(kvp.second->abs_path());
+  }
+
+  bool is_added = false;
+  for (const auto &path : config_->compile_db_files()) {
+    if (watched_files.find(path) != watched_files.end()) {
+      continue;
+    }
+
+    try {
+      // The generators mostly replace it by a rename.
+      WatcherPtr watcher{new ProjectFileWatcher{
+          this, path, IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF}};
+      compile_db_watchers_[watcher->fd()] = std::move(watcher);
+      is_added = true;
+      LOG_INFO << "project=" << name_ << " watch_compile_db=" << path;
+    } catch (const std::exception &e) {
+      LOG_DEBUG << "exception: " << e.what() << " project=" << name_
+                << " compile_db=" << path;
+    }
+  }
+
+  // It may be written after the last load and before it's watched.
+  if (is_added && flag_cache_.is_loaded()) {
+    StartCompileDbReloadTimer();
+  }
+}
+
+bool Project::HandleCompileDbEvent(int wd, uint32_t mask) {
+  auto it = compile_db_watchers_.find(wd);
+  if (it == compile_db_watchers_.end()) {
+    return false;
+  }
+
+  LOG_DEBUG << "project=" << name_ << " event=" << mask
+            << " compile_db=" << it->second->abs_path();
+
+  // The new file is watched again by the reload.
+  if (mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+    compile_db_watchers_.erase(it);
+  }
+
+  StartCompileDbReloadTimer();
+  return true;
+}
+
+void Project::StartCompileDbReloadTimer() {
+  compile_db_reload_timer_.expires_from_now(boost::posix_time::seconds(1));
+  compile_db_reload_timer_.async_wait(
+      [this](const boost::system::error_code &ec) {
+        if (!ec) {
+          LOG_INFO << "compile database changed, project=" << name_;
+          ForceSync();
+        }
+      });
+}
+
 void Project::SmartSync() {
   std::sort(modified_files_.begin(), modified_files_.end());
   auto uq_it = std::unique(modified_files_.begin(), modified_files_.end());
@@ -1147,12 +2628,16 @@ void Project::DeleteUnexistFile(const fspath &deleted_path) {
   LOG_INFO << "project=" << name_ << " deleted_path=" << deleted_path;
 
   if (abs_src_paths_.erase(deleted_path) == 0) {
-    LOG_INFO << "path is not added, project=" << name_
-             << " path=" << deleted_path;
+    // A header only has the macros.
+    BatchWriter batch{this};
+    if (!DeleteHeaderMacros(path_table_.ToRelative(deleted_path), batch)) {
+      LOG_INFO << "path is not added, project=" << name_
+               << " path=" << deleted_path;
+    }
     return;
   }
 
-  fspath relative_path = filesystem::relative(deleted_path, home_path_);
+  fspath relative_path = path_table_.ToRelative(deleted_path);
   in_parsing_files_.erase(relative_path);
 
   BatchWriter batch{this};
@@ -1161,10 +2646,30 @@ void Project::DeleteUnexistFile(const fspath &deleted_path) {
 
   DeleteFileDefinedSymbolInfo(relative_path, batch);
   DeleteFileReferredSymbolInfo(relative_path, batch);
+  batch.Delete(MakeFilePositionKey(relative_path));
+  for (EdgeKind kind : {EdgeKind::kCall, EdgeKind::kDerive,
+                        EdgeKind::kOverride, EdgeKind::kInclude}) {
+    DeleteFileEdges(kind, relative_path, batch);
+  }
 
   batch.WriteSrcPath();
 }
 
+bool Project::DeleteHeaderMacros(const fspath &relative_path,
+                                 BatchWriter &writer) const {
+  auto key = MakeHeaderMacroKey(relative_path);
+  DB_HeaderMacroInfo info;
+  if (!LoadKeyPBValue(key, info)) {
+    return false;
+  }
+
+  for (SymbolId symbol : info.symbol_ids()) {
+    writer.DeleteSymbol(symbol);
+  }
+  writer.Delete(key);
+  return true;
+}
+
 void Project::DeleteFileDefinedSymbolInfo(const fspath &relative_path,
                                           BatchWriter &writer) const {
   std::string file_symbol_key = MakeFileSymbolDefineKey(relative_path);
@@ -1177,7 +2682,7 @@ void Project::DeleteFileDefinedSymbolInfo(const fspath &relative_path,
   }
 
   std::string module_name = GetModuleName(relative_path);
-  for (const auto &symbol : db_fs_info.symbols()) {
+  for (SymbolId symbol : db_fs_info.symbol_ids()) {
     DB_SymbolDefinitionInfo db_info;
     if (!GetSymbolDefinitionInfo(symbol, db_info)) {
       LOG_ERROR << "GetSymbolDefinitionInfo failed, project=" << name_
@@ -1197,11 +2702,13 @@ void Project::DeleteFileReferredSymbolInfo(const fspath &relative_path,
   FileSymbolReferenceMap old_symbols;
   (void)LoadFileReferredSymbolInfo(relative_path, old_symbols);
 
+  FileId file_id = path_table_.Find(relative_path);
+
   for (const auto &kvp : old_symbols) {
     SymbolReferenceLocationMap sym_locs;
-    const auto &sym_name = kvp.first.first;
+    SymbolId sym_id = kvp.first.first;
     const auto &mod_name = kvp.first.second;
-    if (!LoadSymbolReferenceInfo(sym_name, sym_locs)) {
+    if (!LoadSymbolReferenceInfo(sym_id, sym_locs)) {
       continue;
     }
     auto it = sym_locs.find(mod_name);
@@ -1209,11 +2716,11 @@ void Project::DeleteFileReferredSymbolInfo(const fspath &relative_path,
       continue;
     }
 
-    if (!it->second.erase(relative_path)) {
+    if (!it->second.erase(file_id)) {
       continue;
     }
 
-    auto symbol_key = MakeSymbolReferKey(sym_name);
+    auto symbol_key = MakeSymbolReferKey(sym_id);
     if (it->second.empty()) {
       sym_locs.erase(it);
       if (sym_locs.empty()) {
@@ -1222,29 +2729,24 @@ void Project::DeleteFileReferredSymbolInfo(const fspath &relative_path,
       }
     }
 
-    DB_SymbolReferenceInfo db_info;
-    db_info.mutable_items()->Reserve(sym_locs.size());
-    for (const auto &kvp : sym_locs) {
-      auto *item = db_info.add_items();
-      item->set_module_name(kvp.first);
-      item->mutable_path_locs()->Reserve(kvp.second.size());
-      for (const auto &kvp2 : kvp.second) {
-        auto *path_loc = item->add_path_locs();
-        path_loc->set_path(kvp2.first.string());
-        path_loc->mutable_locations()->Reserve(kvp2.second.size());
-        for (const auto &loc : kvp2.second) {
-          auto *pb_loc = path_loc->add_locations();
-          pb_loc->set_line(loc.first);
-          pb_loc->set_column(loc.second);
-        }
-      }
-    }
-    writer.Put(symbol_key, db_info);
+    writer.Put(symbol_key, EncodeSymbolReferenceInfo(sym_locs));
   }
 }
 
-bool Project::IsWatchFdInList(int file_wd) const {
-  return watchers_.find(file_wd) != watchers_.end();
+void Project::DeleteFileEdges(EdgeKind kind, const fspath &relative_path,
+                              BatchWriter &writer) const {
+  EdgeSiteMap edges;
+  if (!LoadFileEdges(kind, relative_path, edges)) {
+    return;
+  }
+
+  FileId file_id = path_table_.Find(relative_path);
+  for (const auto &kv : edges) {
+    const auto &edge = kv.first;
+    writer.Delete(MakeEdgeKey(kind, kEdgeOut, edge.first, edge.second, file_id));
+    writer.Delete(MakeEdgeKey(kind, kEdgeIn, edge.second, edge.first, file_id));
+  }
+  writer.Delete(MakeFileEdgeKey(kind, relative_path));
 }
 
 void Project::AddSymbolLocation(DB_SymbolDefinitionInfo &db_info,
@@ -1252,25 +2754,30 @@ void Project::AddSymbolLocation(DB_SymbolDefinitionInfo &db_info,
                                 const Location &location) {
   assert(location.IsValid());
 
+  auto serialize = [&](DB_SymbolLocation &db_loc) {
+    db_loc.set_file_id(path_table_.Intern(location.filename()));
+    db_loc.set_line(location.line_number());
+    db_loc.set_column(location.column_number());
+  };
+
   auto locations = db_info.mutable_locations();
   for (auto it = locations->begin(); it != locations->end(); ++it) {
-    auto pb_module_name = GetModuleName(it->path());
-    if (module_name == pb_module_name) {
-      location.Serialize(*it);
+    auto db_module_name = GetModuleName(path_table_.RelativePath(it->file_id()));
+    if (module_name == db_module_name) {
+      serialize(*it);
       return;
     }
   }
 
-  auto *pb_loc = db_info.add_locations();
-  location.Serialize(*pb_loc);
+  serialize(*db_info.add_locations());
 }
 
 bool Project::RemoveSymbolLocation(DB_SymbolDefinitionInfo &db_info,
                                    const std::string &module_name) const {
   auto locations = db_info.mutable_locations();
   for (auto it = locations->begin(); it != locations->end(); ++it) {
-    auto pb_module_name = GetModuleName(it->path());
-    if (module_name == pb_module_name) {
+    auto db_module_name = GetModuleName(path_table_.RelativePath(it->file_id()));
+    if (module_name == db_module_name) {
       locations->erase(it);
       return true;
     }
@@ -1293,6 +2800,7 @@ void Project::RestoreConfig() {
   config_ = std::make_shared<ProjectConfig>(name_.c_str(), home_path_.string());
   config_->is_enable_file_watch(true);
   config_->UseDefaultBuildPath();
+  ConfigInst.AddGlobalExcludePatterns(*config_);
 }
 
 }  // namespace symdb
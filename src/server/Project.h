@@ -2,7 +2,10 @@
 #define PROJECT_H_LCSDWOGL
 
 #include <clang-c/Index.h>
+#include <leveldb/cache.h>
 #include <leveldb/db.h>
+#include <leveldb/filter_policy.h>
+#include <functional>
 #include <memory>
 #include <set>
 #include <string>
@@ -11,22 +14,53 @@
 #include <vector>
 #include "util/TypeAlias.h"
 #include "CompilerFlagCache.h"
+#include "FrozenSymbolTable.h"
+#include "InternTable.h"
+#include "PathTable.h"
+#include "ProvisionalIndex.h"
+#include "SymbolNameIndex.h"
+#include "TextIndex.h"
 #include "TranslationUnit.h"
 
 namespace symdb {
 
 using SmartLevelDBPtr = std::unique_ptr<leveldb::DB>;
+using SmartLevelDBCachePtr = std::unique_ptr<leveldb::Cache>;
+using SmartFilterPolicyPtr = std::unique_ptr<const leveldb::FilterPolicy>;
 using SmartCXIndex = ::RawPointerWrap<CXIndex>;
 using TranslationUnitPtr = std::shared_ptr<TranslationUnit>;
 using LineColPairSet = std::set<LineColPair>;
-using SymbolModulePair = std::pair<std::string, std::string>;
+using SymbolId = InternId;
+using SymbolIdLocationMap = std::map<SymbolId, Location>;
+using SymbolModulePair = std::pair<SymbolId, std::string>;
 using FileSymbolReferenceMap = std::map<SymbolModulePair, LineColPairSet>;
-using PathLocPairSetMap = std::map<fspath, LineColPairSet>;
+using PathLocPairSetMap = std::map<FileId, LineColPairSet>;
 using SymbolReferenceLocationMap = std::map<std::string, PathLocPairSetMap>;
+// The relations between the symbols or files, from -> to
+enum class EdgeKind {
+  kCall,      // caller -> callee
+  kDerive,    // base -> derived
+  kOverride,  // overridden -> overrider
+  kInclude,   // includer -> included, of FileId
+};
+
+// Where an edge is found
+struct EdgeSite {
+  FileId file;
+  uint32_t line;
+
+  bool operator==(const EdgeSite &other) const {
+    return file == other.file && line == other.line;
+  }
+};
+
+using EdgeSiteMap = std::map<std::pair<InternId, InternId>, EdgeSite>;
 
 class DB_SymbolDefinitionInfo;
 class BatchWriter;
 class ProjectConfig;
+struct FileEvent;
+enum class RecordFormat;
 
 struct ProjectFileInfo {
   time_t last_mtime;
@@ -38,9 +72,13 @@ struct CompiledFileInfo {
   time_t last_mtime;  // the last_mtime when the file is compiled
 };
 
+class Project;
+
 class ProjectFileWatcher {
 public:
-  explicit ProjectFileWatcher(const fspath &path);
+  // A directory, for its entries
+  ProjectFileWatcher(Project *project, const fspath &path);
+  ProjectFileWatcher(Project *project, const fspath &path, uint32_t mask);
   ProjectFileWatcher(const ProjectFileWatcher &) = delete;
 
   ~ProjectFileWatcher();
@@ -49,13 +87,13 @@ public:
   int fd() const { return fd_; }
 
 private:
+  Project *project_;
   fspath abs_path_;
   int fd_;
 };
 
 using WatcherPtr = std::unique_ptr<ProjectFileWatcher>;
 
-class Project;
 using ProjectPtr = std::shared_ptr<Project>;
 
 class Project : public std::enable_shared_from_this<Project> {
@@ -78,13 +116,14 @@ public:
 
   void ChangeHome(const fspath &new_home);
 
-  void HandleEntryCreate(int wd, bool is_dir, const std::string &path);
-  void HandleEntryDeleted(int wd, bool is_dir, const std::string &path);
-  void HandleFileModified(int wd, const std::string &path);
-  void HandleWatchedDirDeleted(int wd, const std::string &path);
+  // The events of the watches of the project, in order. The lexical
+  // indexes of the files are updated once for all.
+  void HandleFileEvents(const std::vector<const FileEvent *> &events);
+  // Some events are lost, e.g. the queue of the kernel overflowed.
+  void HandleEventsLost();
 
   bool LoadFileDefinedSymbolInfo(const fspath &path,
-                                 SymbolDefinitionMap &symbols) const;
+                                 SymbolIdLocationMap &symbols) const;
 
   bool LoadFileReferredSymbolInfo(const fspath &path,
                                   FileSymbolReferenceMap &symbols) const;
@@ -92,19 +131,79 @@ public:
   bool LoadSymbolReferenceInfo(const std::string &symbol_name,
                                SymbolReferenceLocationMap &loc_map) const;
 
+  using ReferenceVisitor =
+      std::function<void(FileId file, uint32_t line, uint32_t column)>;
+
+  // Visit the references in the module of path, or all of them if path is
+  // empty or its module has none. The references of a file are visited in a
+  // row, sorted by line and column.
+  bool VisitSymbolReferences(const std::string &symbol_name,
+                             const fspath &path,
+                             const ReferenceVisitor &visitor) const;
+
+  // The depth of the direct edges is 1. Return false to stop the visit.
+  using EdgeVisitor = std::function<bool(InternId from, InternId to,
+                                         uint32_t depth, const EdgeSite &site)>;
+
+  // Visit the edges of kind breadth-first from symbol_name, up to max_depth
+  // levels. They are followed forward if is_forward, e.g. to the callees, or
+  // backward otherwise, e.g. to the callers. Each reached symbol is expanded
+  // only once.
+  bool VisitEdges(EdgeKind kind, const std::string &symbol_name,
+                  bool is_forward, uint32_t max_depth,
+                  const EdgeVisitor &visitor) const;
+
+  // Forward to the included files, or backward to the includers. path is
+  // either absolute or relative.
+  bool VisitIncludes(const fspath &path, bool is_forward, uint32_t max_depth,
+                     const EdgeVisitor &visitor) const;
+
+  // line and column are 1-based, the same as the stored locations.
+  bool FindSymbolAtPosition(const fspath &path, uint32_t line,
+                            uint32_t column, SymbolId &symbol) const;
+
+  // Return false if the symbol isn't defined in the project.
+  bool LoadSymbolMetadata(SymbolId symbol, SymbolMetadata &metadata) const;
+  bool LoadSymbolMetadata(const std::string &symbol_name,
+                          SymbolMetadata &metadata) const;
+
   std::vector<Location> QuerySymbolDefinition(const std::string &symbol) const;
 
   Location QuerySymbolDefinition(const std::string &symbol,
                                  const fspath &abs_path) const;
 
+  // The definitions found by the lexer in the files not compiled yet. symbol
+  // is either a USR or a qualified name.
+  std::vector<Location> QueryProvisionalDefinition(
+      const std::string &symbol) const {
+    return provisional_defs_.Find(symbol);
+  }
+
+  std::vector<SymbolNameIndex::Match> SearchSymbols(
+      const std::string &query, SymbolNameIndex::Mode mode,
+      size_t limit) const {
+    return symbol_names_.Search(query, mode, limit);
+  }
+
+  // The files to search for query by TextIndex::Search() in a worker.
+  FsPathVec FindTextFiles(const std::string &query) const {
+    return text_index_.FindFiles(query);
+  }
+
+  std::string GetSymbolName(SymbolId symbol) const {
+    return usr_table_.Lookup(symbol);
+  }
+
+  fspath GetFileAbsPath(FileId file) const {
+    return path_table_.AbsolutePath(file);
+  }
+
   const FsPathSet &abs_src_paths() const { return abs_src_paths_; }
 
   const std::string &name() const { return name_; }
 
   const fspath &home_path() const { return home_path_; }
 
-  bool IsWatchFdInList(int file_wd) const;
-
   bool IsFileExcluded(const fspath &path) const;
 
   std::string GetModuleName(const fspath &path) const;
@@ -112,10 +211,28 @@ public:
 private:
   void ChangeHomeNoCheck(fspath &&new_home);
 
+  // The changed files whose lexical indexes are stale are appended to
+  // lexical_paths.
+  void HandleEntryCreate(int wd, bool is_dir, const std::string &path,
+                         FsPathVec &lexical_paths);
+  void HandleEntryDeleted(int wd, bool is_dir, const std::string &path);
+  void HandleFileModified(int wd, const std::string &path,
+                          FsPathVec &lexical_paths);
+  void HandleWatchedDirDeleted(int wd);
+  // Return false if wd doesn't watch a compilation database.
+  bool HandleCompileDbEvent(int wd, uint32_t mask);
+
   StringVecPtr GetModuleCompilationFlag(const std::string &module_name);
 
   void InitializeLevelDB(bool create_if_missing, bool error_if_exists);
 
+  bool LoadSymbolReferenceInfo(SymbolId symbol,
+                               SymbolReferenceLocationMap &loc_map) const;
+
+  std::vector<Location> QuerySymbolDefinition(SymbolId symbol) const;
+
+  Location QuerySymbolDefinition(SymbolId symbol, const fspath &abs_path) const;
+
   void ClangParseFile(SmartCXIndex cx_index, fspath home_path, fspath abs_path,
                       StringVecPtr compile_flags);
 
@@ -130,14 +247,50 @@ private:
   void WriteFileReferences(TranslationUnitPtr tu, fspath relative_path,
                            BatchWriter &writer);
 
+  void WriteFilePositions(TranslationUnitPtr tu, fspath relative_path,
+                          BatchWriter &writer);
+
+  // Only the headers changed since the last unit including them are written.
+  void WriteHeaderMacros(TranslationUnitPtr tu, BatchWriter &writer);
+
+  EdgeSiteMap InternSymbolEdges(const EdgeLineMap &usr_edges, FileId file);
+  EdgeSiteMap InternIncludeEdges(const EdgeLineMap &path_edges);
+
+  void WriteFileEdges(EdgeKind kind, const EdgeSiteMap &new_edges,
+                      const fspath &relative_path, BatchWriter &writer);
+
+  bool LoadFileEdges(EdgeKind kind, const fspath &path,
+                     EdgeSiteMap &edges) const;
+
+  bool VisitEdgeGraph(EdgeKind kind, InternId start, bool is_forward,
+                      uint32_t max_depth, const EdgeVisitor &visitor) const;
+
   std::string MakeFileInfoKey(const fspath &file_path) const;
   std::string MakeFileSymbolDefineKey(const fspath &file_rel_path) const;
   std::string MakeFileSymbolReferKey(const fspath &file_rel_path) const;
-  std::string MakeSymbolDefineKey(const std::string &symbol_name) const;
-  std::string MakeSymbolReferKey(const std::string &symbol_name) const;
+  std::string MakeFilePositionKey(const fspath &file_rel_path) const;
+  std::string MakeHeaderMacroKey(const fspath &file_rel_path) const;
+  std::string MakeFileEdgeKey(EdgeKind kind,
+                              const fspath &file_rel_path) const;
+  std::string MakeSymbolDefineKey(SymbolId symbol) const;
+  std::string MakeSymbolReferKey(SymbolId symbol) const;
+  std::string MakeSymbolNameKey(SymbolId symbol) const;
+  std::string MakeSymbolMetadataKey(SymbolId symbol) const;
+  // An edge is stored in both directions, e.g.
+  // call:out:<caller>:<callee>:<file> and call:in:<callee>:<caller>:<file>,
+  // so that the callees or callers of a function are a prefix scan. The file
+  // is the translation unit where the edge is found, since an edge may be
+  // found in more than one of them. The value is the EdgeSite, <file>:<line>.
+  std::string MakeEdgeKey(EdgeKind kind, const char *direction, InternId from,
+                          InternId to, FileId file) const;
 
   bool LoadKey(const std::string &key, std::string &value) const;
 
+  // Call fn with the value of key, which is only valid in fn. It saves the
+  // allocation of LoadKey().
+  template <typename Fn>
+  bool VisitKeyValue(const std::string &key, Fn &&fn) const;
+
   template <typename PBType>
   bool LoadKeyPBValue(const std::string &key, PBType &pb) const;
 
@@ -145,11 +298,27 @@ private:
 
   bool PutSingleKey(const std::string &key, const std::string &value);
 
-  bool GetSymbolDefinitionInfo(const std::string &symbol,
+  // All the reads of the symbol definitions go through it. The symdef: keys
+  // of the database override the frozen table, and an empty value tells the
+  // symbol is deleted since the last freeze.
+  template <typename Fn>
+  bool VisitSymbolDefinitionValue(SymbolId symbol, Fn &&fn) const;
+
+  bool GetSymbolDefinitionInfo(SymbolId symbol,
                                DB_SymbolDefinitionInfo &st) const;
 
-  Location GetSymbolLocation(const DB_SymbolDefinitionInfo &st,
-                             const fspath &rel_path) const;
+  // fn(FileId, line, column) returns false to stop the visit.
+  template <typename Fn>
+  bool VisitSymbolDefinitions(SymbolId symbol, Fn &&fn) const;
+
+  std::string EncodeSymbolDefinitionInfo(
+      const DB_SymbolDefinitionInfo &st) const;
+  std::string EncodeSymbolReferenceInfo(
+      const SymbolReferenceLocationMap &sym_locs) const;
+  std::string EncodeFileReferenceInfo(
+      const FileSymbolReferenceMap &symbols) const;
+
+  Location MakeLocation(FileId file, uint32_t line, uint32_t column) const;
 
   void AddSymbolLocation(DB_SymbolDefinitionInfo &st,
                          const std::string &module_name,
@@ -159,28 +328,87 @@ private:
 
   void BuildFile(SmartCXIndex cx_index, const fspath &abs_path);
 
-  void UpdateWatchDirs();
+  void UpdateWatchDirs(const FsPathSet &new_watch_dirs);
+
+  // Rebuild the text index and the provisional definitions from the sources
+  // and header_paths.
+  void BuildLexicalIndexes(const FsPathVec &header_paths);
+  // Read the files in the workers, and update the indexes in batches.
+  void UpdateLexicalIndexes(const FsPathVec &abs_paths);
+
+  struct LexicalFile {
+    fspath abs_path;
+    bool is_readable;
+    TextIndex::Trigrams trigrams;
+    ProvisionalDefinitionVec definitions;
+  };
+  using LexicalFileVecPtr = std::shared_ptr<std::vector<LexicalFile>>;
+
+  void ScanLexicalFiles(uint64_t generation, bool with_trigrams,
+                        FsPathVec abs_paths);
+  void ApplyLexicalFiles(uint64_t generation, LexicalFileVecPtr files);
 
   void StartForceSyncTimer();
   void StartSmartSyncTimer();
 
+  // Update the compilation database if its inputs change, e.g. by cmake,
+  // load it, and then sync all the files. Only the last step is in the main
+  // thread.
   void ForceSync();
+  void HashCompileDbInputs(std::shared_ptr<ProjectConfig> config);
+  void UpdateCompileDbIfChanged(std::string hash);
+  void OnCompileDbUpdated(bool ok);
+  void LoadCompilerFlags(fspath home_path,
+                         std::shared_ptr<ProjectConfig> config);
+  void ApplyCompilerFlags(CompilerFlagCache::FlagStatePtr state,
+                          std::string hash);
+  void SyncFiles();
+
+  // Watch the compilation databases which aren't generated by cmake, and
+  // reload them once they're rewritten. Those not existing yet are retried
+  // by the smart sync timer.
+  void WatchCompileDbFiles();
+  void StartCompileDbReloadTimer();
+
+  fspath GetFrozenSymbolTablePath() const;
+  bool LoadFrozenSymbolTable();
+
+  // Merge the symdef: keys into the frozen table if there are enough of them.
+  // The table is rewritten by a worker from a snapshot of the database, then
+  // swapped in the main thread.
+  void TryFreezeSymbolDefinitions();
+  void FreezeSymbolDefinitions(uint64_t generation,
+                               const leveldb::Snapshot *snapshot);
+  void ApplyFrozenSymbolTable(uint64_t generation, bool is_written,
+                              std::shared_ptr<std::vector<SymbolId>> merged);
+  // A symdef: key is written, or masked if it's deleted.
+  void MarkSymbolDefinitionChanged(SymbolId symbol);
+
+  bool LoadSymbolNames();
 
   void SmartSync();
 
   void DeleteUnexistFile(const fspath &deleted_path);
 
+  // Return false if the header has no macro.
+  bool DeleteHeaderMacros(const fspath &relative_path,
+                          BatchWriter &writer) const;
   void DeleteFileDefinedSymbolInfo(const fspath &path,
                                    BatchWriter &writer) const;
 
   void DeleteFileReferredSymbolInfo(const fspath &path,
                                     BatchWriter &writer) const;
 
+  void DeleteFileEdges(EdgeKind kind, const fspath &path,
+                       BatchWriter &writer) const;
+
   void LoadCmakeCompilationInfo(const fspath &build_path);
 
   void LoadCmakeCompilationInfoFromClangDatabase(const fspath &build_path);
 
-  FsPathSet GetWatchDirs();
+  // Return the directories to watch, and the headers in them which aren't
+  // excluded in header_paths.
+  FsPathSet GetWatchDirs(FsPathVec &header_paths);
 
   void AddFileWatch(const fspath &path);
   void RemoveFileWatch(const fspath &path);
@@ -190,15 +418,46 @@ private:
 private:
   std::string name_;
   fspath home_path_;  // it's absolute, ditto
+  // Both must outlive symbol_db_.
+  SmartLevelDBCachePtr block_cache_;
+  SmartFilterPolicyPtr filter_policy_;
   SmartLevelDBPtr symbol_db_;
+  RecordFormat record_format_;
+  InternTable usr_table_;
+  PathTable path_table_;
+  FrozenSymbolTable frozen_symdefs_;
+  // The symbols which may have symdef: keys, i.e. changed since the last
+  // freeze. The others are looked up in frozen_symdefs_ only.
+  std::unordered_set<SymbolId> symdef_delta_;
+  // Bumped when a freeze starts or the database is reopened, so that the
+  // table of a stale freeze is dropped.
+  uint64_t symdef_freeze_generation_ = 0;
+  bool is_freezing_symdefs_ = false;
+  // The symbols changed after the snapshot of the running freeze, whose
+  // keys must be kept.
+  std::unordered_set<SymbolId> symdef_changed_in_freeze_;
+  // The qualified names of the defined symbols, from the symname: keys.
+  SymbolNameIndex symbol_names_;
+  TextIndex text_index_;
+  // The definitions found by the lexer before the files are compiled
+  ProvisionalIndex provisional_defs_;
+  // Bumped when the lexical indexes are rebuilt, so that the files scanned
+  // for the old ones are dropped.
+  uint64_t lexical_generation_ = 0;
   FsPathSet abs_src_paths_;
   FsPathSet in_parsing_files_;  // relative path
   FsPathVec modified_files_;
   boost::asio::deadline_timer smart_sync_timer_;
   boost::asio::deadline_timer force_sync_timer_;
   std::map<int, WatcherPtr> watchers_;
+  // The files of the compilation databases, watched by themselves
+  std::map<int, WatcherPtr> compile_db_watchers_;
+  // The generators may write a database several times in a row.
+  boost::asio::deadline_timer compile_db_reload_timer_;
 
   CompilerFlagCache flag_cache_;
+  bool is_syncing_ = false;
+  bool is_sync_pending_ = false;
   int64_t cmake_file_last_mtime_;
   std::shared_ptr<ProjectConfig> config_;
 };
@@ -0,0 +1,754 @@
+#include "ProvisionalIndex.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <unordered_set>
+
+namespace symdb {
+
+namespace {
+
+struct Token {
+  enum Kind { kIdentifier, kLiteral, kPunct };
+
+  Kind kind;
+  std::string text;  // empty for the literals
+  uint32_t line;
+  uint32_t column;
+
+  bool Is(const char *punct_or_word) const { return text == punct_or_word; }
+  bool IsIdentifier() const { return kind == kIdentifier; }
+};
+
+bool IsIdentifierHead(char c) {
+  return std::isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+bool IsIdentifierChar(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+// A lexer of C and C++ only good enough to find the definitions. The
+// comments and the preprocessor directives are skipped, and the literals are
+// only told apart from the other tokens.
+class Lexer {
+public:
+  explicit Lexer(const std::string &content) : content_{content} {}
+
+  bool Next(Token &token);
+
+private:
+  char Peek(size_t offset = 0) const {
+    return pos_ + offset < content_.size() ? content_[pos_ + offset] : '\0';
+  }
+
+  void Advance() {
+    if (content_[pos_] == '\n') {
+      ++line_;
+      line_begin_ = pos_ + 1;
+      is_line_start_ = true;
+    }
+    ++pos_;
+  }
+
+  void SkipSpacesAndComments();
+  void SkipQuoted(char quote);
+  void SkipRawString();
+
+  const std::string &content_;
+  size_t pos_ = 0;
+  uint32_t line_ = 1;
+  size_t line_begin_ = 0;
+  bool is_line_start_ = true;
+};
+
+void Lexer::SkipSpacesAndComments() {
+  while (pos_ < content_.size()) {
+    char c = Peek();
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      Advance();
+    } else if (c == '/' && Peek(1) == '/') {
+      while (pos_ < content_.size() && Peek() != '\n') {
+        Advance();
+      }
+    } else if (c == '/' && Peek(1) == '*') {
+      Advance();
+      Advance();
+      while (pos_ < content_.size() && !(Peek() == '*' && Peek(1) == '/')) {
+        Advance();
+      }
+      if (pos_ < content_.size()) {
+        Advance();
+        Advance();
+      }
+    } else if (c == '#' && is_line_start_) {
+      // The directive may be continued by a backslash.
+      while (pos_ < content_.size() && Peek() != '\n') {
+        if (Peek() == '\\' && Peek(1) == '\n') {
+          Advance();
+        }
+        Advance();
+      }
+    } else {
+      break;
+    }
+  }
+}
+
+void Lexer::SkipQuoted(char quote) {
+  Advance();
+  while (pos_ < content_.size()) {
+    char c = Peek();
+    if (c == '\\' && pos_ + 1 < content_.size()) {
+      Advance();
+    } else if (c == quote || c == '\n') {
+      break;
+    }
+    Advance();
+  }
+  if (pos_ < content_.size()) {
+    Advance();
+  }
+}
+
+void Lexer::SkipRawString() {
+  // R"delimiter( ... )delimiter"
+  Advance();
+  size_t open = content_.find('(', pos_);
+  if (open == std::string::npos) {
+    pos_ = content_.size();
+    return;
+  }
+
+  std::string terminator = ")" + content_.substr(pos_, open - pos_) + "\"";
+  size_t end = content_.find(terminator, open);
+  end = end == std::string::npos ? content_.size() : end + terminator.size();
+  while (pos_ < end) {
+    Advance();
+  }
+}
+
+bool Lexer::Next(Token &token) {
+  SkipSpacesAndComments();
+  if (pos_ >= content_.size()) {
+    return false;
+  }
+
+  is_line_start_ = false;
+  token.line = line_;
+  token.column = static_cast<uint32_t>(pos_ - line_begin_ + 1);
+  token.text.clear();
+
+  char c = Peek();
+  if (IsIdentifierHead(c)) {
+    size_t begin = pos_;
+    while (pos_ < content_.size() && IsIdentifierChar(Peek())) {
+      Advance();
+    }
+    token.text.assign(content_, begin, pos_ - begin);
+
+    // The prefixes of the literals, e.g. u8"text" and R"(text)"
+    char quote = Peek();
+    if (quote == '"' || quote == '\'') {
+      const auto &prefix = token.text;
+      if (quote == '"' && !prefix.empty() && prefix.back() == 'R' &&
+          (prefix == "R" || prefix == "LR" || prefix == "uR" ||
+           prefix == "UR" || prefix == "u8R")) {
+        SkipRawString();
+        token.kind = Token::kLiteral;
+        token.text.clear();
+        return true;
+      }
+      if (prefix == "L" || prefix == "u" || prefix == "U" || prefix == "u8") {
+        SkipQuoted(quote);
+        token.kind = Token::kLiteral;
+        token.text.clear();
+        return true;
+      }
+    }
+
+    token.kind = Token::kIdentifier;
+    return true;
+  }
+
+  if (std::isdigit(static_cast<unsigned char>(c)) ||
+      (c == '.' && std::isdigit(static_cast<unsigned char>(Peek(1))))) {
+    while (pos_ < content_.size()) {
+      char d = Peek();
+      if ((d == '+' || d == '-') &&
+          std::strchr("eEpP", content_[pos_ - 1]) != nullptr) {
+        Advance();
+      } else if (IsIdentifierChar(d) || d == '.' || d == '\'') {
+        Advance();
+      } else {
+        break;
+      }
+    }
+    token.kind = Token::kLiteral;
+    return true;
+  }
+
+  if (c == '"' || c == '\'') {
+    SkipQuoted(c);
+    token.kind = Token::kLiteral;
+    return true;
+  }
+
+  token.kind = Token::kPunct;
+  if ((c == ':' && Peek(1) == ':') || (c == '-' && Peek(1) == '>')) {
+    token.text.assign(content_, pos_, 2);
+    Advance();
+  } else {
+    token.text.assign(1, c);
+  }
+  Advance();
+  return true;
+}
+
+const std::unordered_set<std::string> &NonFunctionWords() {
+  static const std::unordered_set<std::string> kWords = {
+      "if",       "for",       "while",         "switch",  "catch",
+      "return",   "sizeof",    "decltype",      "alignof", "alignas",
+      "noexcept", "throw",     "typeid",        "new",     "delete",
+      "requires", "__attribute__", "__declspec", "static_assert",
+  };
+  return kWords;
+}
+
+bool IsClassKey(const Token &token) {
+  return token.Is("class") || token.Is("struct") || token.Is("union") ||
+         token.Is("enum");
+}
+
+// e.g. FOO_BAR(x) { ... } of the test frameworks.
+bool IsMacroName(const std::string &name) {
+  bool has_upper = false;
+  for (char c : name) {
+    if (std::islower(static_cast<unsigned char>(c))) {
+      return false;
+    }
+    has_upper = has_upper || std::isupper(static_cast<unsigned char>(c));
+  }
+  return has_upper && name.size() > 1;
+}
+
+// Feed the tokens of a file, and it finds the definitions by the braces
+// opened in the namespace and class scopes. The tokens in the other scopes,
+// e.g. the function bodies, are skipped except the braces.
+class DefinitionScanner {
+public:
+  explicit DefinitionScanner(ProvisionalDefinitionVec &definitions)
+      : definitions_{definitions} {
+    scopes_.push_back(Scope{ScopeKind::kNamespace, std::string{}});
+  }
+
+  void Feed(const Token &token);
+
+private:
+  enum class ScopeKind {
+    kNamespace,
+    kClass,
+    kBlock,  // e.g. a function body
+    kInit,   // braces in a declaration, e.g. a braced initializer
+  };
+
+  struct Scope {
+    ScopeKind kind;
+    std::string name;
+  };
+
+  bool IsInDeclarationScope() const {
+    return scopes_.back().kind == ScopeKind::kNamespace ||
+           scopes_.back().kind == ScopeKind::kClass;
+  }
+
+  void OpenScope(ScopeKind kind, std::string name = std::string{});
+  void CloseScope(const Token &token);
+  void ClearStatement() {
+    statement_.clear();
+    paren_depth_ = 0;
+  }
+
+  void OnOpenBrace();
+  // Not a part of an operator, e.g. == and operator=.
+  bool IsAssignment(size_t index) const;
+  bool TryClassDefinition(size_t key_index);
+  bool TryFunctionDefinition(size_t paren_index);
+
+  void AddDefinition(const std::string &name, const Token &token);
+
+  ProvisionalDefinitionVec &definitions_;
+  std::vector<Scope> scopes_;
+  // The tokens since the last declaration in the declaration scope
+  std::vector<Token> statement_;
+  int paren_depth_ = 0;
+};
+
+void DefinitionScanner::Feed(const Token &token) {
+  if (!IsInDeclarationScope()) {
+    if (token.Is("{")) {
+      OpenScope(ScopeKind::kBlock);
+    } else if (token.Is("}")) {
+      CloseScope(token);
+    }
+    return;
+  }
+
+  if (token.Is("{")) {
+    OnOpenBrace();
+  } else if (token.Is("}")) {
+    // Ignore the unbalanced ones, e.g. by the #if branches.
+    if (scopes_.size() > 1) {
+      CloseScope(token);
+    }
+    ClearStatement();
+  } else if (token.Is(";") && paren_depth_ == 0) {
+    ClearStatement();
+  } else if (token.Is(":") && statement_.size() == 1 &&
+             statement_.front().IsIdentifier()) {
+    // The access specifiers, e.g. public:
+    ClearStatement();
+  } else {
+    if (token.Is("(")) {
+      ++paren_depth_;
+    } else if (token.Is(")") && paren_depth_ > 0) {
+      --paren_depth_;
+    }
+    statement_.push_back(token);
+  }
+}
+
+void DefinitionScanner::OpenScope(ScopeKind kind, std::string name) {
+  scopes_.push_back(Scope{kind, std::move(name)});
+}
+
+void DefinitionScanner::CloseScope(const Token &token) {
+  ScopeKind kind = scopes_.back().kind;
+  scopes_.pop_back();
+
+  // The declaration goes on after the braced initializer.
+  if (kind == ScopeKind::kInit && IsInDeclarationScope()) {
+    statement_.push_back(token);
+  }
+}
+
+void DefinitionScanner::OnOpenBrace() {
+  if (paren_depth_ > 0) {
+    // e.g. a default argument of {}
+    OpenScope(ScopeKind::kInit);
+    return;
+  }
+
+  size_t begin = 0;
+  size_t size = statement_.size();
+
+  // Skip the template headers.
+  while (begin + 1 < size && statement_[begin].Is("template") &&
+         statement_[begin + 1].Is("<")) {
+    int angle_depth = 0;
+    for (++begin; begin < size; ++begin) {
+      if (statement_[begin].Is("<")) {
+        ++angle_depth;
+      } else if (statement_[begin].Is(">") && --angle_depth == 0) {
+        ++begin;
+        break;
+      }
+    }
+  }
+
+  if (size == begin + 2 && statement_[begin].Is("extern") &&
+      statement_[begin + 1].kind == Token::kLiteral) {
+    // extern "C" {
+    OpenScope(ScopeKind::kNamespace);
+    ClearStatement();
+    return;
+  }
+
+  size_t ns_index = begin;
+  if (ns_index < size && statement_[ns_index].Is("inline")) {
+    ++ns_index;
+  }
+  if (ns_index < size && statement_[ns_index].Is("namespace")) {
+    // Anonymous, or nested like a::b.
+    std::string name;
+    for (size_t i = ns_index + 1; i < size; ++i) {
+      if (statement_[i].IsIdentifier() || statement_[i].Is("::")) {
+        name += statement_[i].text;
+      }
+    }
+    OpenScope(ScopeKind::kNamespace, std::move(name));
+    ClearStatement();
+    return;
+  }
+
+  size_t key_index = size;
+  size_t paren_index = size;
+  size_t assign_index = size;
+  int depth = 0;
+  for (size_t i = begin; i < size; ++i) {
+    const auto &token = statement_[i];
+    if (token.Is("(")) {
+      if (depth++ == 0 && paren_index == size) {
+        paren_index = i;
+      }
+    } else if (token.Is(")")) {
+      --depth;
+    } else if (depth == 0 && key_index == size && IsClassKey(token)) {
+      key_index = i;
+    } else if (depth == 0 && assign_index == size && IsAssignment(i)) {
+      assign_index = i;
+    }
+  }
+
+  if (key_index < paren_index && key_index < assign_index &&
+      TryClassDefinition(key_index)) {
+    return;
+  }
+
+  if (paren_index < assign_index && TryFunctionDefinition(paren_index)) {
+    return;
+  }
+
+  // e.g. a variable with a braced initializer
+  OpenScope(ScopeKind::kInit);
+}
+
+bool DefinitionScanner::IsAssignment(size_t index) const {
+  if (!statement_[index].Is("=")) {
+    return false;
+  }
+  if (index + 1 < statement_.size() && statement_[index + 1].Is("=")) {
+    return false;
+  }
+  if (index == 0) {
+    return true;
+  }
+
+  const auto &prev = statement_[index - 1];
+  return prev.IsIdentifier() ? !prev.Is("operator")
+                             : std::strchr("=!<>+-*/%&|^", prev.text[0]) ==
+                                   nullptr;
+}
+
+bool DefinitionScanner::TryClassDefinition(size_t key_index) {
+  size_t size = statement_.size();
+  bool is_enum = statement_[key_index].Is("enum");
+  size_t i = key_index + 1;
+  if (is_enum && i < size &&
+      (statement_[i].Is("class") || statement_[i].Is("struct"))) {
+    ++i;
+  }
+
+  // The name is the last run of the identifiers, after the attributes and the
+  // export macros, e.g. class [[deprecated]] EXPORT_API a::Foo final : Bar.
+  std::string name;
+  size_t name_index = size;
+  while (i < size) {
+    const auto &token = statement_[i];
+    if (token.Is("[")) {
+      int bracket_depth = 0;
+      for (; i < size; ++i) {
+        if (statement_[i].Is("[")) {
+          ++bracket_depth;
+        } else if (statement_[i].Is("]") && --bracket_depth == 0) {
+          ++i;
+          break;
+        }
+      }
+    } else if (token.IsIdentifier() && i + 1 < size &&
+               statement_[i + 1].Is("(")) {
+      // alignas(8), __attribute__((packed)), etc.
+      int depth = 0;
+      for (++i; i < size; ++i) {
+        if (statement_[i].Is("(")) {
+          ++depth;
+        } else if (statement_[i].Is(")") && --depth == 0) {
+          ++i;
+          break;
+        }
+      }
+    } else if (token.IsIdentifier() && !token.Is("final")) {
+      name.clear();
+      while (i < size) {
+        name += statement_[i].text;
+        name_index = i++;
+        if (i + 1 < size && statement_[i].Is("::") &&
+            statement_[i + 1].IsIdentifier()) {
+          name += "::";
+          ++i;
+        } else {
+          break;
+        }
+      }
+    } else {
+      break;
+    }
+  }
+
+  // Otherwise, e.g. struct Foo *Make() {
+  if (i < size && !statement_[i].Is(":") && !statement_[i].Is("final") &&
+      !statement_[i].Is("<")) {
+    return false;
+  }
+
+  if (name_index < size) {
+    AddDefinition(name, statement_[name_index]);
+  }
+
+  // The enumerators aren't wanted.
+  OpenScope(is_enum ? ScopeKind::kBlock : ScopeKind::kClass, std::move(name));
+  ClearStatement();
+  return true;
+}
+
+bool DefinitionScanner::TryFunctionDefinition(size_t paren_index) {
+  if (paren_index == 0) {
+    return false;
+  }
+
+  // The name before the parameters, e.g. a::Foo::~Foo or operator==.
+  std::string name;
+  size_t name_index = paren_index - 1;
+  size_t first = paren_index;
+  for (size_t back = 1; back <= 4 && back <= paren_index; ++back) {
+    if (statement_[paren_index - back].Is("operator")) {
+      first = paren_index - back;
+      name_index = first;
+      for (size_t i = first; i < paren_index; ++i) {
+        name += statement_[i].text;
+      }
+      // operator()(...)
+      if (back == 1 && paren_index + 1 < statement_.size() &&
+          statement_[paren_index + 1].Is(")")) {
+        name += "()";
+      }
+      break;
+    }
+  }
+
+  if (name.empty()) {
+    const auto &last = statement_[paren_index - 1];
+    if (!last.IsIdentifier() || NonFunctionWords().count(last.text) != 0) {
+      return false;
+    }
+
+    if (IsMacroName(last.text)) {
+      OpenScope(ScopeKind::kBlock);
+      ClearStatement();
+      return true;
+    }
+
+    first = paren_index - 1;
+    if (first > 0 && statement_[first - 1].Is("~")) {
+      --first;
+    }
+    // The qualifiers, whose template arguments are dropped, e.g. Foo<T>::
+    while (first >= 2 && statement_[first - 1].Is("::")) {
+      size_t qualifier = first - 2;
+      if (statement_[qualifier].Is(">")) {
+        int angle_depth = 0;
+        for (; qualifier > 0; --qualifier) {
+          if (statement_[qualifier].Is(">")) {
+            ++angle_depth;
+          } else if (statement_[qualifier].Is("<") && --angle_depth == 0) {
+            break;
+          }
+        }
+        if (qualifier == 0) {
+          break;
+        }
+        --qualifier;
+      }
+      if (!statement_[qualifier].IsIdentifier()) {
+        break;
+      }
+      first = qualifier;
+    }
+
+    int angle_depth = 0;
+    for (size_t i = first; i < paren_index; ++i) {
+      const auto &token = statement_[i];
+      if (token.Is("<")) {
+        ++angle_depth;
+      } else if (token.Is(">")) {
+        --angle_depth;
+      } else if (angle_depth == 0) {
+        name += token.text;
+      }
+    }
+  }
+
+  // The braced member initializers of a constructor, e.g.
+  // Foo() : a_{1}, b_(2) {
+  int depth = 0;
+  size_t i = paren_index;
+  for (; i < statement_.size(); ++i) {
+    if (statement_[i].Is("(")) {
+      ++depth;
+    } else if (statement_[i].Is(")") && --depth == 0) {
+      break;
+    }
+  }
+  bool has_initializers = false;
+  for (++i; i < statement_.size(); ++i) {
+    if (statement_[i].Is(":")) {
+      has_initializers = true;
+      break;
+    }
+  }
+  if (has_initializers && !statement_.back().Is(")") &&
+      !statement_.back().Is("}")) {
+    OpenScope(ScopeKind::kInit);
+    return true;
+  }
+
+  AddDefinition(name, statement_[name_index]);
+  OpenScope(ScopeKind::kBlock);
+  ClearStatement();
+  return true;
+}
+
+void DefinitionScanner::AddDefinition(const std::string &name,
+                                      const Token &token) {
+  std::string qualified_name;
+  for (const auto &scope : scopes_) {
+    if (!scope.name.empty()) {
+      qualified_name += scope.name;
+      qualified_name += "::";
+    }
+  }
+  qualified_name += name;
+  definitions_.push_back(
+      ProvisionalDefinition{std::move(qualified_name), token.line, token.column});
+}
+
+}  // namespace
+
+void ScanProvisionalDefinitions(const std::string &content,
+                                ProvisionalDefinitionVec &definitions) {
+  definitions.clear();
+
+  Lexer lexer{content};
+  DefinitionScanner scanner{definitions};
+  Token token;
+  while (lexer.Next(token)) {
+    scanner.Feed(token);
+  }
+}
+
+std::string GetUsrQualifiedName(const std::string &usr) {
+  // c:[file]@kind@name@kind@name..., the file is of the static ones.
+  if (usr.compare(0, 2, "c:") != 0) {
+    return std::string{};
+  }
+
+  size_t pos = usr.find('@');
+  if (pos == std::string::npos) {
+    return std::string{};
+  }
+
+  std::vector<std::string> parts;
+  while (pos != std::string::npos) {
+    size_t next = usr.find('@', pos + 1);
+    parts.push_back(usr.substr(pos + 1, next == std::string::npos
+                                             ? std::string::npos
+                                             : next - pos - 1));
+    pos = next;
+  }
+
+  std::string name;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    const auto &kind = parts[i];
+    if (kind == "aN") {
+      // The anonymous namespace
+      continue;
+    }
+
+    // N namespace, S struct or class, U union, E enum, F function, T typedef,
+    // and ST>... class template.
+    bool is_known = kind == "N" || kind == "S" || kind == "U" || kind == "E" ||
+                    kind == "F" || kind == "T" || kind.compare(0, 3, "ST>") == 0;
+    if (!is_known || i + 1 >= parts.size()) {
+      return std::string{};
+    }
+
+    const auto &part = parts[++i];
+    if (!name.empty()) {
+      name += "::";
+    }
+    name.append(part, 0, part.find('#'));
+  }
+
+  return name;
+}
+
+void ProvisionalIndex::Clear() {
+  files_.clear();
+  names_.clear();
+}
+
+void ProvisionalIndex::Update(const fspath &path,
+                              ProvisionalDefinitionVec definitions) {
+  Remove(path);
+  if (definitions.empty()) {
+    return;
+  }
+
+  auto it = files_.emplace(path, std::move(definitions)).first;
+  for (const auto &def : it->second) {
+    auto &paths = names_[def.name];
+    // The overloads are in a row.
+    if (paths.empty() || paths.back() != &it->first) {
+      paths.push_back(&it->first);
+    }
+  }
+}
+
+void ProvisionalIndex::Remove(const fspath &path) {
+  auto it = files_.find(path);
+  if (it == files_.end()) {
+    return;
+  }
+
+  for (const auto &def : it->second) {
+    auto name_it = names_.find(def.name);
+    if (name_it == names_.end()) {
+      continue;
+    }
+
+    auto &paths = name_it->second;
+    paths.erase(std::remove(paths.begin(), paths.end(), &it->first),
+                paths.end());
+    if (paths.empty()) {
+      names_.erase(name_it);
+    }
+  }
+
+  files_.erase(it);
+}
+
+std::vector<Location> ProvisionalIndex::Find(const std::string &name) const {
+  std::vector<Location> locations;
+
+  std::string qualified_name = GetUsrQualifiedName(name);
+  if (qualified_name.empty()) {
+    qualified_name = name;
+  }
+
+  auto name_it = names_.find(qualified_name);
+  if (name_it == names_.end()) {
+    return locations;
+  }
+
+  for (const fspath *path : name_it->second) {
+    for (const auto &def : files_.at(*path)) {
+      if (def.name == qualified_name) {
+        locations.emplace_back(path->string(), def.line, def.column);
+      }
+    }
+  }
+
+  return locations;
+}
+
+}  // namespace symdb
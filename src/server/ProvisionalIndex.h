@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Location.h"
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+// A likely definition found by the lexer, e.g. "symdb::Project::Build".
+struct ProvisionalDefinition {
+  std::string name;
+  uint32_t line;
+  uint32_t column;
+};
+
+using ProvisionalDefinitionVec = std::vector<ProvisionalDefinition>;
+
+// Find the definitions in the namespace and class scopes, i.e. the classes,
+// structs, unions, enums and the functions with bodies, by tokenizing content
+// without any semantic analysis. The macros aren't expanded, so the names in
+// ALL_CAPS followed by '(' are taken as macros rather than functions.
+void ScanProvisionalDefinitions(const std::string &content,
+                                ProvisionalDefinitionVec &definitions);
+
+// Return the qualified name of the common USRs, e.g. "a::B::f" of
+// "c:@N@a@S@B@F@f#", or empty if it's unknown, e.g. a function template.
+std::string GetUsrQualifiedName(const std::string &usr);
+
+// The definitions found by the lexer, which answer the definition queries
+// before clang parses the files. They're replaced by the semantic ones of a
+// file once it's compiled.
+class ProvisionalIndex {
+public:
+  void Clear();
+
+  // Replace the definitions of path if it's already added.
+  void Update(const fspath &path, ProvisionalDefinitionVec definitions);
+  void Remove(const fspath &path);
+
+  size_t size() const { return files_.size(); }
+
+  // name is either a USR or a qualified name.
+  std::vector<Location> Find(const std::string &name) const;
+
+private:
+  std::map<fspath, ProvisionalDefinitionVec> files_;
+  // qualified name -> the keys of files_
+  std::unordered_map<std::string, std::vector<const fspath *>> names_;
+};
+
+}  // namespace symdb
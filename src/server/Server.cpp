@@ -1,7 +1,8 @@
 #include "Server.h"
 
 #include <errno.h>
-#include <sys/inotify.h>
+#include <unistd.h>
+#include <algorithm>
 #include <string>
 
 #include "Config.h"
@@ -40,22 +41,28 @@ void Server::Run(const std::string &listen_path) {
     worker_threads_.emplace_back([this]() { worker_io_service_.run(); });
   }
 
-  int inotify_fd = inotify_init1(IN_NONBLOCK);
-  if (inotify_fd < 0) {
-    THROW_AT_FILE_LINE("initofy_init1 error: %s", strerror(errno));
+  FsPathVec roots;
+  for (const auto &cfg_ptr : ConfigInst.projects()) {
+    roots.push_back(cfg_ptr->home_path());
   }
+  file_watcher_ = FileWatcher::Create(ConfigInst.file_watcher_backend(), roots);
+  LOG_INFO << "file_watcher=" << file_watcher_->name()
+           << ", fd=" << file_watcher_->fd();
+
+  // The stream closes its fd, while the watcher owns the original one.
+  int watcher_fd = ::dup(file_watcher_->fd());
+  if (watcher_fd < 0) {
+    THROW_AT_FILE_LINE("dup error: %s", strerror(errno));
+  }
+  watcher_stream_.reset(new AsioStream{main_io_service_, watcher_fd});
+  watcher_stream_->non_blocking();
 
-  LOG_DEBUG << "inotify_fd=" << inotify_fd;
-
-  inotify_stream_.reset(new AsioStream{main_io_service_, inotify_fd});
-  inotify_stream_->non_blocking();
-
-  inotify_stream_->async_wait(AsioStream::wait_read,
+  watcher_stream_->async_wait(AsioStream::wait_read,
                               [this](const boost::system::error_code &ec) {
                                 if (!ec) {
-                                  this->HandleInotifyReadable();
+                                  this->HandleWatcherReadable();
                                 } else {
-                                  LOG_ERROR << "inotify wait error: " << ec;
+                                  LOG_ERROR << "watcher wait error: " << ec;
                                 }
                               });
 
@@ -113,95 +120,125 @@ void Server::AddProject(const std::string &proj_name, ProjectPtr ptr) {
   projects_[proj_name] = ptr;
 }
 
-ProjectPtr Server::GetProjectByWatcher(int watch_fd) {
-  for (auto &kvp : projects_) {
-    if (kvp.second->IsWatchFdInList(watch_fd)) {
-      return kvp.second;
-    }
+int Server::AddWatch(Project *project, const fspath &path, uint32_t mask) {
+  if (!file_watcher_) {
+    THROW_AT_FILE_LINE("no file watcher, path=%s", path.c_str());
   }
 
-  return ProjectPtr{};
+  // Never narrow what the other projects watch.
+  int wd = file_watcher_->AddWatch(path, mask | IN_MASK_ADD);
+  auto &watch = watches_[wd];
+  watch.owners.emplace_back(project, mask);
+  watch.is_removed = false;
+  return wd;
 }
 
-void Server::HandleInotifyReadable() {
-  int inotify_fd = inotify_stream_->native_handle();
+void Server::RemoveWatch(Project *project, int wd) {
+  auto it = watches_.find(wd);
+  if (it == watches_.end()) {
+    LOG_ERROR << "watch not added, watch_fd=" << wd;
+    return;
+  }
 
-  unsigned int avail;
-  (void)ioctl(inotify_fd, FIONREAD, &avail);
+  auto &owners = it->second.owners;
+  auto oit = std::find_if(owners.begin(), owners.end(), [&](const auto &kvp) {
+    return kvp.first == project;
+  });
+  if (oit != owners.end()) {
+    owners.erase(oit);
+  }
+  if (!owners.empty()) {
+    return;
+  }
 
-  char buffer[avail];
-  read(inotify_fd, buffer, avail);
+  // A watch removed by the kernel is dropped here as well, once the last
+  // project handles its IN_DELETE_SELF, so its wd may be reused.
+  if (!it->second.is_removed && file_watcher_) {
+    file_watcher_->RemoveWatch(wd);
+  }
+  watches_.erase(it);
+}
 
-  for (decltype(avail) offset = 0; offset < avail;) {
-    inotify_event *event = (inotify_event *)(buffer + offset);
+void Server::HandleWatcherReadable() {
+  file_watcher_->ReadEvents([this](const std::vector<FileEvent> &events) {
+    HandleWatcherEvents(events);
+  });
 
-    offset += sizeof(inotify_event) + event->len;
+  watcher_stream_->async_wait(AsioStream::wait_read,
+                              [this](const boost::system::error_code &ec) {
+                                if (!ec) {
+                                  this->HandleWatcherReadable();
+                                }
+                              });
+}
 
-    if (event->len == 0) {
-      LOG_WARN << "event=" << event->mask << ", watch_fd=" << event->wd;
+void Server::HandleWatcherEvents(const std::vector<FileEvent> &events) {
+  project_events_.clear();
+  bool is_overflowed = false;
+  for (const auto &event : events) {
+    if (event.mask & IN_Q_OVERFLOW) {
+      is_overflowed = true;
       continue;
     }
 
-    // VIM creates the weried file 4913...
-    if (!strncmp(event->name, "4913", event->len)) {
+    auto it = watches_.find(event.wd);
+    if (it == watches_.end()) {
       continue;
     }
-
-    try {
-      auto ext = fspath(event->name).extension().c_str();
-      if (!symutil::is_cpp_ext(ext)) {
-        continue;
-      }
-    } catch (const std::exception &e) {
-      LOG_ERROR << "file=" << event->name << " extension error: " << e.what();
-      return;
-    }
-
-    try {
-      HandleInotifyEvent(event);
-    } catch (const std::exception &e) {
-      LOG_ERROR << "exception: " << e.what();
+    if (event.mask & IN_IGNORED) {
+      it->second.is_removed = true;
+      continue;
     }
-  }
 
-  inotify_stream_->async_wait(AsioStream::wait_read,
-                              [this](const boost::system::error_code &ec) {
-                                if (!ec) {
-                                  this->HandleInotifyReadable();
-                                }
-                              });
-}
-
-void Server::HandleInotifyEvent(const inotify_event *event) {
-  LOG_DEBUG << "event=" << event->mask << ", watch_fd=" << event->wd
-            << ", file=" << event->name;
+    if (!event.name.empty()) {
+      LOG_DEBUG << "event=" << event.mask << ", watch_fd=" << event.wd
+                << ", file=" << event.name;
 
-  if (ConfigInst.IsFileExcluded(event->name)) {
-    LOG_INFO << "file ignored, path=" << event->name;
-    return;
-  }
+      // VIM creates the weried file 4913...
+      if (event.name == "4913") {
+        continue;
+      }
 
-  ProjectPtr project = GetProjectByWatcher(event->wd);
-  if (!project) {
-    LOG_ERROR << "GetProjectByWatcher failed, watch_fd=" << event->wd;
-    return;
-  }
+      auto pos = event.name.rfind('.');
+      if (pos == std::string_view::npos || pos == 0 ||
+          !symutil::is_cpp_ext(event.name.substr(pos))) {
+        continue;
+      }
 
-  bool is_dir = !!(event->mask & IN_ISDIR);
-  if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
-    project->HandleEntryCreate(event->wd, is_dir, event->name);
-  }
+      if (ConfigInst.IsFileExcluded(event.name)) {
+        LOG_INFO << "file ignored, path=" << event.name;
+        continue;
+      }
+    }
 
-  if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE)) {
-    project->HandleFileModified(event->wd, event->name);
+    for (const auto &owner : it->second.owners) {
+      if (event.mask & owner.second) {
+        project_events_.emplace_back(owner.first, &event);
+      }
+    }
   }
 
-  if (event->mask & IN_DELETE) {
-    project->HandleEntryDeleted(event->wd, is_dir, event->name);
+  if (is_overflowed) {
+    LOG_WARN << "events lost, sync all projects";
+    for (auto &kvp : projects_) {
+      kvp.second->HandleEventsLost();
+    }
   }
 
-  if (event->mask & IN_DELETE_SELF) {
-    project->HandleWatchedDirDeleted(event->wd, event->name);
+  // The events of a project stay in order.
+  std::stable_sort(
+      project_events_.begin(), project_events_.end(),
+      [](const auto &lhs, const auto &rhs) {
+        return std::less<Project *>{}(lhs.first, rhs.first);
+      });
+  for (size_t i = 0; i < project_events_.size();) {
+    Project *project = project_events_[i].first;
+    batch_events_.clear();
+    for (; i < project_events_.size() && project_events_[i].first == project;
+         ++i) {
+      batch_events_.push_back(project_events_[i].second);
+    }
+    project->HandleFileEvents(batch_events_);
   }
 }
 
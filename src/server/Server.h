@@ -5,13 +5,13 @@
 #include <memory>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
+#include "FileWatcher.h"
 #include "Listener.h"
 #include "util/Singleton.h"
 #include "util/TypeAlias.h"
 
-struct inotify_event;
-
 namespace symdb {
 
 class Project;
@@ -35,9 +35,10 @@ public:
 
   asio::io_service &main_io_service() { return main_io_service_; }
 
-  int inotify_fd() const {
-    return inotify_stream_ ? inotify_stream_->native_handle() : -1;
-  }
+  // Several projects may watch the same path, and they share the wd. Throw
+  // if path can't be watched, e.g. before Run().
+  int AddWatch(Project *project, const fspath &path, uint32_t mask);
+  void RemoveWatch(Project *project, int wd);
 
   template <class F>
   void PostToWorker(F f) {
@@ -58,10 +59,9 @@ public:
 private:
   void AddProject(const std::string &proj_name, ProjectPtr ptr);
 
-  void HandleInotifyReadable();
-  void HandleInotifyEvent(const inotify_event *event);
-
-  ProjectPtr GetProjectByWatcher(int watch_fd);
+  void HandleWatcherReadable();
+  // Group the events by the projects, so each handles its own in a batch.
+  void HandleWatcherEvents(const std::vector<FileEvent> &events);
 
   void LoadConfiguredProject();
 
@@ -72,6 +72,12 @@ private:
   Server &operator=(const Server &) = delete;
 
   using ProjectMap = std::map<std::string, ProjectPtr>;
+
+  struct Watch {
+    // The projects and what they watch, which the shared one covers.
+    std::vector<std::pair<Project *, uint32_t>> owners;
+    bool is_removed = false;  // by the kernel
+  };
   using AsioWorkPtr = std::unique_ptr<asio::io_service::work>;
 
   asio::io_service main_io_service_;
@@ -85,7 +91,12 @@ private:
   AsioWorkPtr idle_work_;
   std::unique_ptr<Listener> listener_;
   ProjectMap projects_;
-  AsioStreamPtr inotify_stream_;
+  FileWatcherPtr file_watcher_;
+  AsioStreamPtr watcher_stream_;  // of a dup of the fd of file_watcher_
+  std::unordered_map<int, Watch> watches_;  // by wd
+  // Reused by each batch of events.
+  std::vector<std::pair<Project *, const FileEvent *>> project_events_;
+  std::vector<const FileEvent *> batch_events_;
 };
 
 }  // namespace symdb
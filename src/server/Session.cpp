@@ -5,6 +5,7 @@
 #include "Project.h"
 #include "Server.h"
 #include "proto/Message.pb.h"
+#include "util/Functions.h"
 #include "util/Logger.h"
 #include "util/NetDefine.h"
 #include "util/TypeAlias.h"
@@ -32,6 +33,71 @@ private:
   int msg_id_;
 };
 
+const size_t kDefaultSearchLimit = 100;
+const size_t kMaxSearchLimit = 1000;
+
+const uint32_t kMaxCallDepth = 8;
+// The hierarchies and include chains are shallow, it's only a guard against
+// the cycles.
+const uint32_t kMaxHierarchyDepth = 64;
+const size_t kMaxEdges = 5000;
+
+// Pack the edges reached from symbol, and the definitions of the far ends.
+// set_ends(edge, from, to) sets the USRs of the ends. Return false if
+// symbol is not found.
+template <typename EdgeType, typename SetEnds>
+bool PackEdges(const Project &project, EdgeKind kind, const std::string &symbol,
+               bool is_forward, uint32_t depth,
+               google::protobuf::RepeatedPtrField<EdgeType> &edges,
+               SetEnds &&set_ends) {
+  auto visitor = [&](SymbolId from, SymbolId to, uint32_t edge_depth,
+                     const EdgeSite &site) {
+    auto *edge = edges.Add();
+    auto from_symbol = project.GetSymbolName(from);
+    auto to_symbol = project.GetSymbolName(to);
+    set_ends(*edge, from_symbol, to_symbol);
+    edge->set_depth(edge_depth);
+    const auto &far_end = is_forward ? to_symbol : from_symbol;
+    for (const auto &loc : project.QuerySymbolDefinition(far_end)) {
+      loc.Serialize(*edge->add_locations());
+    }
+    edge->mutable_site()->set_path(project.GetFileAbsPath(site.file).string());
+    edge->mutable_site()->set_line(site.line);
+    return static_cast<size_t>(edges.size()) < kMaxEdges;
+  };
+
+  return project.VisitEdges(kind, symbol, is_forward, depth, visitor);
+}
+
+// Leave pb unset if there's no metadata, e.g. the symbol is only declared.
+template <typename Symbol>
+void PackSymbolMetadata(const Project &project, const Symbol &symbol,
+                        PB_SymbolMetadata &pb) {
+  SymbolMetadata metadata;
+  if (!project.LoadSymbolMetadata(symbol, metadata)) {
+    return;
+  }
+
+  pb.set_kind(metadata.kind);
+  pb.set_kind_name(CXStringToString(
+      clang_getCursorKindSpelling(static_cast<CXCursorKind>(metadata.kind))));
+  pb.set_display_name(metadata.display_name);
+  pb.set_type(metadata.type);
+  pb.set_brief_comment(metadata.brief_comment);
+}
+
+void SetCallEnds(PB_CallEdge &edge, const std::string &caller,
+                 const std::string &callee) {
+  edge.set_caller(caller);
+  edge.set_callee(callee);
+}
+
+void SetSymbolEdgeEnds(PB_SymbolEdge &edge, const std::string &from,
+                       const std::string &to) {
+  edge.set_from_symbol(from);
+  edge.set_to_symbol(to);
+}
+
 inline bool IsValidProjectName(const std::string &proj_name) {
   if (proj_name.empty()) {
     return false;
@@ -149,6 +215,38 @@ void Session::handle_message(const uint8_t *buffer, size_t length) {
       rebuild_file(body_buffer, body_length);
       break;
 
+    case MessageID::SEARCH_SYMBOLS_REQ:
+      search_symbols(body_buffer, body_length);
+      break;
+
+    case MessageID::GET_SYMBOL_AT_POSITION_REQ:
+      get_symbol_at_position(body_buffer, body_length);
+      break;
+
+    case MessageID::GET_CALLERS_REQ:
+      get_callers(body_buffer, body_length);
+      break;
+
+    case MessageID::GET_CALLEES_REQ:
+      get_callees(body_buffer, body_length);
+      break;
+
+    case MessageID::GET_TYPE_HIERARCHY_REQ:
+      get_type_hierarchy(body_buffer, body_length);
+      break;
+
+    case MessageID::GET_OVERRIDES_REQ:
+      get_overrides(body_buffer, body_length);
+      break;
+
+    case MessageID::GET_INCLUDES_REQ:
+      get_includes(body_buffer, body_length);
+      break;
+
+    case MessageID::TEXT_SEARCH_REQ:
+      text_search(body_buffer, body_length);
+      break;
+
     default:
       LOG_ERROR << "unknown message " << head.msg_id();
       break;
@@ -241,7 +339,7 @@ void Session::list_project_files(const uint8_t *buffer, size_t length) {
   auto *files = rsp->mutable_files();
   files->Reserve(abs_src_paths.size());
   for (const auto &path : abs_src_paths) {
-    fspath rel_path = filesystem::relative(path, project->home_path());
+    fspath rel_path = symutil::lexical_relative(path, project->home_path());
     auto *file = rsp->add_files();
     *file = rel_path.string();
   }
@@ -261,31 +359,40 @@ void Session::get_symbol_definition(const uint8_t *buffer, size_t length) {
     return;
   }
 
+  std::vector<Location> locations;
   if (!msg.abs_path().empty()) {
     Location location =
         project->QuerySymbolDefinition(msg.symbol(), msg.abs_path());
     if (location.IsValid()) {
-      location.Serialize(*rsp->add_locations());
-      LOG_DEBUG << "project=" << msg.proj_name() << ", symbol=" << msg.symbol()
-                << ", abs_path=" << msg.abs_path()
-                << ", path=" << location.filename();
-    } else {
-      LOG_ERROR << kErrorSymbolNotFound << ", project=" << msg.proj_name()
-                << " symbol=" << msg.symbol();
-      rsp->set_error(kErrorSymbolNotFound);
+      locations.push_back(location);
     }
   } else {
-    auto locations = project->QuerySymbolDefinition(msg.symbol());
-    if (locations.empty()) {
-      LOG_ERROR << kErrorSymbolNotFound << ", project=" << msg.proj_name()
-                << " symbol=" << msg.symbol();
-      rsp->set_error(kErrorSymbolNotFound);
-    } else {
-      rsp->mutable_locations()->Reserve(locations.size());
-      for (const auto &loc : locations) {
-        loc.Serialize(*rsp->add_locations());
-      }
-    }
+    locations = project->QuerySymbolDefinition(msg.symbol());
+  }
+
+  // The file may not be compiled yet.
+  if (locations.empty()) {
+    locations = project->QueryProvisionalDefinition(msg.symbol());
+    rsp->set_is_provisional(!locations.empty());
+  }
+
+  if (locations.empty()) {
+    LOG_ERROR << kErrorSymbolNotFound << ", project=" << msg.proj_name()
+              << " symbol=" << msg.symbol();
+    rsp->set_error(kErrorSymbolNotFound);
+    return;
+  }
+
+  LOG_DEBUG << "project=" << msg.proj_name() << ", symbol=" << msg.symbol()
+            << ", locations=" << locations.size()
+            << ", is_provisional=" << rsp->is_provisional();
+  rsp->mutable_locations()->Reserve(locations.size());
+  for (const auto &loc : locations) {
+    loc.Serialize(*rsp->add_locations());
+  }
+
+  if (msg.with_metadata() && !rsp->is_provisional()) {
+    PackSymbolMetadata(*project, msg.symbol(), *rsp->mutable_metadata());
   }
 }
 
@@ -304,44 +411,38 @@ void Session::get_symbol_references(const uint8_t *buffer, size_t length) {
     return;
   }
 
-  SymbolReferenceLocationMap sym_locs;
-  project->LoadSymbolReferenceInfo(msg.symbol(), sym_locs);
-
-  auto pack_locations = [&](const PathLocPairSetMap &path_locs) {
-    for (const auto &kvp : path_locs) {
-      for (const auto &loc : kvp.second) {
-        try {
-          fspath abs_path = project->home_path() / kvp.first;
-          if (filesystem::exists(abs_path)) {
-            auto *item = rsp->add_locations();
-            item->set_path(abs_path.string());
-            item->set_line(loc.first);
-            item->set_column(loc.second);
-          } else {
-            LOG_WARN << "path=" << abs_path << "not found";
-          }
-        } catch (const std::exception &e) {
-          LOG_ERROR << "exception=" << e.what()
-                    << ", project=" << project->name()
-                    << ", home=" << project->home_path()
-                    << ", path=" << kvp.first;
-        }
+  // The references of a file are visited in a row.
+  FileId last_file_id = PathTable::kInvalidId;
+  std::string abs_path;
+  bool is_existing = false;
+
+  auto pack_location = [&](FileId file_id, uint32_t line, uint32_t column) {
+    if (file_id != last_file_id) {
+      last_file_id = file_id;
+      abs_path = project->GetFileAbsPath(file_id).string();
+      try {
+        is_existing = !abs_path.empty() && filesystem::exists(abs_path);
+      } catch (const std::exception &e) {
+        LOG_ERROR << "exception=" << e.what()
+                  << ", project=" << project->name()
+                  << ", home=" << project->home_path()
+                  << ", path=" << abs_path;
+        is_existing = false;
+      }
+      if (!is_existing) {
+        LOG_WARN << "path=" << abs_path << " not found";
       }
     }
-  };
 
-  if (!msg.path().empty()) {
-    auto module_name = project->GetModuleName(msg.path());
-    auto it = sym_locs.find(module_name);
-    if (it != sym_locs.end()) {
-      pack_locations(it->second);
-      return;
+    if (is_existing) {
+      auto *item = rsp->add_locations();
+      item->set_path(abs_path);
+      item->set_line(line);
+      item->set_column(column);
     }
-  }
+  };
 
-  for (const auto &kvp : sym_locs) {
-    pack_locations(kvp.second);
-  }
+  project->VisitSymbolReferences(msg.symbol(), msg.path(), pack_location);
 }
 
 void Session::list_file_symbols(const uint8_t *buffer, size_t length) {
@@ -358,7 +459,7 @@ void Session::list_file_symbols(const uint8_t *buffer, size_t length) {
     return;
   }
 
-  SymbolDefinitionMap symbols;
+  SymbolIdLocationMap symbols;
   if (!project->LoadFileDefinedSymbolInfo(msg.relative_path(), symbols)) {
     LOG_ERROR << kErrorFileNotFound << ", project=" << msg.proj_name();
     rsp->set_error(kErrorFileNotFound);
@@ -367,9 +468,12 @@ void Session::list_file_symbols(const uint8_t *buffer, size_t length) {
     pb_symbols->Reserve(symbols.size());
     for (const auto &kv : symbols) {
       auto *pb_symbol = pb_symbols->Add();
-      pb_symbol->set_name(kv.first);
+      pb_symbol->set_name(project->GetSymbolName(kv.first));
       pb_symbol->set_column(kv.second.column_number());
       pb_symbol->set_line(kv.second.line_number());
+      if (msg.with_metadata()) {
+        PackSymbolMetadata(*project, kv.first, *pb_symbol->mutable_metadata());
+      }
     }
   }
 }
@@ -398,7 +502,7 @@ void Session::list_file_references(const uint8_t *buffer, size_t length) {
     pb_symbols->Reserve(symbols.size());
     for (const auto &kv : symbols) {
       auto *pb_symbol = pb_symbols->Add();
-      pb_symbol->set_name(kv.first.first);
+      pb_symbol->set_name(project->GetSymbolName(kv.first.first));
       for (const auto &lcp : kv.second) {
         pb_symbol->set_line(lcp.first);
         pb_symbol->set_column(lcp.second);
@@ -432,4 +536,263 @@ void Session::rebuild_file(const uint8_t *buffer, size_t length) {
   project->RebuildFile(abs_path);
 }
 
+void Session::search_symbols(const uint8_t *buffer, size_t length) {
+  CHECK_PARSE_MESSAGE(SearchSymbolsReq, buffer, length);
+
+  LOG_DEBUG << "project=" << msg.proj_name() << ", query=" << msg.query()
+            << ", mode=" << msg.mode();
+
+  ResponseGuard<SearchSymbolsRsp> rsp(this, MessageID::SEARCH_SYMBOLS_RSP);
+  ProjectPtr project = ServerInst.GetProject(msg.proj_name());
+  if (!project) {
+    LOG_ERROR << kErrorProjectNotFound << ", project=" << msg.proj_name();
+    rsp->set_error(kErrorProjectNotFound);
+    return;
+  }
+
+  SymbolNameIndex::Mode mode = SymbolNameIndex::Mode::kPrefix;
+  if (msg.mode() == SearchSymbolsReq::SUBSTRING) {
+    mode = SymbolNameIndex::Mode::kSubstring;
+  } else if (msg.mode() == SearchSymbolsReq::FUZZY) {
+    mode = SymbolNameIndex::Mode::kFuzzy;
+  }
+
+  size_t limit = msg.limit() == 0 ? kDefaultSearchLimit
+                                  : std::min<size_t>(msg.limit(), kMaxSearchLimit);
+
+  auto matches = project->SearchSymbols(msg.query(), mode, limit);
+  rsp->mutable_matches()->Reserve(matches.size());
+  for (const auto &match : matches) {
+    auto *pb_match = rsp->add_matches();
+    auto symbol = project->GetSymbolName(match.id);
+    pb_match->set_name(match.name);
+    pb_match->set_symbol(symbol);
+    pb_match->set_score(match.score);
+    for (const auto &loc : project->QuerySymbolDefinition(symbol)) {
+      loc.Serialize(*pb_match->add_locations());
+    }
+  }
+}
+
+void Session::get_symbol_at_position(const uint8_t *buffer, size_t length) {
+  CHECK_PARSE_MESSAGE(GetSymbolAtPositionReq, buffer, length);
+
+  LOG_DEBUG << "project=" << msg.proj_name() << ", abs_path=" << msg.abs_path()
+            << ", line=" << msg.line() << ", column=" << msg.column();
+
+  ResponseGuard<GetSymbolAtPositionRsp> rsp(
+      this, MessageID::GET_SYMBOL_AT_POSITION_RSP);
+  ProjectPtr project = ServerInst.GetProject(msg.proj_name());
+  if (!project) {
+    LOG_ERROR << kErrorProjectNotFound << ", project=" << msg.proj_name();
+    rsp->set_error(kErrorProjectNotFound);
+    return;
+  }
+
+  SymbolId symbol_id = 0;
+  if (!project->FindSymbolAtPosition(msg.abs_path(), msg.line(), msg.column(),
+                                     symbol_id)) {
+    LOG_ERROR << kErrorSymbolNotFound << ", project=" << msg.proj_name()
+              << " abs_path=" << msg.abs_path() << " line=" << msg.line()
+              << " column=" << msg.column();
+    rsp->set_error(kErrorSymbolNotFound);
+    return;
+  }
+
+  auto symbol = project->GetSymbolName(symbol_id);
+  rsp->set_symbol(symbol);
+  if (msg.with_metadata()) {
+    PackSymbolMetadata(*project, symbol_id, *rsp->mutable_metadata());
+  }
+
+  // Prefer the definition in the module of the file.
+  Location location = project->QuerySymbolDefinition(symbol, msg.abs_path());
+  if (location.IsValid()) {
+    location.Serialize(*rsp->add_locations());
+    return;
+  }
+
+  for (const auto &loc : project->QuerySymbolDefinition(symbol)) {
+    loc.Serialize(*rsp->add_locations());
+  }
+}
+
+void Session::get_callers(const uint8_t *buffer, size_t length) {
+  CHECK_PARSE_MESSAGE(GetCallersReq, buffer, length);
+
+  LOG_DEBUG << "project=" << msg.proj_name() << ", symbol=" << msg.symbol()
+            << ", depth=" << msg.depth();
+
+  ResponseGuard<GetCallersRsp> rsp(this, MessageID::GET_CALLERS_RSP);
+  ProjectPtr project = ServerInst.GetProject(msg.proj_name());
+  if (!project) {
+    LOG_ERROR << kErrorProjectNotFound << ", project=" << msg.proj_name();
+    rsp->set_error(kErrorProjectNotFound);
+    return;
+  }
+
+  uint32_t depth = std::min(std::max(msg.depth(), 1U), kMaxCallDepth);
+  if (!PackEdges(*project, EdgeKind::kCall, msg.symbol(), false, depth,
+                 *rsp->mutable_edges(), SetCallEnds)) {
+    LOG_ERROR << kErrorSymbolNotFound << ", project=" << msg.proj_name()
+              << " symbol=" << msg.symbol();
+    rsp->set_error(kErrorSymbolNotFound);
+  }
+}
+
+void Session::get_callees(const uint8_t *buffer, size_t length) {
+  CHECK_PARSE_MESSAGE(GetCalleesReq, buffer, length);
+
+  LOG_DEBUG << "project=" << msg.proj_name() << ", symbol=" << msg.symbol()
+            << ", depth=" << msg.depth();
+
+  ResponseGuard<GetCalleesRsp> rsp(this, MessageID::GET_CALLEES_RSP);
+  ProjectPtr project = ServerInst.GetProject(msg.proj_name());
+  if (!project) {
+    LOG_ERROR << kErrorProjectNotFound << ", project=" << msg.proj_name();
+    rsp->set_error(kErrorProjectNotFound);
+    return;
+  }
+
+  uint32_t depth = std::min(std::max(msg.depth(), 1U), kMaxCallDepth);
+  if (!PackEdges(*project, EdgeKind::kCall, msg.symbol(), true, depth,
+                 *rsp->mutable_edges(), SetCallEnds)) {
+    LOG_ERROR << kErrorSymbolNotFound << ", project=" << msg.proj_name()
+              << " symbol=" << msg.symbol();
+    rsp->set_error(kErrorSymbolNotFound);
+  }
+}
+
+void Session::get_type_hierarchy(const uint8_t *buffer, size_t length) {
+  CHECK_PARSE_MESSAGE(GetTypeHierarchyReq, buffer, length);
+
+  LOG_DEBUG << "project=" << msg.proj_name() << ", symbol=" << msg.symbol()
+            << ", direction=" << msg.direction() << ", depth=" << msg.depth();
+
+  ResponseGuard<GetTypeHierarchyRsp> rsp(this,
+                                         MessageID::GET_TYPE_HIERARCHY_RSP);
+  ProjectPtr project = ServerInst.GetProject(msg.proj_name());
+  if (!project) {
+    LOG_ERROR << kErrorProjectNotFound << ", project=" << msg.proj_name();
+    rsp->set_error(kErrorProjectNotFound);
+    return;
+  }
+
+  bool is_forward = msg.direction() == GetTypeHierarchyReq::DERIVED;
+  uint32_t depth = msg.depth() == 0 ? kMaxHierarchyDepth
+                                    : std::min(msg.depth(), kMaxHierarchyDepth);
+  if (!PackEdges(*project, EdgeKind::kDerive, msg.symbol(), is_forward, depth,
+                 *rsp->mutable_edges(), SetSymbolEdgeEnds)) {
+    LOG_ERROR << kErrorSymbolNotFound << ", project=" << msg.proj_name()
+              << " symbol=" << msg.symbol();
+    rsp->set_error(kErrorSymbolNotFound);
+  }
+}
+
+void Session::get_overrides(const uint8_t *buffer, size_t length) {
+  CHECK_PARSE_MESSAGE(GetOverridesReq, buffer, length);
+
+  LOG_DEBUG << "project=" << msg.proj_name() << ", symbol=" << msg.symbol()
+            << ", direction=" << msg.direction() << ", depth=" << msg.depth();
+
+  ResponseGuard<GetOverridesRsp> rsp(this, MessageID::GET_OVERRIDES_RSP);
+  ProjectPtr project = ServerInst.GetProject(msg.proj_name());
+  if (!project) {
+    LOG_ERROR << kErrorProjectNotFound << ", project=" << msg.proj_name();
+    rsp->set_error(kErrorProjectNotFound);
+    return;
+  }
+
+  bool is_forward = msg.direction() == GetOverridesReq::OVERRIDERS;
+  uint32_t depth = msg.depth() == 0 ? kMaxHierarchyDepth
+                                    : std::min(msg.depth(), kMaxHierarchyDepth);
+  if (!PackEdges(*project, EdgeKind::kOverride, msg.symbol(), is_forward,
+                 depth, *rsp->mutable_edges(), SetSymbolEdgeEnds)) {
+    LOG_ERROR << kErrorSymbolNotFound << ", project=" << msg.proj_name()
+              << " symbol=" << msg.symbol();
+    rsp->set_error(kErrorSymbolNotFound);
+  }
+}
+
+void Session::get_includes(const uint8_t *buffer, size_t length) {
+  CHECK_PARSE_MESSAGE(GetIncludesReq, buffer, length);
+
+  LOG_DEBUG << "project=" << msg.proj_name() << ", path=" << msg.path()
+            << ", direction=" << msg.direction() << ", depth=" << msg.depth();
+
+  ResponseGuard<GetIncludesRsp> rsp(this, MessageID::GET_INCLUDES_RSP);
+  ProjectPtr project = ServerInst.GetProject(msg.proj_name());
+  if (!project) {
+    LOG_ERROR << kErrorProjectNotFound << ", project=" << msg.proj_name();
+    rsp->set_error(kErrorProjectNotFound);
+    return;
+  }
+
+  auto *edges = rsp->mutable_edges();
+  auto visitor = [&](FileId includer, FileId included, uint32_t depth,
+                     const EdgeSite &site) {
+    auto *edge = edges->Add();
+    edge->set_includer(project->GetFileAbsPath(includer).string());
+    edge->set_included(project->GetFileAbsPath(included).string());
+    edge->set_line(site.line);
+    edge->set_depth(depth);
+    return static_cast<size_t>(edges->size()) < kMaxEdges;
+  };
+
+  bool is_forward = msg.direction() == GetIncludesReq::INCLUDEES;
+  uint32_t depth = msg.depth() == 0 ? kMaxHierarchyDepth
+                                    : std::min(msg.depth(), kMaxHierarchyDepth);
+  if (!project->VisitIncludes(msg.path(), is_forward, depth, visitor)) {
+    LOG_ERROR << kErrorFileNotFound << ", project=" << msg.proj_name()
+              << " path=" << msg.path();
+    rsp->set_error(kErrorFileNotFound);
+  }
+}
+
+void Session::text_search(const uint8_t *buffer, size_t length) {
+  CHECK_PARSE_MESSAGE(TextSearchReq, buffer, length);
+
+  LOG_DEBUG << "project=" << msg.proj_name() << ", text=" << msg.text()
+            << ", ignore_case=" << msg.ignore_case();
+
+  ProjectPtr project = ServerInst.GetProject(msg.proj_name());
+  if (!project) {
+    LOG_ERROR << kErrorProjectNotFound << ", project=" << msg.proj_name();
+    ResponseGuard<TextSearchRsp> rsp(this, MessageID::TEXT_SEARCH_RSP);
+    rsp->set_error(kErrorProjectNotFound);
+    return;
+  }
+
+  if (msg.text().size() < TextIndex::kMinQuerySize) {
+    LOG_ERROR << kErrorQueryTooShort << ", project=" << msg.proj_name()
+              << " text=" << msg.text();
+    ResponseGuard<TextSearchRsp> rsp(this, MessageID::TEXT_SEARCH_RSP);
+    rsp->set_error(kErrorQueryTooShort);
+    return;
+  }
+
+  size_t limit = msg.limit() == 0 ? kDefaultSearchLimit
+                                  : std::min<size_t>(msg.limit(), kMaxSearchLimit);
+
+  // Reading the files may take long, so a worker does it. The session reads
+  // no more requests until it replies.
+  auto paths = std::make_shared<FsPathVec>(project->FindTextFiles(msg.text()));
+  ServerInst.PostToWorker([self = shared_from_this(), paths, text = msg.text(),
+                           ignore_case = msg.ignore_case(), limit]() {
+    auto matches = std::make_shared<std::vector<TextIndex::Match>>(
+        TextIndex::Search(*paths, text, ignore_case, limit));
+    ServerInst.PostToMain([self, matches]() {
+      ResponseGuard<TextSearchRsp> rsp(self.get(), MessageID::TEXT_SEARCH_RSP);
+      rsp->mutable_matches()->Reserve(matches->size());
+      for (const auto &match : *matches) {
+        auto *pb_match = rsp->add_matches();
+        pb_match->set_path(match.path.string());
+        pb_match->set_line(match.line);
+        pb_match->set_column(match.column);
+        pb_match->set_text(match.text);
+      }
+    });
+  });
+}
+
 }  // namespace symdb
@@ -46,6 +46,14 @@ private:
   void list_file_symbols(const uint8_t *buffer, size_t length);
   void list_file_references(const uint8_t *buffer, size_t length);
   void rebuild_file(const uint8_t *buffer, size_t length);
+  void search_symbols(const uint8_t *buffer, size_t length);
+  void get_symbol_at_position(const uint8_t *buffer, size_t length);
+  void get_callers(const uint8_t *buffer, size_t length);
+  void get_callees(const uint8_t *buffer, size_t length);
+  void get_type_hierarchy(const uint8_t *buffer, size_t length);
+  void get_overrides(const uint8_t *buffer, size_t length);
+  void get_includes(const uint8_t *buffer, size_t length);
+  void text_search(const uint8_t *buffer, size_t length);
 
 private:
   Socket socket_;
@@ -0,0 +1,543 @@
+#include "SymbolNameIndex.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace symdb {
+
+namespace {
+
+const size_t kKeysPerBlock = 16;
+// Compact when the delta is larger than both of them.
+const size_t kMinDeltaToCompact = 4096;
+const size_t kDeltaRatioToCompact = 16;
+// The minimal trigram similarity of a fuzzy match, in percent.
+const int kMinTrigramSimilarity = 30;
+// The queries shorter than it are answered by scanning all the names.
+const size_t kMinTrigramQuerySize = 3;
+
+// clang-format off
+const int kScoreExact          = 1000;
+const int kScoreSpellingPrefix = 800;
+const int kScoreQualifiedPrefix = 700;
+const int kScoreInitials       = 600;
+const int kScoreSubstring      = 500;
+const int kScoreWordBoundary   = 50;
+const int kScoreFuzzy          = 400;  // scaled by the similarity
+const int kScoreSubsequence    = 300;
+const int kScoreCaseMatched    = 30;
+// clang-format on
+
+char ToLower(char c) { return static_cast<char>(::tolower((unsigned char)c)); }
+
+std::string ToLower(const char *str, size_t size) {
+  std::string lower(size, '\0');
+  std::transform(str, str + size, lower.begin(),
+                 [](char c) { return ToLower(c); });
+  return lower;
+}
+
+size_t GetSpellingPos(const std::string &qualified_name) {
+  auto pos = qualified_name.rfind("::");
+  return pos == std::string::npos ? 0 : pos + 2;
+}
+
+// "GetSymbolName" -> "gsn", "get_symbol_name" -> "gsn", "HTTPServer" -> "hs"
+std::string GetInitials(const char *str, size_t size) {
+  std::string initials;
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char c = str[i];
+    if (!::isalnum(c)) {
+      continue;
+    }
+
+    bool is_start = i == 0 || !::isalnum((unsigned char)str[i - 1]);
+    if (!is_start && ::isupper(c)) {
+      unsigned char prev = str[i - 1];
+      bool is_next_lower = i + 1 < size && ::islower((unsigned char)str[i + 1]);
+      is_start = !::isupper(prev) || is_next_lower;
+    }
+
+    if (is_start) {
+      initials.push_back(ToLower(c));
+    }
+  }
+  return initials;
+}
+
+// The distinct trigrams of a lowercase string, sorted.
+std::vector<uint32_t> GetTrigrams(const char *lower, size_t size) {
+  std::vector<uint32_t> trigrams;
+  for (size_t i = 0; i + 3 <= size; ++i) {
+    trigrams.push_back((uint32_t)(unsigned char)lower[i] << 16 |
+                       (uint32_t)(unsigned char)lower[i + 1] << 8 |
+                       (uint32_t)(unsigned char)lower[i + 2]);
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+  return trigrams;
+}
+
+void AppendVarint(std::string &dest, uint32_t value) {
+  while (value >= 0x80) {
+    dest.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  dest.push_back(static_cast<char>(value));
+}
+
+uint32_t ReadVarint(const char *&pos) {
+  uint32_t value = 0;
+  for (int shift = 0;; shift += 7) {
+    uint32_t byte = static_cast<uint8_t>(*pos++);
+    value |= (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+}
+
+bool StartsWithIgnoreCase(const char *str, size_t size,
+                          const std::string &lower_prefix) {
+  if (size < lower_prefix.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < lower_prefix.size(); ++i) {
+    if (ToLower(str[i]) != lower_prefix[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t FindIgnoreCase(const char *str, size_t size,
+                      const std::string &lower_needle) {
+  if (size < lower_needle.size()) {
+    return std::string::npos;
+  }
+  for (size_t i = 0; i + lower_needle.size() <= size; ++i) {
+    if (StartsWithIgnoreCase(str + i, size - i, lower_needle)) {
+      return i;
+    }
+  }
+  return std::string::npos;
+}
+
+bool IsSubsequenceIgnoreCase(const char *str, size_t size,
+                             const std::string &lower_needle) {
+  size_t j = 0;
+  for (size_t i = 0; i < size && j < lower_needle.size(); ++i) {
+    if (ToLower(str[i]) == lower_needle[j]) {
+      ++j;
+    }
+  }
+  return j == lower_needle.size();
+}
+
+bool IsWordBoundary(const char *str, size_t pos) {
+  if (pos == 0) {
+    return true;
+  }
+  unsigned char prev = str[pos - 1];
+  unsigned char cur = str[pos];
+  return !::isalnum(prev) || (::islower(prev) && ::isupper(cur));
+}
+
+struct Query {
+  std::string text;
+  std::string lower;
+  SymbolNameIndex::Mode mode;
+  std::vector<uint32_t> trigrams;
+};
+
+// shared_trigrams is negative if it's unknown. Return a negative value if
+// name doesn't match at all.
+int Score(const Query &query, const char *name, size_t name_size,
+          size_t spelling_pos, int shared_trigrams) {
+  using Mode = SymbolNameIndex::Mode;
+
+  const char *spelling = name + spelling_pos;
+  size_t spelling_size = name_size - spelling_pos;
+  const auto &lower = query.lower;
+
+  int score = -1;
+  bool is_case_matched = false;
+  if (StartsWithIgnoreCase(spelling, spelling_size, lower)) {
+    score = spelling_size == lower.size() ? kScoreExact : kScoreSpellingPrefix;
+    is_case_matched = memcmp(spelling, query.text.data(), lower.size()) == 0;
+  } else if (StartsWithIgnoreCase(name, name_size, lower)) {
+    score = kScoreQualifiedPrefix;
+    is_case_matched = memcmp(name, query.text.data(), lower.size()) == 0;
+  } else if (query.mode == Mode::kPrefix) {
+    return -1;
+  } else if (query.mode == Mode::kFuzzy &&
+             GetInitials(spelling, spelling_size).compare(0, lower.size(),
+                                                          lower) == 0) {
+    score = kScoreInitials;
+  } else {
+    size_t pos = FindIgnoreCase(spelling, spelling_size, lower);
+    if (pos != std::string::npos) {
+      score = kScoreSubstring;
+      if (IsWordBoundary(spelling, pos)) {
+        score += kScoreWordBoundary;
+      }
+      is_case_matched =
+          memcmp(spelling + pos, query.text.data(), lower.size()) == 0;
+    } else if (query.mode == Mode::kSubstring) {
+      return -1;
+    }
+  }
+
+  if (score < 0) {
+    // Fuzzy only
+    if (shared_trigrams < 0) {
+      auto name_trigrams =
+          GetTrigrams(ToLower(spelling, spelling_size).c_str(), spelling_size);
+      std::vector<uint32_t> shared;
+      std::set_intersection(query.trigrams.begin(), query.trigrams.end(),
+                            name_trigrams.begin(), name_trigrams.end(),
+                            std::back_inserter(shared));
+      shared_trigrams = shared.size();
+    }
+
+    int all_trigrams = spelling_size >= 3 ? spelling_size - 2 : 0;
+    int union_size =
+        static_cast<int>(query.trigrams.size()) + all_trigrams - shared_trigrams;
+    int similarity = union_size > 0 ? shared_trigrams * 100 / union_size : 0;
+    if (similarity >= kMinTrigramSimilarity) {
+      score = kScoreFuzzy * similarity / 100;
+    }
+    if (IsSubsequenceIgnoreCase(spelling, spelling_size, lower)) {
+      score = std::max(score, kScoreSubsequence);
+    }
+    if (score < 0) {
+      return -1;
+    }
+  }
+
+  if (is_case_matched) {
+    score += kScoreCaseMatched;
+  }
+
+  // The shorter, the better.
+  return score - static_cast<int>(std::min<size_t>(spelling_size, 100));
+}
+
+struct Candidate {
+  int score;
+  InternId id;
+  const char *name;
+  size_t name_size;
+};
+
+}  // namespace
+
+void SymbolNameIndex::FrontCodedKeys::Build(
+    std::vector<std::pair<std::string, uint32_t>> &keys) {
+  std::sort(keys.begin(), keys.end());
+
+  blob_.clear();
+  block_offsets_.clear();
+
+  const std::string *prev = nullptr;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    const auto &key = keys[i].first;
+    if (i % kKeysPerBlock == 0) {
+      block_offsets_.push_back(blob_.size());
+      AppendVarint(blob_, key.size());
+      blob_.append(key);
+    } else {
+      size_t shared = 0;
+      size_t max_shared = std::min(prev->size(), key.size());
+      while (shared < max_shared && (*prev)[shared] == key[shared]) {
+        ++shared;
+      }
+      AppendVarint(blob_, shared);
+      AppendVarint(blob_, key.size() - shared);
+      blob_.append(key, shared, std::string::npos);
+    }
+    AppendVarint(blob_, keys[i].second);
+    prev = &key;
+  }
+
+  blob_.shrink_to_fit();
+  block_offsets_.shrink_to_fit();
+}
+
+template <typename Fn>
+void SymbolNameIndex::FrontCodedKeys::ForEachPrefixed(const std::string &prefix,
+                                                      Fn &&fn) const {
+  if (block_offsets_.empty()) {
+    return;
+  }
+
+  auto head_less = [this](uint32_t offset, const std::string &target) {
+    const char *pos = blob_.data() + offset;
+    uint32_t size = ReadVarint(pos);
+    int ret = memcmp(pos, target.data(), std::min<size_t>(size, target.size()));
+    return ret < 0 || (ret == 0 && size < target.size());
+  };
+
+  // The first block whose head is not less than prefix. The keys starting
+  // with prefix may begin in the previous block.
+  auto it = std::lower_bound(block_offsets_.begin(), block_offsets_.end(),
+                             prefix, head_less);
+  size_t block = it - block_offsets_.begin();
+  if (block > 0) {
+    --block;
+  }
+
+  std::string key;
+  const char *pos = blob_.data() + block_offsets_[block];
+  const char *end = blob_.data() + blob_.size();
+  for (size_t i = 0; pos < end; ++i) {
+    if (i % kKeysPerBlock == 0) {
+      uint32_t size = ReadVarint(pos);
+      key.assign(pos, size);
+      pos += size;
+    } else {
+      uint32_t shared = ReadVarint(pos);
+      uint32_t size = ReadVarint(pos);
+      key.resize(shared);
+      key.append(pos, size);
+      pos += size;
+    }
+    uint32_t entry_index = ReadVarint(pos);
+
+    if (key.compare(0, prefix.size(), prefix) == 0) {
+      fn(entry_index);
+    } else if (key > prefix) {
+      break;
+    }
+  }
+}
+
+template <typename Fn>
+void SymbolNameIndex::ForEachPosting(uint32_t trigram, Fn &&fn) const {
+  auto it = trigram_postings_.find(trigram);
+  if (it == trigram_postings_.end()) {
+    return;
+  }
+
+  const char *pos = it->second.data();
+  const char *end = pos + it->second.size();
+  uint32_t entry_index = 0;
+  while (pos < end) {
+    entry_index += ReadVarint(pos);
+    fn(entry_index);
+  }
+}
+
+void SymbolNameIndex::Clear() {
+  entries_.clear();
+  name_arena_.clear();
+  base_ids_.clear();
+  std::vector<std::pair<std::string, uint32_t>> no_keys;
+  spelling_keys_.Build(no_keys);
+  qualified_keys_.Build(no_keys);
+  initials_keys_.Build(no_keys);
+  trigram_postings_.clear();
+  delta_.clear();
+  removed_.clear();
+}
+
+void SymbolNameIndex::Add(InternId id, const std::string &qualified_name) {
+  if (base_ids_.find(id) != base_ids_.end()) {
+    removed_.insert(id);
+  }
+  delta_[id] = qualified_name;
+}
+
+void SymbolNameIndex::Remove(InternId id) {
+  if (base_ids_.find(id) != base_ids_.end()) {
+    removed_.insert(id);
+  }
+  delta_.erase(id);
+}
+
+size_t SymbolNameIndex::size() const {
+  // removed_ also has the replaced ones, which are in delta_.
+  return entries_.size() - removed_.size() + delta_.size();
+}
+
+bool SymbolNameIndex::NeedCompact() const {
+  size_t changes = delta_.size() + removed_.size();
+  return changes >= std::max(kMinDeltaToCompact,
+                             entries_.size() / kDeltaRatioToCompact);
+}
+
+void SymbolNameIndex::Compact() {
+  std::vector<std::pair<InternId, std::string>> names;
+  names.reserve(entries_.size() + delta_.size());
+  for (const auto &entry : entries_) {
+    if (!IsRemoved(entry.id)) {
+      names.emplace_back(
+          entry.id,
+          std::string{name_arena_.data() + entry.name_offset, entry.name_size});
+    }
+  }
+  for (auto &kv : delta_) {
+    names.emplace_back(kv.first, std::move(kv.second));
+  }
+
+  Clear();
+
+  entries_.reserve(names.size());
+  std::vector<std::pair<std::string, uint32_t>> spelling_keys;
+  std::vector<std::pair<std::string, uint32_t>> qualified_keys;
+  std::vector<std::pair<std::string, uint32_t>> initials_keys;
+  std::unordered_map<uint32_t, uint32_t> last_postings;
+
+  for (const auto &kv : names) {
+    const auto &name = kv.second;
+    uint32_t index = entries_.size();
+    size_t spelling_pos = GetSpellingPos(name);
+
+    entries_.push_back(Entry{kv.first, static_cast<uint32_t>(name_arena_.size()),
+                             static_cast<uint32_t>(name.size()),
+                             static_cast<uint32_t>(spelling_pos)});
+    name_arena_.append(name);
+    base_ids_[kv.first] = index;
+
+    auto lower = ToLower(name.data(), name.size());
+    auto lower_spelling = lower.substr(spelling_pos);
+    for (uint32_t trigram :
+         GetTrigrams(lower_spelling.data(), lower_spelling.size())) {
+      // The lists are sorted since the entries are added in order.
+      auto &posting = trigram_postings_[trigram];
+      auto it = last_postings.emplace(trigram, 0).first;
+      AppendVarint(posting, index - it->second);
+      it->second = index;
+    }
+
+    initials_keys.emplace_back(
+        GetInitials(name.data() + spelling_pos, name.size() - spelling_pos),
+        index);
+    if (spelling_pos > 0) {
+      qualified_keys.emplace_back(lower, index);
+    }
+    spelling_keys.emplace_back(std::move(lower_spelling), index);
+  }
+
+  for (auto &kv : trigram_postings_) {
+    kv.second.shrink_to_fit();
+  }
+  name_arena_.shrink_to_fit();
+
+  spelling_keys_.Build(spelling_keys);
+  qualified_keys_.Build(qualified_keys);
+  initials_keys_.Build(initials_keys);
+}
+
+std::vector<SymbolNameIndex::Match> SymbolNameIndex::Search(
+    const std::string &text, Mode mode, size_t limit) const {
+  std::vector<Match> matches;
+  if (text.empty() || limit == 0) {
+    return matches;
+  }
+
+  Query query{text, ToLower(text.data(), text.size()), mode, {}};
+  query.trigrams = GetTrigrams(query.lower.data(), query.lower.size());
+
+  bool use_trigrams =
+      mode != Mode::kPrefix && query.lower.size() >= kMinTrigramQuerySize &&
+      query.lower.find("::") == std::string::npos;
+
+  std::vector<Candidate> candidates;
+
+  auto add_base = [&](uint32_t index, int shared_trigrams) {
+    const auto &entry = entries_[index];
+    if (IsRemoved(entry.id)) {
+      return;
+    }
+    const char *name = name_arena_.data() + entry.name_offset;
+    int score = Score(query, name, entry.name_size, entry.spelling_pos,
+                      shared_trigrams);
+    if (score >= 0) {
+      candidates.push_back(Candidate{score, entry.id, name, entry.name_size});
+    }
+  };
+
+  if (mode != Mode::kPrefix && !use_trigrams) {
+    // Too short to use the trigrams, or a qualified name.
+    for (uint32_t i = 0; i < entries_.size(); ++i) {
+      add_base(i, -1);
+    }
+  } else {
+    // An entry may be reached from more than one key.
+    std::vector<bool> is_visited(entries_.size());
+    auto visit = [&](uint32_t index, int shared_trigrams) {
+      if (index < entries_.size() && !is_visited[index]) {
+        is_visited[index] = true;
+        add_base(index, shared_trigrams);
+      }
+    };
+
+    spelling_keys_.ForEachPrefixed(query.lower,
+                                   [&](uint32_t index) { visit(index, -1); });
+    qualified_keys_.ForEachPrefixed(query.lower,
+                                    [&](uint32_t index) { visit(index, -1); });
+    if (mode == Mode::kFuzzy) {
+      initials_keys_.ForEachPrefixed(query.lower,
+                                     [&](uint32_t index) { visit(index, -1); });
+    }
+
+    if (use_trigrams) {
+      std::vector<uint8_t> counts(entries_.size());
+      for (uint32_t trigram : query.trigrams) {
+        ForEachPosting(trigram, [&counts](uint32_t index) {
+          if (index < counts.size() && counts[index] < UINT8_MAX) {
+            ++counts[index];
+          }
+        });
+      }
+
+      // A substring has all the trigrams of the query, and a fuzzy match
+      // needs enough of them to reach the similarity.
+      size_t min_count = query.trigrams.size();
+      if (mode == Mode::kFuzzy) {
+        min_count = std::max<size_t>(
+            1, query.trigrams.size() * kMinTrigramSimilarity / 100);
+      }
+      for (uint32_t i = 0; i < counts.size(); ++i) {
+        if (counts[i] >= min_count) {
+          visit(i, counts[i]);
+        }
+      }
+    }
+  }
+
+  for (const auto &kv : delta_) {
+    const auto &name = kv.second;
+    int score =
+        Score(query, name.data(), name.size(), GetSpellingPos(name), -1);
+    if (score >= 0) {
+      candidates.push_back(Candidate{score, kv.first, name.data(), name.size()});
+    }
+  }
+
+  auto is_better = [](const Candidate &lhs, const Candidate &rhs) {
+    if (lhs.score != rhs.score) {
+      return lhs.score > rhs.score;
+    }
+    int ret = strncmp(lhs.name, rhs.name, std::min(lhs.name_size, rhs.name_size));
+    if (ret != 0) {
+      return ret < 0;
+    }
+    return lhs.name_size < rhs.name_size;
+  };
+
+  size_t count = std::min(limit, candidates.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + count,
+                    candidates.end(), is_better);
+
+  matches.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    const auto &c = candidates[i];
+    matches.push_back(Match{c.id, std::string{c.name, c.name_size}, c.score});
+  }
+  return matches;
+}
+
+}  // namespace symdb
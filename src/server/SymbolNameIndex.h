@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "InternTable.h"
+
+namespace symdb {
+
+// An in-memory index of the qualified names of the defined symbols, e.g.
+// "symdb::Project::Build", for the workspace symbol search. The last
+// component of a qualified name is called the spelling. Three kinds of the
+// lowercase keys are kept in the front-coded sorted arrays:
+//    - the spelling, e.g. "build"
+//    - the qualified name, e.g. "symdb::project::build"
+//    - the initials of the spelling, e.g. "gsn" of GetSymbolName
+// and the trigrams of the spelling have the delta-varint posting lists.
+//
+// The arrays are immutable. The changes since the last Compact() are kept in
+// a small delta, which is searched linearly.
+class SymbolNameIndex {
+public:
+  enum class Mode { kPrefix, kSubstring, kFuzzy };
+
+  struct Match {
+    InternId id;
+    std::string name;
+    int score;
+  };
+
+  void Clear();
+
+  // Replace the name if id is already added.
+  void Add(InternId id, const std::string &qualified_name);
+  void Remove(InternId id);
+
+  size_t size() const;
+
+  bool NeedCompact() const;
+  void Compact();
+
+  // Return at most limit matches, the best first. query is case-insensitive
+  // but the case-sensitive matches are ranked higher.
+  std::vector<Match> Search(const std::string &query, Mode mode,
+                            size_t limit) const;
+
+private:
+  struct Entry {
+    InternId id;
+    uint32_t name_offset;
+    uint32_t name_size;
+    uint32_t spelling_pos;
+  };
+
+  // A sorted array of keys, each of which refers to an entry. The keys are
+  // grouped into the blocks, in which a key only stores the suffix different
+  // from the previous one.
+  class FrontCodedKeys {
+  public:
+    void Build(std::vector<std::pair<std::string, uint32_t>> &keys);
+
+    // fn(entry_index) is called for each key starting with prefix.
+    template <typename Fn>
+    void ForEachPrefixed(const std::string &prefix, Fn &&fn) const;
+
+  private:
+    std::string blob_;
+    std::vector<uint32_t> block_offsets_;
+  };
+
+  // Decode the posting list of trigram, and call fn(entry_index).
+  template <typename Fn>
+  void ForEachPosting(uint32_t trigram, Fn &&fn) const;
+
+  bool IsRemoved(InternId id) const {
+    return removed_.find(id) != removed_.end();
+  }
+
+private:
+  // The immutable base.
+  std::vector<Entry> entries_;
+  std::string name_arena_;
+  std::unordered_map<InternId, uint32_t> base_ids_;
+  FrontCodedKeys spelling_keys_;
+  FrontCodedKeys qualified_keys_;
+  FrontCodedKeys initials_keys_;
+  std::unordered_map<uint32_t, std::string> trigram_postings_;
+
+  // The changes since the base is built.
+  std::unordered_map<InternId, std::string> delta_;
+  std::unordered_set<InternId> removed_;  // of the base
+};
+
+}  // namespace symdb
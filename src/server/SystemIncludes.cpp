@@ -0,0 +1,272 @@
+#include "SystemIncludes.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include "util/Exceptions.h"
+#include "util/Logger.h"
+
+namespace symdb {
+
+namespace {
+
+// Quote path for sh.
+std::string QuotePath(const std::string &path) {
+  std::string quoted{"'"};
+  for (char c : path) {
+    if (c == '\'') {
+      quoted += "'\\''";
+    } else {
+      quoted.push_back(c);
+    }
+  }
+  quoted.push_back('\'');
+  return quoted;
+}
+
+StringVec ProbeCompiler(const fspath &compiler, bool is_cpp) {
+  const std::string command = QuotePath(compiler.string()) + " -E -x " +
+                              (is_cpp ? "c++" : "c") +
+                              " - -v < /dev/null 2>&1";
+  const char kSysIncSearchBegin[] = "#include <...> search starts here:";
+  const char kSysIncSearchEnd[] = "End of search list.";
+
+  FILE *stream = popen(command.c_str(), "r");
+  if (stream == nullptr) {
+    THROW_AT_FILE_LINE("popen error: %s", strerror(errno));
+  }
+
+  StringVec flags;
+  bool is_started = false;
+  char line[4096];
+  while (fgets(line, sizeof(line), stream) != nullptr) {
+    char *start = line + strspn(line, " \t");
+    char *end = start + strlen(start);
+    if (end > start && *(end - 1) == '\n') {
+      --end;
+    }
+
+    std::string str_line{start, end};
+    if (is_started && str_line.find(kSysIncSearchEnd) != std::string::npos) {
+      break;
+    } else if (is_started) {
+      if (str_line.empty() || str_line.front() != '/') {
+        LOG_ERROR << "line is not a path: " << str_line;
+      } else {
+        flags.push_back("-isystem");
+        flags.push_back(str_line);
+      }
+    } else if (strstr(line, kSysIncSearchBegin) != nullptr) {
+      is_started = true;
+    }
+  }
+  pclose(stream);
+
+  LOG_INFO << "compiler=" << compiler << " is_cpp=" << is_cpp
+           << " system_dirs=" << flags.size() / 2;
+  return flags;
+}
+
+int64_t GetMtime(const fspath &path) {
+  try {
+    return symutil::last_wtime(path);
+  } catch (const std::exception &e) {
+    LOG_ERROR << "exception=" << e.what() << ", path=" << path;
+    return -1;
+  }
+}
+
+}  // namespace
+
+void SystemIncludes::Init(const fspath &cache_path) {
+  std::lock_guard<std::mutex> guard{mutex_};
+  cache_path_ = cache_path;
+  entries_.clear();
+
+  std::ifstream ifs{cache_path};
+  std::string line;
+  // mtime \t c|c++ \t compiler [\t dir]...
+  while (std::getline(ifs, line)) {
+    std::istringstream iss{line};
+    std::string mtime;
+    std::string lang;
+    std::string compiler;
+    if (!std::getline(iss, mtime, '\t') || !std::getline(iss, lang, '\t') ||
+        !std::getline(iss, compiler, '\t')) {
+      LOG_WARN << "bad line, path=" << cache_path << " line=" << line;
+      continue;
+    }
+
+    auto flags = std::make_shared<StringVec>();
+    std::string dir;
+    while (std::getline(iss, dir, '\t')) {
+      flags->push_back("-isystem");
+      flags->push_back(dir);
+    }
+    entries_[MakeKey(compiler, lang == "c++")] =
+        Entry{std::strtoll(mtime.c_str(), nullptr, 10), flags};
+  }
+
+  LOG_INFO << "path=" << cache_path << " compilers=" << entries_.size();
+}
+
+void SystemIncludes::Probe(const std::vector<Compiler> &compilers,
+                           size_t max_threads) {
+  std::vector<std::pair<const Compiler *, int64_t>> probes;
+  {
+    std::unordered_set<std::string> probed_keys;
+    std::lock_guard<std::mutex> guard{mutex_};
+    for (const auto &compiler : compilers) {
+      auto key = MakeKey(compiler.path, compiler.is_cpp);
+      int64_t mtime = GetMtime(compiler.path);
+      auto it = entries_.find(key);
+      if (mtime < 0 || (it != entries_.end() && it->second.mtime == mtime) ||
+          !probed_keys.insert(key).second) {
+        continue;
+      }
+      probes.emplace_back(&compiler, mtime);
+    }
+  }
+
+  if (probes.empty()) {
+    return;
+  }
+
+  // The compilers are mostly waited for, so the threads needn't be workers.
+  std::vector<StringVecPtr> results(probes.size());
+  size_t nr_threads = std::max<size_t>(1, std::min(max_threads, probes.size()));
+  auto probe = [&](size_t first) {
+    for (size_t i = first; i < probes.size(); i += nr_threads) {
+      const auto *compiler = probes[i].first;
+      try {
+        results[i] = std::make_shared<StringVec>(
+            ProbeCompiler(compiler->path, compiler->is_cpp));
+      } catch (const std::exception &e) {
+        LOG_ERROR << "exception=" << e.what()
+                  << ", compiler=" << compiler->path;
+        // Not retried until it's modified.
+        results[i] = std::make_shared<StringVec>();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(nr_threads - 1);
+  for (size_t i = 1; i < nr_threads; ++i) {
+    threads.emplace_back(probe, i);
+  }
+  probe(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::lock_guard<std::mutex> guard{mutex_};
+  for (size_t i = 0; i < probes.size(); ++i) {
+    const auto *compiler = probes[i].first;
+    entries_[MakeKey(compiler->path, compiler->is_cpp)] =
+        Entry{probes[i].second, results[i]};
+  }
+  Save();
+}
+
+StringVecPtr SystemIncludes::Get(const fspath &compiler, bool is_cpp) const {
+  std::lock_guard<std::mutex> guard{mutex_};
+  auto it = entries_.find(MakeKey(compiler, is_cpp));
+  if (it == entries_.end() || it->second.flags->empty()) {
+    return StringVecPtr{};
+  }
+  return it->second.flags;
+}
+
+void SystemIncludes::Put(const fspath &compiler_path, bool is_cpp,
+                         const StringVec &dirs) {
+  // Keyed by the resolved one like the probed ones.
+  fspath compiler = ResolveCompiler(compiler_path.string(), std::string{});
+  int64_t mtime = compiler.empty() ? -1 : GetMtime(compiler);
+  if (mtime < 0) {
+    return;
+  }
+
+  auto flags = std::make_shared<StringVec>();
+  flags->reserve(dirs.size() * 2);
+  for (const auto &dir : dirs) {
+    flags->push_back("-isystem");
+    flags->push_back(dir);
+  }
+
+  std::lock_guard<std::mutex> guard{mutex_};
+  auto &entry = entries_[MakeKey(compiler, is_cpp)];
+  if (entry.flags && entry.mtime == mtime && *entry.flags == *flags) {
+    return;
+  }
+  entry = Entry{mtime, flags};
+  Save();
+}
+
+fspath SystemIncludes::ResolveCompiler(const std::string &compiler,
+                                       const std::string &directory) {
+  fspath path;
+  if (compiler.find('/') != std::string::npos) {
+    path = symutil::absolute_path(compiler, directory);
+  } else {
+    const char *env_path = getenv("PATH");
+    std::istringstream iss{env_path ? env_path : ""};
+    std::string dir;
+    while (std::getline(iss, dir, ':')) {
+      fspath candidate = fspath{dir.empty() ? "." : dir} / compiler;
+      if (::access(candidate.c_str(), X_OK) == 0) {
+        path = std::move(candidate);
+        break;
+      }
+    }
+  }
+
+  // Not canonical, since a symlink may be a launcher which runs the compiler
+  // by its own name, e.g. /usr/lib/ccache/g++ -> /usr/bin/ccache.
+  if (path.empty() || ::access(path.c_str(), X_OK) != 0) {
+    LOG_DEBUG << "compiler not found, compiler=" << compiler
+              << " directory=" << directory;
+    return fspath{};
+  }
+  return path.lexically_normal();
+}
+
+std::string SystemIncludes::MakeKey(const fspath &compiler, bool is_cpp) {
+  return (is_cpp ? "c++\t" : "c\t") + compiler.string();
+}
+
+void SystemIncludes::Save() const {
+  if (cache_path_.empty()) {
+    return;
+  }
+
+  fspath tmp_path = cache_path_;
+  tmp_path += ".tmp";
+  {
+    std::ofstream ofs{tmp_path, std::ios::trunc};
+    for (const auto &kvp : entries_) {
+      // The flags are -isystem and dir in pairs.
+      ofs << kvp.second.mtime << '\t' << kvp.first;
+      for (size_t i = 1; i < kvp.second.flags->size(); i += 2) {
+        ofs << '\t' << (*kvp.second.flags)[i];
+      }
+      ofs << '\n';
+    }
+    if (!ofs) {
+      LOG_ERROR << "failed to write " << tmp_path;
+      return;
+    }
+  }
+
+  if (::rename(tmp_path.c_str(), cache_path_.c_str()) != 0) {
+    LOG_ERROR << "rename error: " << strerror(errno) << ", path=" << tmp_path;
+  }
+}
+
+}  // namespace symdb
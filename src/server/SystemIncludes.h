@@ -0,0 +1,68 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+// The system include directories of the compilers, found by
+// "<compiler> -E -x <lang> - -v" as "-isystem <dir>" flags. They're cached
+// by the path and the mtime of the compiler in a file, so a restart forks
+// no compiler unless it's upgraded.
+//
+// All are thread-safe after Init().
+class SystemIncludes {
+public:
+  struct Compiler {
+    fspath path;  // absolute
+    bool is_cpp;
+  };
+
+  static SystemIncludes &Instance() {
+    static SystemIncludes obj;
+    return obj;
+  }
+
+  // Load the cache, a missing or bad one is ignored.
+  void Init(const fspath &cache_path);
+
+  // Probe the compilers which aren't cached or are modified since, up to
+  // max_threads at a time, and save the cache if any is probed.
+  void Probe(const std::vector<Compiler> &compilers, size_t max_threads);
+
+  // Return nullptr if compiler isn't probed or it failed.
+  StringVecPtr Get(const fspath &compiler, bool is_cpp) const;
+
+  // Put the directories told by others, e.g. cmake.
+  void Put(const fspath &compiler, bool is_cpp, const StringVec &dirs);
+
+  // Resolve compiler of a command run in directory like the shell, i.e. by
+  // PATH if it has no '/'. The symlinks are kept. Return empty if it's not
+  // found.
+  static fspath ResolveCompiler(const std::string &compiler,
+                                const std::string &directory);
+
+private:
+  struct Entry {
+    int64_t mtime;
+    StringVecPtr flags;
+  };
+
+  SystemIncludes() = default;
+
+  static std::string MakeKey(const fspath &compiler, bool is_cpp);
+
+  void Save() const;
+
+private:
+  mutable std::mutex mutex_;
+  fspath cache_path_;
+  std::unordered_map<std::string, Entry> entries_;
+};
+
+}  // namespace symdb
+
+#define SystemIncludesInst symdb::SystemIncludes::Instance()
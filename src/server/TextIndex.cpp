@@ -0,0 +1,298 @@
+#include "TextIndex.h"
+#include <algorithm>
+#include <fstream>
+#include "util/Logger.h"
+
+namespace symdb {
+
+namespace {
+
+// The larger files are mostly generated or data.
+const size_t kMaxTextFileSize = 8 << 20;
+// A file having a NUL in the head is binary.
+const size_t kBinaryCheckSize = 8192;
+const size_t kMaxMatchTextSize = 256;
+const size_t kMinDeadDocsToCompact = 1024;
+
+char ToLower(char c) { return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c; }
+
+uint32_t MakeTrigram(const char *p) {
+  return (static_cast<uint32_t>(static_cast<uint8_t>(ToLower(p[0]))) << 16) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(ToLower(p[1]))) << 8) |
+         static_cast<uint32_t>(static_cast<uint8_t>(ToLower(p[2])));
+}
+
+void AppendVarint32(std::string &dest, uint32_t value) {
+  while (value >= 0x80) {
+    dest.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  dest.push_back(static_cast<char>(value));
+}
+
+// Decode the delta-varint doc ids of data, and call fn(doc).
+template <typename Fn>
+void ForEachDoc(const std::string &data, Fn &&fn) {
+  uint32_t doc = 0;
+  size_t pos = 0;
+  while (pos < data.size()) {
+    uint32_t delta = 0;
+    for (int shift = 0; pos < data.size(); shift += 7) {
+      auto byte = static_cast<uint8_t>(data[pos++]);
+      delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        break;
+      }
+    }
+    doc += delta;
+    fn(doc);
+  }
+}
+
+}  // namespace
+
+bool TextIndex::ReadFile(const fspath &path, std::string &content) {
+  std::ifstream ifs{path, std::ios::binary};
+  if (!ifs) {
+    return false;
+  }
+
+  ifs.seekg(0, std::ios::end);
+  auto size = ifs.tellg();
+  if (size < 0 || static_cast<size_t>(size) > kMaxTextFileSize) {
+    return false;
+  }
+  ifs.seekg(0, std::ios::beg);
+
+  content.resize(static_cast<size_t>(size));
+  if (!ifs.read(&content[0], size)) {
+    return false;
+  }
+
+  size_t head_size = std::min(content.size(), kBinaryCheckSize);
+  return content.find('\0') >= head_size;
+}
+
+void TextIndex::ExtractTrigrams(const std::string &content,
+                                Trigrams &trigrams) {
+  trigrams.clear();
+  if (content.size() < kMinQuerySize) {
+    return;
+  }
+
+  trigrams.reserve(content.size() - kMinQuerySize + 1);
+  for (size_t i = 0; i + kMinQuerySize <= content.size(); ++i) {
+    trigrams.push_back(MakeTrigram(content.data() + i));
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+  trigrams.shrink_to_fit();
+}
+
+void TextIndex::Clear() {
+  docs_.clear();
+  path_docs_.clear();
+  postings_.clear();
+  dead_docs_ = 0;
+}
+
+void TextIndex::Update(const fspath &path, const Trigrams &trigrams) {
+  Remove(path);
+
+  auto doc = static_cast<DocId>(docs_.size());
+  docs_.push_back(path);
+  path_docs_.emplace(path, doc);
+
+  for (uint32_t trigram : trigrams) {
+    auto it = postings_.find(trigram);
+    if (it == postings_.end()) {
+      auto &posting = postings_[trigram];
+      AppendVarint32(posting.data, doc);
+      posting.last_doc = doc;
+    } else {
+      AppendVarint32(it->second.data, doc - it->second.last_doc);
+      it->second.last_doc = doc;
+    }
+  }
+}
+
+void TextIndex::Remove(const fspath &path) {
+  auto it = path_docs_.find(path);
+  if (it == path_docs_.end()) {
+    return;
+  }
+
+  docs_[it->second].clear();
+  path_docs_.erase(it);
+  ++dead_docs_;
+}
+
+bool TextIndex::NeedCompact() const {
+  return dead_docs_ >= kMinDeadDocsToCompact && dead_docs_ >= size();
+}
+
+void TextIndex::Compact() {
+  const DocId kDeadId = static_cast<DocId>(-1);
+  std::vector<DocId> new_ids(docs_.size(), kDeadId);
+  std::vector<fspath> new_docs;
+  new_docs.reserve(path_docs_.size());
+  for (DocId doc = 0; doc < docs_.size(); ++doc) {
+    if (!IsDead(doc)) {
+      new_ids[doc] = static_cast<DocId>(new_docs.size());
+      new_docs.push_back(std::move(docs_[doc]));
+    }
+  }
+
+  for (auto it = postings_.begin(); it != postings_.end();) {
+    Posting posting{std::string{}, 0};
+    ForEachDoc(it->second.data, [&](DocId doc) {
+      DocId new_id = new_ids[doc];
+      if (new_id == kDeadId) {
+        return;
+      }
+      AppendVarint32(posting.data, posting.data.empty()
+                                       ? new_id
+                                       : new_id - posting.last_doc);
+      posting.last_doc = new_id;
+    });
+
+    if (posting.data.empty()) {
+      it = postings_.erase(it);
+    } else {
+      posting.data.shrink_to_fit();
+      it->second = std::move(posting);
+      ++it;
+    }
+  }
+
+  docs_.swap(new_docs);
+  for (auto &kv : path_docs_) {
+    kv.second = new_ids[kv.second];
+  }
+
+  LOG_INFO << "compacted, files=" << docs_.size()
+           << " dead_files=" << dead_docs_ << " trigrams=" << postings_.size();
+  dead_docs_ = 0;
+}
+
+std::vector<TextIndex::DocId> TextIndex::FindCandidates(
+    const std::string &query) const {
+  std::vector<const std::string *> lists;
+  for (size_t i = 0; i + kMinQuerySize <= query.size(); ++i) {
+    auto it = postings_.find(MakeTrigram(query.data() + i));
+    if (it == postings_.end()) {
+      return std::vector<DocId>{};
+    }
+    lists.push_back(&it->second.data);
+  }
+
+  // Start from the shortest list, so the candidates only shrink.
+  std::sort(lists.begin(), lists.end(),
+            [](const std::string *lhs, const std::string *rhs) {
+              return lhs->size() < rhs->size();
+            });
+  lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+  std::vector<DocId> candidates;
+  ForEachDoc(*lists.front(), [&](DocId doc) {
+    if (!IsDead(doc)) {
+      candidates.push_back(doc);
+    }
+  });
+
+  std::vector<DocId> intersection;
+  for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+    intersection.clear();
+    auto cit = candidates.begin();
+    ForEachDoc(*lists[i], [&](DocId doc) {
+      while (cit != candidates.end() && *cit < doc) {
+        ++cit;
+      }
+      if (cit != candidates.end() && *cit == doc) {
+        intersection.push_back(doc);
+      }
+    });
+    candidates.swap(intersection);
+  }
+
+  return candidates;
+}
+
+FsPathVec TextIndex::FindFiles(const std::string &query) const {
+  FsPathVec paths;
+  if (query.size() < kMinQuerySize) {
+    return paths;
+  }
+
+  auto candidates = FindCandidates(query);
+  paths.reserve(candidates.size());
+  for (DocId doc : candidates) {
+    paths.push_back(docs_[doc]);
+  }
+  return paths;
+}
+
+std::vector<TextIndex::Match> TextIndex::Search(const FsPathVec &paths,
+                                                const std::string &query,
+                                                bool ignore_case,
+                                                size_t limit) {
+  std::vector<Match> matches;
+  if (query.size() < kMinQuerySize || limit == 0) {
+    return matches;
+  }
+
+  std::string needle = query;
+  if (ignore_case) {
+    std::transform(needle.begin(), needle.end(), needle.begin(), ToLower);
+  }
+
+  std::string content;
+  std::string folded;
+  for (const auto &path : paths) {
+    if (!ReadFile(path, content)) {
+      LOG_WARN << "read failed, path=" << path;
+      continue;
+    }
+
+    const std::string *haystack = &content;
+    if (ignore_case) {
+      folded.resize(content.size());
+      std::transform(content.begin(), content.end(), folded.begin(), ToLower);
+      haystack = &folded;
+    }
+
+    uint32_t line = 1;
+    size_t line_begin = 0;
+    size_t pos = haystack->find(needle);
+    while (pos != std::string::npos) {
+      // Count the lines up to the match.
+      for (size_t nl = content.find('\n', line_begin);
+           nl != std::string::npos && nl < pos;
+           nl = content.find('\n', line_begin)) {
+        ++line;
+        line_begin = nl + 1;
+      }
+
+      size_t line_end = content.find('\n', pos);
+      if (line_end == std::string::npos) {
+        line_end = content.size();
+      }
+      matches.push_back(Match{
+          path, line, static_cast<uint32_t>(pos - line_begin + 1),
+          content.substr(line_begin,
+                         std::min(line_end - line_begin, kMaxMatchTextSize))});
+      if (matches.size() >= limit) {
+        return matches;
+      }
+
+      // At most one match per line.
+      pos = line_end < content.size() ? haystack->find(needle, line_end + 1)
+                                      : std::string::npos;
+    }
+  }
+
+  return matches;
+}
+
+}  // namespace symdb
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "util/TypeAlias.h"
+
+namespace symdb {
+
+// An in-memory trigram index of the text of the project files. It finds what
+// the semantic index can't, e.g. the text in the comments and the macros,
+// and it's ready long before the first build finishes.
+//
+// Each trigram of the lowercase text has a delta-varint posting list of the
+// files containing it, so a search only reads the files having all the
+// trigrams of the query. A file gets a new document id whenever it's
+// updated, which keeps the posting lists sorted by appending. The old id is
+// dead until Compact().
+//
+// Only the static ones are used by the workers, e.g. Search() which reads
+// the files.
+class TextIndex {
+public:
+  using Trigrams = std::vector<uint32_t>;
+
+  struct Match {
+    fspath path;
+    uint32_t line;     // 1-based
+    uint32_t column;   // 1-based, in bytes
+    std::string text;  // of the line, truncated if it's too long
+  };
+
+  // The shortest query, which has a trigram at least.
+  static constexpr size_t kMinQuerySize = 3;
+
+  // Return false if path can't be read, or it's too large or binary.
+  static bool ReadFile(const fspath &path, std::string &content);
+
+  // Return the unique trigrams of content, sorted.
+  static void ExtractTrigrams(const std::string &content, Trigrams &trigrams);
+
+  void Clear();
+
+  // Replace the text of path if it's already added.
+  void Update(const fspath &path, const Trigrams &trigrams);
+  void Remove(const fspath &path);
+
+  size_t size() const { return path_docs_.size(); }
+
+  bool NeedCompact() const;
+  void Compact();
+
+  // Return the files which may contain query, in the order they're added.
+  FsPathVec FindFiles(const std::string &query) const;
+
+  // Return at most limit matches of paths, one per line at most. The query
+  // is a literal text of kMinQuerySize bytes at least.
+  static std::vector<Match> Search(const FsPathVec &paths,
+                                   const std::string &query, bool ignore_case,
+                                   size_t limit);
+
+private:
+  using DocId = uint32_t;
+
+  struct Posting {
+    std::string data;
+    DocId last_doc;
+  };
+
+  std::vector<DocId> FindCandidates(const std::string &query) const;
+
+  bool IsDead(DocId doc) const { return docs_[doc].empty(); }
+
+private:
+  std::vector<fspath> docs_;  // DocId -> path, empty if it's dead
+  std::map<fspath, DocId> path_docs_;
+  std::unordered_map<uint32_t, Posting> postings_;
+  size_t dead_docs_ = 0;
+};
+
+}  // namespace symdb
@@ -59,18 +59,45 @@ void TranslationUnit::CollectSymbols() {
   CXCursor cursor = clang_getTranslationUnitCursor(translation_unit_);
 
   (void)clang_visitChildren(cursor, &TranslationUnit::VisitCursor, this);
+
+  clang_getInclusions(translation_unit_, &TranslationUnit::VisitInclusion,
+                      this);
+}
+
+void TranslationUnit::VisitInclusion(CXFile included_file,
+                                     CXSourceLocation *inclusion_stack,
+                                     unsigned stack_size,
+                                     CXClientData client_data) {
+  // The main file
+  if (stack_size == 0) {
+    return;
+  }
+
+  TranslationUnit *unit = reinterpret_cast<TranslationUnit *>(client_data);
+
+  // inclusion_stack[0] is the #include directive.
+  Location includer{inclusion_stack[0]};
+  auto included = CXFileToFilepath(included_file);
+  if (includer.IsValid() && !included.empty()) {
+    unit->includes_.emplace(std::make_pair(includer.filename(), included),
+                            includer.line_number());
+  }
 }
 
 CXChildVisitResult TranslationUnit::VisitCursor(CXCursor cursor,
                                                 CXCursor parent,
                                                 CXClientData client_data) {
-  (void)parent;
-
   Location location(clang_getCursorLocation(cursor));
 
   TranslationUnit *unit = reinterpret_cast<TranslationUnit *>(client_data);
 
   do {
+    // The macros of the headers are wanted too, see header_macros().
+    if (clang_getCursorKind(cursor) == CXCursor_MacroDefinition) {
+      unit->CollectMacroDefinition(cursor, location);
+      break;
+    }
+
     if (location.filename() != unit->filename_) {
       break;
     }
@@ -86,6 +113,7 @@ CXChildVisitResult TranslationUnit::VisitCursor(CXCursor cursor,
     LineColPair lcp{location.line_number(), location.column_number()};
     if (cursorKind == CXCursor_MacroExpansion) {
       unit->macro_expansions_.insert(lcp);
+      unit->CollectMacroExpansion(cursor, location, symbol);
       break;
     }
 
@@ -96,12 +124,25 @@ CXChildVisitResult TranslationUnit::VisitCursor(CXCursor cursor,
     }
 
     bool is_definition = clang_isCursorDefinition(cursor);
+    const std::string *caller = unit->UpdateCaller(cursor, is_definition);
+    unit->CollectHierarchy(cursor, parent, location.line_number());
+
     if (is_definition && IsWantedDefinition(cursor)) {
       auto usr = CXStringToString(clang_getCursorUSR(cursor));
       if (usr.empty()) {
         LOG_ERROR << "No USR name at " << location;
       } else {
         unit->defined_symbols_[usr] = location;
+        unit->defined_symbol_names_[usr] = GetCursorQualifiedName(cursor);
+        unit->symbol_sizes_[lcp] = symbol.size();
+
+        auto &metadata = unit->defined_symbol_metadata_[usr];
+        metadata.kind = cursorKind;
+        metadata.display_name =
+            CXStringToString(clang_getCursorDisplayName(cursor));
+        metadata.type = CXStringToString(clang_getTypeSpelling(cursorType));
+        metadata.brief_comment =
+            CXStringToString(clang_Cursor_getBriefCommentText(cursor));
       }
     } else if (!is_definition && IsWantedReference(cursor)) {
       auto referencedCursor = clang_getCursorReferenced(cursor);
@@ -115,6 +156,17 @@ CXChildVisitResult TranslationUnit::VisitCursor(CXCursor cursor,
         SymbolPathPair symbol_path { usr, origin_loc.filename() };
         unit->referred_symbols_[symbol_path].insert(
             LineColPair{location.line_number(), location.column_number()});
+
+        // The spelling of the reference may be of the expression, e.g.
+        // "class Foo" of a type reference.
+        unit->symbol_sizes_.emplace(
+            lcp, CXStringToString(clang_getCursorSpelling(referencedCursor))
+                     .size());
+
+        if (caller && IsFunction(referencedCursor)) {
+          unit->calls_.emplace(std::make_pair(*caller, usr),
+                               location.line_number());
+        }
       } else {
         CXCursorKind kind = clang_getCursorKind(referencedCursor);
         auto usr = CXStringToString(clang_getCursorUSR(referencedCursor));
@@ -149,6 +201,122 @@ CXChildVisitResult TranslationUnit::VisitCursor(CXCursor cursor,
   return CXChildVisit_Continue;
 }
 
+const std::string *TranslationUnit::UpdateCaller(CXCursor cursor,
+                                                bool is_definition) {
+  unsigned offset = 0;
+  clang_getExpansionLocation(clang_getCursorLocation(cursor), nullptr, nullptr,
+                             nullptr, &offset);
+  while (!callers_.empty() && callers_.back().second < offset) {
+    callers_.pop_back();
+  }
+
+  if (is_definition && IsFunction(cursor)) {
+    unsigned end_offset = 0;
+    clang_getExpansionLocation(clang_getRangeEnd(clang_getCursorExtent(cursor)),
+                               nullptr, nullptr, nullptr, &end_offset);
+    callers_.emplace_back(CXStringToString(clang_getCursorUSR(cursor)),
+                          end_offset);
+  }
+
+  if (callers_.empty() || callers_.back().first.empty()) {
+    return nullptr;
+  }
+  return &callers_.back().first;
+}
+
+void TranslationUnit::CollectHierarchy(CXCursor cursor, CXCursor parent,
+                                       uint32_t line) {
+  CXCursorKind kind = clang_getCursorKind(cursor);
+  if (kind == CXCursor_CXXBaseSpecifier) {
+    CXCursor base = clang_getTypeDeclaration(clang_getCursorType(cursor));
+    auto base_usr = CXStringToString(clang_getCursorUSR(base));
+    auto derived_usr = CXStringToString(clang_getCursorUSR(parent));
+    if (!base_usr.empty() && !derived_usr.empty()) {
+      derivations_.emplace(std::make_pair(base_usr, derived_usr), line);
+    }
+  } else if (kind == CXCursor_CXXMethod) {
+    CXCursor *overridden = nullptr;
+    unsigned num_overridden = 0;
+    clang_getOverriddenCursors(cursor, &overridden, &num_overridden);
+    if (num_overridden == 0) {
+      return;
+    }
+
+    auto usr = CXStringToString(clang_getCursorUSR(cursor));
+    for (unsigned i = 0; i < num_overridden; ++i) {
+      auto overridden_usr =
+          CXStringToString(clang_getCursorUSR(overridden[i]));
+      if (!usr.empty() && !overridden_usr.empty()) {
+        overrides_.emplace(std::make_pair(overridden_usr, usr), line);
+      }
+    }
+    clang_disposeOverriddenCursors(overridden);
+  }
+}
+
+void TranslationUnit::CollectMacroDefinition(CXCursor cursor,
+                                             const Location &location) {
+  // The builtin ones have no file.
+  if (!location.IsValid() ||
+      clang_Location_isInSystemHeader(clang_getCursorLocation(cursor))) {
+    return;
+  }
+
+  // It has the file and the offset unless it's in a system header, so the
+  // same header macro has the same USR in all the units.
+  auto usr = CXStringToString(clang_getCursorUSR(cursor));
+  auto name = CXStringToString(clang_getCursorSpelling(cursor));
+  if (usr.empty() || name.empty()) {
+    return;
+  }
+
+  if (location.filename() == filename_) {
+    LineColPair lcp{location.line_number(), location.column_number()};
+    defined_symbols_[usr] = location;
+    defined_symbol_names_[usr] = name;
+    symbol_sizes_[lcp] = name.size();
+
+    auto &metadata = defined_symbol_metadata_[usr];
+    metadata.kind = CXCursor_MacroDefinition;
+    metadata.display_name = name;
+    return;
+  }
+
+  auto it = header_macros_.find(location.filename());
+  if (it == header_macros_.end()) {
+    it = header_macros_.emplace(location.filename(), HeaderMacros{}).first;
+    CXFile file = nullptr;
+    clang_getSpellingLocation(clang_getCursorLocation(cursor), &file, nullptr,
+                              nullptr, nullptr);
+    if (file) {
+      it->second.last_mtime = clang_getFileTime(file);
+    }
+  }
+  it->second.definitions[usr] = location;
+  it->second.names[usr] = name;
+}
+
+void TranslationUnit::CollectMacroExpansion(CXCursor cursor,
+                                            const Location &location,
+                                            const std::string &name) {
+  CXCursor definition = clang_getCursorReferenced(cursor);
+  if (clang_Cursor_isNull(definition) ||
+      clang_getCursorKind(definition) != CXCursor_MacroDefinition ||
+      clang_Location_isInSystemHeader(clang_getCursorLocation(definition))) {
+    return;
+  }
+
+  auto usr = CXStringToString(clang_getCursorUSR(definition));
+  Location origin_loc{definition};
+  if (usr.empty() || !origin_loc.IsValid()) {
+    return;
+  }
+
+  LineColPair lcp{location.line_number(), location.column_number()};
+  referred_symbols_[SymbolPathPair{usr, origin_loc.filename()}].insert(lcp);
+  symbol_sizes_.emplace(lcp, name.size());
+}
+
 Location TranslationUnit::GetSourceLocation(const std::string &filename,
                                             unsigned int line,
                                             unsigned int column) const {
@@ -244,6 +412,21 @@ bool TranslationUnit::IsWantedReference(CXCursor cursor) {
   }
 }
 
+bool TranslationUnit::IsFunction(CXCursor cursor) {
+  switch (clang_getCursorKind(cursor)) {
+    case CXCursorKind::CXCursor_FunctionDecl:
+    case CXCursorKind::CXCursor_CXXMethod:
+    case CXCursorKind::CXCursor_Constructor:
+    case CXCursorKind::CXCursor_Destructor:
+    case CXCursorKind::CXCursor_ConversionFunction:
+    case CXCursorKind::CXCursor_FunctionTemplate:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
 // We only consider non-static definitions.
 bool TranslationUnit::IsWantedReferenceDef(CXCursor cursor) {
   std::string ns = symdb::GetCursorNamespace(cursor);
@@ -13,7 +13,34 @@ using LineColPair = std::pair<uint32_t, uint32_t>;
 using LineColPairSet = std::set<LineColPair>;
 using SymbolPathPair = std::pair<std::string, std::string>;
 using SymbolDefinitionMap = std::map<std::string, Location>;
+using SymbolNameMap = std::map<std::string, std::string>;
 using SymbolReferenceMap = std::map<SymbolPathPair, LineColPairSet>;
+using SymbolSizeMap = std::map<LineColPair, uint32_t>;
+
+// What editors show without parsing the file, e.g. hover and outline
+struct SymbolMetadata {
+  uint32_t kind = 0;  // CXCursorKind
+  std::string display_name;  // e.g. "Build(const fspath &)"
+  std::string type;
+  std::string brief_comment;
+};
+
+using SymbolMetadataMap = std::map<std::string, SymbolMetadata>;
+
+// The macros defined in a header, which are the same in all the units
+// including it unless the header changes or the #if's differ.
+struct HeaderMacros {
+  int64_t last_mtime = 0;
+  SymbolDefinitionMap definitions;  // USR -> location
+  SymbolNameMap names;              // USR -> macro name
+};
+
+// header path -> macros
+using HeaderMacroMap = std::map<std::string, HeaderMacros>;
+
+// (from, to) -> the line where the edge is found, in the file of the
+// translation unit except the includes, which are in the includer.
+using EdgeLineMap = std::map<std::pair<std::string, std::string>, uint32_t>;
 
 class TranslationUnit {
 public:
@@ -40,6 +67,25 @@ public:
 
   SymbolDefinitionMap& defined_symbols() { return defined_symbols_; }
   SymbolReferenceMap& reference_symbols() { return referred_symbols_; }
+  // USR -> qualified name of the defined symbols
+  SymbolNameMap& defined_symbol_names() { return defined_symbol_names_; }
+  // USR -> metadata of the defined symbols
+  SymbolMetadataMap& defined_symbol_metadata() {
+    return defined_symbol_metadata_;
+  }
+  // The spelling size of the symbol at a definition or reference
+  SymbolSizeMap& symbol_sizes() { return symbol_sizes_; }
+  // (caller USR, callee USR) of the functions defined in the file
+  EdgeLineMap& calls() { return calls_; }
+  // (base USR, derived USR) of the classes defined in the file
+  EdgeLineMap& derivations() { return derivations_; }
+  // (overridden USR, overrider USR) of the methods declared in the file
+  EdgeLineMap& overrides() { return overrides_; }
+  // (includer path, included path) of all the files in the unit
+  EdgeLineMap& includes() { return includes_; }
+  // The macros defined in the headers, the ones of the main file are in
+  // defined_symbols().
+  HeaderMacroMap& header_macros() { return header_macros_; }
 
 private:
   void CheckClangDiagnostic();
@@ -52,11 +98,36 @@ private:
   static bool IsWantedReference(CXCursor cursor);
   // The definition of the reference
   static bool IsWantedReferenceDef(CXCursor cursor);
+  static bool IsFunction(CXCursor cursor);
+
+  void CollectHierarchy(CXCursor cursor, CXCursor parent, uint32_t line);
+  void CollectMacroDefinition(CXCursor cursor, const Location &location);
+  void CollectMacroExpansion(CXCursor cursor, const Location &location,
+                             const std::string &name);
+
+  static void VisitInclusion(CXFile included_file,
+                             CXSourceLocation *inclusion_stack,
+                             unsigned stack_size, CXClientData client_data);
+
+  // The function whose body encloses the visited cursor, if any.
+  const std::string *UpdateCaller(CXCursor cursor, bool is_definition);
 
   CXTranslationUnit translation_unit_;
   std::string filename_;
   SymbolDefinitionMap defined_symbols_;
+  SymbolNameMap defined_symbol_names_;
+  SymbolMetadataMap defined_symbol_metadata_;
   SymbolReferenceMap referred_symbols_;
+  SymbolSizeMap symbol_sizes_;
+  EdgeLineMap calls_;
+  EdgeLineMap derivations_;
+  EdgeLineMap overrides_;
+  EdgeLineMap includes_;
+  HeaderMacroMap header_macros_;
+  // The functions being visited, (USR, end offset of the extent). The
+  // cursors are visited in order, so a function ends once a cursor after it
+  // is visited.
+  std::vector<std::pair<std::string, unsigned>> callers_;
   std::set<LineColPair> macro_expansions_;
 };
 
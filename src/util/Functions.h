@@ -56,6 +56,23 @@ inline bool path_has_prefix(const fspath &path, const fspath &prefix) {
   return path_str.compare(0, prefix_str.size(), prefix_str) == 0;
 }
 
+// Unlike filesystem::relative(), it's purely lexical and never touches the
+// file system. Symlinks are not resolved, so both paths should be canonical
+// ones or derived from a canonical base.
+inline fspath lexical_relative(const fspath &path, const fspath &base) {
+  if (!path.is_absolute()) {
+    return path.lexically_normal();
+  }
+  return path.lexically_normal().lexically_relative(base);
+}
+
+inline fspath lexical_absolute(const fspath &path, const fspath &base) {
+  if (path.is_absolute()) {
+    return path.lexically_normal();
+  }
+  return (base / path).lexically_normal();
+}
+
 inline void replace_string(std::string &dest, const std::string &from,
                            const std::string &to) {
   auto pos = dest.find(from);
@@ -30,6 +30,22 @@ struct MessageID {
     LIST_PROJECT_FILES_RSP,
     REBUILD_FILE_REQ,
     REBUILD_FILE_RSP,
+    SEARCH_SYMBOLS_REQ,
+    SEARCH_SYMBOLS_RSP,
+    GET_SYMBOL_AT_POSITION_REQ,
+    GET_SYMBOL_AT_POSITION_RSP,
+    GET_CALLERS_REQ,
+    GET_CALLERS_RSP,
+    GET_CALLEES_REQ,
+    GET_CALLEES_RSP,
+    GET_TYPE_HIERARCHY_REQ,
+    GET_TYPE_HIERARCHY_RSP,
+    GET_OVERRIDES_REQ,
+    GET_OVERRIDES_RSP,
+    GET_INCLUDES_REQ,
+    GET_INCLUDES_RSP,
+    TEXT_SEARCH_REQ,
+    TEXT_SEARCH_RSP,
     MAX_MESSAGE_ID,
   };
 };
@@ -50,6 +66,7 @@ static const std::string kErrorInvalidProjName =
 static const std::string kErrorProjectNotFound = "project not found";
 static const std::string kErrorFileNotFound = "file not found";
 static const std::string kErrorSymbolNotFound = "symbol not found";
+static const std::string kErrorQueryTooShort = "query too short";
 
 }  // namespace symdb
 